@@ -6,8 +6,10 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <cctype>
+#include <cstring>
 
 #include "rapidxml/rapidxml.hpp"
 #include "rapidxml/rapidxml_utils.hpp"
@@ -39,16 +41,22 @@ static const bool xml2json_numeric_support = false;
 /* [End]   This part is configurable */
 
 // Avoided any namespace pollution.
-static bool xml2json_has_digits_only(const char * input, bool *hasDecimal)
+//
+// Documents are parsed with rapidxml::parse_non_destructive, so the input is
+// never written to and names and values are (pointer, size) pairs into it
+// rather than terminated strings. The JSON refers to them where they lie, so
+// the input must outlive the writer.
+static bool xml2json_has_digits_only(const char * input, std::size_t size, bool *hasDecimal)
 {
-    if (input == nullptr)
+    if (input == nullptr || size == 0)
         return false;  // treat empty input as a string (probably will be an empty string)
 
     const char * runPtr = input;
+    const char * endPtr = input + size;
 
     *hasDecimal = false;
 
-    while (*runPtr != '\0')
+    while (runPtr != endPtr)
     {
         if (*runPtr == '.')
         {
@@ -67,16 +75,143 @@ static bool xml2json_has_digits_only(const char * input, bool *hasDecimal)
     return true;
 }
 
-void xml2json_to_array_form(const char *name, rapidjson::Value &jsvalue, rapidjson::Value &jsvalue_chd, rapidjson::Document::AllocatorType& allocator)
+// Appends code point as UTF-8, returns the bytes written
+static std::size_t xml2json_put_utf8(unsigned long code, char *out)
+{
+    if (code < 0x80)
+    {
+        out[0] = static_cast<char>(code);
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        out[0] = static_cast<char>(0xC0 | (code >> 6));
+        out[1] = static_cast<char>(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        out[0] = static_cast<char>(0xE0 | (code >> 12));
+        out[1] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out[2] = static_cast<char>(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | (code >> 18));
+    out[1] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+    out[2] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out[3] = static_cast<char>(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Translates the entity reference at text, which starts with '&'. Returns the
+// characters consumed and the bytes written to out, or 0 when it is not one
+// rapidxml would have translated.
+static std::size_t xml2json_translate_entity(const char *text, const char *end, char *out, std::size_t *written)
+{
+    static const struct { const char *name; std::size_t size; char value; } named[] =
+    {
+        {"&amp;", 5, '&'}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}, {"&apos;", 6, '\''}, {"&quot;", 6, '"'}
+    };
+    for (std::size_t i = 0; i < sizeof(named) / sizeof(named[0]); i++)
+    {
+        if (static_cast<std::size_t>(end - text) >= named[i].size && memcmp(text, named[i].name, named[i].size) == 0)
+        {
+            out[0] = named[i].value;
+            *written = 1;
+            return named[i].size;
+        }
+    }
+    if (end - text < 4 || text[1] != '#')
+        return 0;
+    const char *runPtr = text + 2;
+    int base = 10;
+    if (*runPtr == 'x')
+    {
+        base = 16;
+        runPtr++;
+    }
+    unsigned long code = 0;
+    const char *digits = runPtr;
+    while (runPtr != end && isxdigit(*runPtr) && (base == 16 || isdigit(*runPtr)) && code <= 0x10FFFF)
+    {
+        code = code * base + (isdigit(*runPtr) ? *runPtr - '0' : (tolower(*runPtr) - 'a' + 10));
+        runPtr++;
+    }
+    if (runPtr == digits || runPtr == end || *runPtr != ';' || code > 0x10FFFF)
+        throw rapidxml::parse_error("expected ;", const_cast<char *>(runPtr));
+    *written = xml2json_put_utf8(code, out);
+    return runPtr + 1 - text;
+}
+
+// Text without entity references is referenced in place. Text with them is
+// translated into a copy, as the destructive parse used to do in the input.
+static void xml2json_set_text(rapidjson::Value &jsvalue, const char *text, std::size_t size, rapidjson::Document::AllocatorType& allocator)
+{
+    const char *amp = size ? static_cast<const char *>(memchr(text, '&', size)) : nullptr;
+    if (!amp)
+    {
+        jsvalue.SetString(rapidjson::StringRef(text, static_cast<rapidjson::SizeType>(size)));
+        return;
+    }
+    // A translated reference is never longer than the reference
+    char *translated = static_cast<char *>(allocator.Malloc(size));
+    const char *end = text + size;
+    std::size_t used = amp - text;
+    memcpy(translated, text, used);
+    for (const char *runPtr = amp; runPtr != end;)
+    {
+        std::size_t written = 0;
+        std::size_t consumed = (*runPtr == '&') ? xml2json_translate_entity(runPtr, end, translated + used, &written) : 0;
+        if (consumed)
+        {
+            runPtr += consumed;
+            used += written;
+        }
+        else
+        {
+            translated[used++] = *runPtr++;
+        }
+    }
+    jsvalue.SetString(rapidjson::StringRef(translated, static_cast<rapidjson::SizeType>(used)));
+}
+
+static void xml2json_set_value(rapidjson::Value &jsvalue, const char *text, std::size_t size, rapidjson::Document::AllocatorType& allocator)
+{
+    bool hasDecimal;
+    if (xml2json_numeric_support == false || xml2json_has_digits_only(text, size, &hasDecimal) == false)
+    {
+        xml2json_set_text(jsvalue, text, size, allocator);
+    }
+    else
+    {
+        std::string number(text, size);
+        if (hasDecimal)
+        {
+            double value = std::strtod(number.c_str(), nullptr);
+            jsvalue.SetDouble(value);
+        }
+        else
+        {
+            long int value = std::strtol(number.c_str(), nullptr, 0);
+            jsvalue.SetInt(value);
+        }
+    }
+}
+
+static rapidjson::Value xml2json_name(const char *name, std::size_t size)
+{
+    return rapidjson::Value(rapidjson::StringRef(name, static_cast<rapidjson::SizeType>(size)));
+}
+
+void xml2json_to_array_form(const char *name, std::size_t name_size, rapidjson::Value &jsvalue, rapidjson::Value &jsvalue_chd, rapidjson::Document::AllocatorType& allocator)
 {
     rapidjson::Value jsvalue_target; // target to do some operation
-    rapidjson::Value jn;             // this is a must, partially because of the latest version of rapidjson
-    jn.SetString(name, allocator);
-    jsvalue_target = jsvalue.FindMember(name)->value;
+    rapidjson::Value jn = xml2json_name(name, name_size);
+    jsvalue_target = jsvalue.FindMember(jn)->value;
     if(jsvalue_target.IsArray())
     {
         jsvalue_target.PushBack(jsvalue_chd, allocator);
-        jsvalue.RemoveMember(name);
+        jsvalue.RemoveMember(jn);
         jsvalue.AddMember(jn, jsvalue_target, allocator);
     }
     else
@@ -86,7 +221,7 @@ void xml2json_to_array_form(const char *name, rapidjson::Value &jsvalue, rapidjs
         jsvalue_array.SetArray();
         jsvalue_array.PushBack(jsvalue_target, allocator);
         jsvalue_array.PushBack(jsvalue_chd, allocator);
-        jsvalue.RemoveMember(name);
+        jsvalue.RemoveMember(jn);
         jsvalue.AddMember(jn, jsvalue_array, allocator);
     }
 }
@@ -94,36 +229,16 @@ void xml2json_to_array_form(const char *name, rapidjson::Value &jsvalue, rapidjs
 void xml2json_add_attributes(rapidxml::xml_node<> *xmlnode, rapidjson::Value &jsvalue, rapidjson::Document::AllocatorType& allocator)
 {
     rapidxml::xml_attribute<> *myattr;
+    const std::size_t prefix_size = sizeof(xml2json_attribute_name_prefix) - 1;
     for(myattr = xmlnode->first_attribute(); myattr; myattr = myattr->next_attribute())
     {
         rapidjson::Value jn, jv;
-        jn.SetString((std::string(xml2json_attribute_name_prefix) + myattr->name()).c_str(), allocator);
-
-        if (xml2json_numeric_support == false)
-        {
-            jv.SetString(myattr->value(), allocator);
-        }
-        else
-        {
-            bool hasDecimal;
-            if (xml2json_has_digits_only(myattr->value(), &hasDecimal) == false)
-            {
-                jv.SetString(myattr->value(), allocator);
-            }
-            else
-            {
-                if (hasDecimal)
-                {
-                    double value = std::strtod(myattr->value(),nullptr);
-                    jv.SetDouble(value);
-                }
-                else
-                {
-                    long int value = std::strtol(myattr->value(), nullptr, 0);
-                    jv.SetInt(value);
-                }
-            }
-        }
+        std::size_t name_size = prefix_size + myattr->name_size();
+        char *name = static_cast<char *>(allocator.Malloc(name_size));
+        memcpy(name, xml2json_attribute_name_prefix, prefix_size);
+        memcpy(name + prefix_size, myattr->name(), myattr->name_size());
+        jn.SetString(rapidjson::StringRef(name, static_cast<rapidjson::SizeType>(name_size)));
+        xml2json_set_value(jv, myattr->value(), myattr->value_size(), allocator);
         jsvalue.AddMember(jn, jv, allocator);
     }
 }
@@ -141,7 +256,10 @@ void xml2json_traverse_node(rapidxml::xml_node<> *xmlnode, rapidjson::Value &jsv
     if((xmlnode->type() == rapidxml::node_data || xmlnode->type() == rapidxml::node_cdata) && xmlnode->value())
     {
         // case: pure_text
-        jsvalue.SetString(xmlnode->value(), allocator);  // then addmember("#text" , jsvalue, allocator)
+        if (xmlnode->type() == rapidxml::node_cdata)
+            jsvalue.SetString(rapidjson::StringRef(xmlnode->value(), static_cast<rapidjson::SizeType>(xmlnode->value_size())));
+        else
+            xml2json_set_text(jsvalue, xmlnode->value(), xmlnode->value_size(), allocator);  // then addmember("#text" , jsvalue, allocator)
     }
     else if(xmlnode->type() == rapidxml::node_element)
     {
@@ -151,8 +269,8 @@ void xml2json_traverse_node(rapidxml::xml_node<> *xmlnode, rapidjson::Value &jsv
             {
                 // case: <e attr="xxx">text</e>
                 rapidjson::Value jn, jv;
-                jn.SetString(xml2json_text_additional_name, allocator);
-                jv.SetString(xmlnode->first_node()->value(), allocator);
+                jn.SetString(rapidjson::StringRef(xml2json_text_additional_name));
+                xml2json_set_text(jv, xmlnode->first_node()->value(), xmlnode->first_node()->value_size(), allocator);
                 jsvalue.AddMember(jn, jv, allocator);
                 xml2json_add_attributes(xmlnode, jsvalue, allocator);
                 return;
@@ -174,62 +292,36 @@ void xml2json_traverse_node(rapidxml::xml_node<> *xmlnode, rapidjson::Value &jsv
             else if(xmlnode->first_node()->type() == rapidxml::node_data && count_children(xmlnode) == 1)
             {
                 // case: <e>text</e>
-                if (xml2json_numeric_support == false)
-                {
-                    jsvalue.SetString(rapidjson::StringRef(xmlnode->first_node()->value()), allocator);
-                }
-                else
-                {
-                    bool hasDecimal;
-                    if (xml2json_has_digits_only(xmlnode->first_node()->value(), &hasDecimal) == false)
-                    {
-                        jsvalue.SetString(rapidjson::StringRef(xmlnode->first_node()->value()), allocator);
-                    }
-                    else
-                    {
-                        if (hasDecimal)
-                        {
-                            double value = std::strtod(xmlnode->first_node()->value(), nullptr);
-                            jsvalue.SetDouble(value);
-                        }
-                        else
-                        {
-                            long int value = std::strtol(xmlnode->first_node()->value(), nullptr, 0);
-                            jsvalue.SetInt(value);
-                        }
-                    }
-                }
+                xml2json_set_value(jsvalue, xmlnode->first_node()->value(), xmlnode->first_node()->value_size(), allocator);
                 return;
             }
         }
         if(xmlnode->first_node())
         {
             // case: complex else...
-            std::map<std::string, int> name_count;
             for(xmlnode_chd = xmlnode->first_node(); xmlnode_chd; xmlnode_chd = xmlnode_chd->next_sibling())
             {
-                std::string current_name;
                 const char *name_ptr = NULL;
-                rapidjson::Value jn, jv;
+                std::size_t name_size = 0;
                 if(xmlnode_chd->type() == rapidxml::node_data || xmlnode_chd->type() == rapidxml::node_cdata)
                 {
-                    current_name = xml2json_text_additional_name;
-                    name_count[current_name]++;
-                    jv.SetString(xml2json_text_additional_name, allocator);
-                    name_ptr = jv.GetString();
+                    name_ptr = xml2json_text_additional_name;
+                    name_size = sizeof(xml2json_text_additional_name) - 1;
                 }
                 else if(xmlnode_chd->type() == rapidxml::node_element)
                 {
-                    current_name = xmlnode_chd->name();
-                    name_count[current_name]++;
                     name_ptr = xmlnode_chd->name();
+                    name_size = xmlnode_chd->name_size();
                 }
+                // An earlier sibling of the same name is already a member,
+                // which is what counting the names with a map used to find
+                bool repeated = name_ptr && jsvalue.HasMember(xml2json_name(name_ptr, name_size));
                 xml2json_traverse_node(xmlnode_chd, jsvalue_chd, allocator);
-                if(name_count[current_name] > 1 && name_ptr)
-                    xml2json_to_array_form(name_ptr, jsvalue, jsvalue_chd, allocator);
+                if(repeated)
+                    xml2json_to_array_form(name_ptr, name_size, jsvalue, jsvalue_chd, allocator);
                 else
                 {
-                    jn.SetString(name_ptr, allocator);
+                    rapidjson::Value jn = xml2json_name(name_ptr, name_size);
                     jsvalue.AddMember(jn, jsvalue_chd, allocator);
                 }
             }
@@ -241,32 +333,49 @@ void xml2json_traverse_node(rapidxml::xml_node<> *xmlnode, rapidjson::Value &jsv
     }
 }
 
-std::string xml2json(const char *xml_str)
+// Parses into xml_doc, which must be empty, and builds the JSON DOM and the
+// writer's stack with allocator, so callers can reuse both across messages.
+// xml_str must be terminated but is not modified.
+template <typename OutputStream>
+void xml2json(const char *xml_str, rapidxml::xml_document<> &xml_doc, rapidjson::Document::AllocatorType &allocator, OutputStream &out)
 {
     //file<> fdoc("track_orig.xml"); // could serve another use case
-    rapidxml::xml_document<> *xml_doc = new rapidxml::xml_document<>();
-    xml_doc->parse<0> (const_cast<char *>(xml_str));
+    xml_doc.parse<rapidxml::parse_non_destructive> (const_cast<char *>(xml_str));
 
-    rapidjson::Document js_doc;
+    rapidjson::Document js_doc(&allocator);
     js_doc.SetObject();
-    rapidjson::Document::AllocatorType& allocator = js_doc.GetAllocator();
 
     rapidxml::xml_node<> *xmlnode_chd;
 
-    for(xmlnode_chd = xml_doc->first_node(); xmlnode_chd; xmlnode_chd = xmlnode_chd->next_sibling())
+    for(xmlnode_chd = xml_doc.first_node(); xmlnode_chd; xmlnode_chd = xmlnode_chd->next_sibling())
     {
         rapidjson::Value jsvalue_chd;
         jsvalue_chd.SetObject();
         //rapidjson::Value jsvalue_name(xmlnode_chd->name(), allocator);
         //js_doc.AddMember(jsvalue_name, jsvalue_chd, allocator);
         xml2json_traverse_node(xmlnode_chd, jsvalue_chd, allocator);
-        js_doc.AddMember(rapidjson::StringRef(xmlnode_chd->name()), jsvalue_chd, allocator);
+        rapidjson::Value jn = xml2json_name(xmlnode_chd->name(), xmlnode_chd->name_size());
+        js_doc.AddMember(jn, jsvalue_chd, allocator);
     }
 
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    rapidjson::Writer<OutputStream, rapidjson::UTF8<>, rapidjson::UTF8<>, rapidjson::Document::AllocatorType> writer(out, &allocator);
     js_doc.Accept(writer);
-    delete xml_doc;
+}
+
+// Writes the JSON to any rapidjson output stream, so callers can write
+// straight into their own buffers
+template <typename OutputStream>
+void xml2json(const char *xml_str, OutputStream &out)
+{
+    std::unique_ptr<rapidxml::xml_document<> > xml_doc(new rapidxml::xml_document<>());
+    rapidjson::Document::AllocatorType allocator;
+    xml2json(xml_str, *xml_doc, allocator, out);
+}
+
+std::string xml2json(const char *xml_str)
+{
+    rapidjson::StringBuffer buffer;
+    xml2json(xml_str, buffer);
     return buffer.GetString();
 }
 
@@ -0,0 +1,428 @@
+/*
+ * bridge_bench.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ *
+ * Microbenchmarks for the functions every EA message passes through. Each
+ * result is printed as one JSON object per line so runs from different
+ * releases can be diffed or loaded into a spreadsheet. The bench is built
+ * with EM_ALLOC_ACCOUNTING so allocations are reported per stage, and
+ * --check_alloc_budget fails the run when the steady state message path
+ * allocates more than AllocAccounting::kMessageBudget allows.
+ */
+
+#include "ea_connector.hpp"
+#include "map_converter.hpp"
+#include "ros_connector.hpp"
+#include "alloc_accounting.hpp"
+#ifdef EM_PROTOBUF
+#include "robot_commands.pb.h"
+#endif
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace
+{
+	// Swallows the per message logging of the code under test
+	class NullBuffer : public std::streambuf
+	{
+	protected:
+		int overflow(int inChar) override { return inChar; }
+		std::streamsize xsputn(const char *, std::streamsize inCount) override { return inCount; }
+	};
+
+	std::string PointListXml(const size_t &inPoints, const bool &inTimed)
+	{
+		std::stringstream ss;
+		ss << "<robot><map><point_list><id>1</id>";
+		for (size_t i = 0; i < inPoints; i++)
+		{
+			// A lawnmower pattern, so every few points there is a corner
+			double_t x = (i / 10) * 2.0;
+			double_t y = ((i / 10) % 2 ? 9 - i % 10 : i % 10) * 1.5;
+			ss << "<point>" << x << "," << y;
+			if (inTimed)
+			{
+				ss << ",0.8,0.4," << i * 2.5;
+			}
+			ss << "</point>";
+		}
+		ss << "</point_list></map></robot>";
+		return ss.str();
+	}
+
+#ifdef EM_PROTOBUF
+	// The same points as PointListXml, as a serialized ats.base.RobotCommand
+	std::string PointListCommand(const size_t &inPoints, const bool &inTimed)
+	{
+		ats::base::RobotCommand aCommand;
+		ats::base::PointList *aList = aCommand.mutable_point_list();
+		aList->set_id(1);
+		for (size_t i = 0; i < inPoints; i++)
+		{
+			aList->add_x((i / 10) * 2.0);
+			aList->add_y(((i / 10) % 2 ? 9 - i % 10 : i % 10) * 1.5);
+			if (inTimed)
+			{
+				aList->add_v(0.8);
+				aList->add_a(0.4);
+				aList->add_t(i * 2.5);
+			}
+		}
+		return aCommand.SerializeAsString();
+	}
+#endif
+
+	std::string PolygonSvg(const size_t &inVertices)
+	{
+		std::stringstream ss;
+		ss << "<svg><polygon map:type=\"nogo\" points=\"";
+		for (size_t i = 0; i < inVertices; i++)
+		{
+			double_t aAngle = 2 * M_PI * i / inVertices;
+			ss << (i ? " " : "") << 50 + 40 * cos(aAngle) << "," << 50 + 40 * sin(aAngle);
+		}
+		ss << "\"/></svg>";
+		return ss.str();
+	}
+}
+
+class BridgeBench
+{
+public:
+	BridgeBench(boost::asio::io_context &inIoContext, std::ostream &outResults, const std::string &inFilter, const double &inMinTimeMs) :
+		fEAConnector(inIoContext, "127.0.0.1", 0, "127.0.0.1"),
+		fResults(outResults),
+		fFilter(inFilter),
+		fMinTime(inMinTimeMs * 1e6)
+	{
+		fEAConnector.fMessageInterchange = &fMessageInterchange;
+		fRosConnector.Start(&fMessageInterchange, true);
+	}
+
+	// Returns false when a stage went over its budget
+	bool CheckAllocBudget()
+	{
+		std::string aBuffer = PointListXml(AllocAccounting::kBudgetPoints, true) + "\n";
+		AllocAccounting::TAllocCounts aCounts;
+		uint64_t aIterations = 0;
+		MeasureAllocations(aCounts, aIterations, [&] { RunMessagePath(aBuffer); });
+
+		bool aWithinBudget = true;
+		for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+		{
+			double aPerMessage = static_cast<double>(aCounts.allocations[i]) / aIterations;
+			if (aPerMessage > AllocAccounting::kMessageBudget[i])
+			{
+				char aLine[256];
+				snprintf(aLine, sizeof(aLine), "{\"alloc_budget_exceeded\":\"%s\",\"allocs_per_message\":%.2f,\"budget\":%llu}",
+					AllocAccounting::StageName(static_cast<AllocAccounting::TAllocStage>(i)), aPerMessage, static_cast<unsigned long long>(AllocAccounting::kMessageBudget[i]));
+				fResults << aLine << std::endl;
+				aWithinBudget = false;
+			}
+		}
+		return aWithinBudget;
+	}
+
+	void Run()
+	{
+		BenchMessagePath();
+		BenchMessagePathProtobuf();
+		BenchFindXml();
+		BenchConvertToJson();
+		BenchRosDecode();
+		BenchAddPoint();
+		BenchBuildFollowWaypoints();
+		BenchRasterizeSegment();
+		BenchProcessPolygon();
+		BenchWriteMapToFile();
+	}
+private:
+	// Runs inFunction until fMinTime has passed and reports the mean cost of
+	// one call. inBytes is the input consumed per call, 0 when meaningless.
+	template <typename TFunction>
+	void Measure(const std::string &inName, const size_t &inSize, const size_t &inBytes, TFunction inFunction)
+	{
+		if (!fFilter.empty() && inName.find(fFilter) == std::string::npos)
+		{
+			return;
+		}
+		AllocAccounting::TAllocCounts aCounts;
+		uint64_t aIterations = 0;
+		double aElapsed = MeasureAllocations(aCounts, aIterations, inFunction);
+
+		uint64_t aAllocations = 0;
+		uint64_t aAllocatedBytes = 0;
+		std::string aByStage;
+		for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+		{
+			aAllocations += aCounts.allocations[i];
+			aAllocatedBytes += aCounts.bytes[i];
+			if (aCounts.allocations[i])
+			{
+				char aStage[64];
+				snprintf(aStage, sizeof(aStage), "%s\"%s\":%.2f", aByStage.empty() ? "" : ",",
+					AllocAccounting::StageName(static_cast<AllocAccounting::TAllocStage>(i)), static_cast<double>(aCounts.allocations[i]) / aIterations);
+				aByStage += aStage;
+			}
+		}
+
+		double aNsPerOp = aElapsed / aIterations;
+		char aLine[1024];
+		snprintf(aLine, sizeof(aLine),
+			"{\"benchmark\":\"%s\",\"size\":%zu,\"iterations\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"alloc_bytes_per_op\":%.1f,\"bytes_per_s\":%.0f,\"allocs_by_stage\":{%s}}",
+			inName.c_str(), inSize, static_cast<unsigned long long>(aIterations), aNsPerOp,
+			static_cast<double>(aAllocations) / aIterations, static_cast<double>(aAllocatedBytes) / aIterations,
+			inBytes ? inBytes * 1e9 / aNsPerOp : 0.0, aByStage.c_str());
+		fResults << aLine << std::endl;
+	}
+
+	// Warms up with one call, then doubles the iterations until fMinTime has
+	// passed. Returns the time (ns) of the last round, outCounts holds the
+	// allocations it made.
+	template <typename TFunction>
+	double MeasureAllocations(AllocAccounting::TAllocCounts &outCounts, uint64_t &outIterations, TFunction inFunction)
+	{
+		inFunction();
+
+		outIterations = 1;
+		double aElapsed = 0;
+		while (true)
+		{
+			AllocAccounting::TAllocCounts aBefore;
+			AllocAccounting::Snapshot(aBefore);
+			std::chrono::steady_clock::time_point aStart = std::chrono::steady_clock::now();
+			for (uint64_t i = 0; i < outIterations; i++)
+			{
+				inFunction();
+			}
+			aElapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - aStart).count();
+			AllocAccounting::Snapshot(outCounts);
+			for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+			{
+				outCounts.allocations[i] -= aBefore.allocations[i];
+				outCounts.bytes[i] -= aBefore.bytes[i];
+			}
+			if (aElapsed >= fMinTime || outIterations >= (1ull << 30))
+			{
+				break;
+			}
+			outIterations *= 2;
+		}
+		return aElapsed;
+	}
+
+	// One EA read holding a whole frame, through framing, conversion and the
+	// ROS side, with the replies collected as the io thread would
+	void RunMessagePath(std::string &inBuffer)
+	{
+		std::size_t aProcessed = 0;
+		fEAConnector.HandleAsyncRead(inBuffer, aProcessed, LatencyTracer::Now());
+		while (fMessageInterchange.GetNextMessageForEA(fReply))
+		{
+		}
+	}
+
+	void BenchMessagePath()
+	{
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			std::string aBuffer = PointListXml(aPoints, true) + "\n";
+			Measure("message_path", aPoints, aBuffer.size(), [&] { RunMessagePath(aBuffer); });
+		}
+	}
+
+	// The binary equivalent of message_path: one length prefixed frame
+	// carrying a RobotCommand, with no conversion on the EA side
+	void BenchMessagePathProtobuf()
+	{
+#ifdef EM_PROTOBUF
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			std::string aPayload = PointListCommand(aPoints, true);
+			EAFrame::THeader aHeader;
+			aHeader.type = EAFrame::kFrameProtobuf;
+			aHeader.length = static_cast<uint32_t>(aPayload.size());
+			aHeader.sequence = 1;
+			Measure("message_path_protobuf", aPoints, aPayload.size() + EAFrame::kHeaderSize, [&]
+			{
+				fEAConnector.HandleFrame(aHeader, &aPayload[0], LatencyTracer::Now());
+				while (fMessageInterchange.GetNextMessageForEA(fReply))
+				{
+				}
+			});
+		}
+#endif
+	}
+
+	void BenchFindXml()
+	{
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			// A frame followed by the start of the next, as a TCP read delivers them
+			std::string aBuffer = PointListXml(aPoints, false) + "\n<robot><map><point_list>";
+			std::size_t aStart, aEnd;
+			Measure("find_xml", aPoints, aBuffer.size(), [&] { fEAConnector.FindXml(aBuffer, 0, aStart, aEnd); });
+		}
+	}
+
+	void BenchConvertToJson()
+	{
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			std::string aXml = PointListXml(aPoints, true);
+			Measure("xml2json", aPoints, aXml.size(), [&] { fEAConnector.ConvertToJson(aXml); });
+		}
+	}
+
+	void BenchRosDecode()
+	{
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			TMessageBufferPtr aJson = fEAConnector.ConvertToJson(PointListXml(aPoints, true));
+			TMessageBufferPtr aReply;
+			Measure("ros_process_incoming", aPoints, aJson->Size(), [&]
+			{
+				LatencyTracer::TMessageTrace aTrace;
+				fRosConnector.ProcessIncomingMessage(aJson, aTrace);
+				while (fMessageInterchange.GetNextMessageForEA(aReply))
+				{
+				}
+			});
+		}
+	}
+
+	void BenchAddPoint()
+	{
+		RosConnector::TPointList aList;
+		aList.reserve(1);
+		std::string aPlain = "123.456,78.9";
+		Measure("add_point", 2, aPlain.size(), [&] { aList.clear(); fRosConnector.AddPoint(aList, aPlain); });
+		std::string aTimed = "123.456, 78.9, 0.8, 0.4, 12.5";
+		Measure("add_point", 5, aTimed.size(), [&] { aList.clear(); fRosConnector.AddPoint(aList, aTimed); });
+	}
+
+	void BenchBuildFollowWaypoints()
+	{
+		for (size_t aPoints : {10, 100, 1000})
+		{
+			RosConnector::TPointList aList;
+			for (size_t i = 0; i < aPoints; i++)
+			{
+				RosConnector::TWayPoint aPoint;
+				aPoint.x = (i / 10) * 2.0;
+				aPoint.y = ((i / 10) % 2 ? 9 - i % 10 : i % 10) * 1.5;
+				aList.push_back(aPoint);
+			}
+			Measure("build_follow_waypoints", aPoints, 0, [&] { fRosConnector.BuildFollowWaypointsMessage(aList); });
+		}
+	}
+
+	void BenchRasterizeSegment()
+	{
+		const uint16_t aRows = 2000;
+		const uint16_t aColumns = 2000;
+		std::vector<unsigned char> aBuffer(aRows * aColumns, 0xff);
+		for (double aLength : {10.0, 100.0, 1000.0})
+		{
+			Measure("rasterize_segment", aLength, 0, [&] { fMapConverter.RasterizeSegment(aBuffer.data(), aRows, aColumns, 5, 5, 5 + aLength, 5 + aLength * 0.7); });
+		}
+	}
+
+	void BenchProcessPolygon()
+	{
+		const uint32_t aRows = 1000;
+		const uint32_t aColumns = 1000;
+		std::vector<unsigned char> aBuffer(aRows * aColumns, 0xff);
+		for (size_t aVertices : {4, 64, 1024})
+		{
+			pugi::xml_document aDocument;
+			std::string aSvg = PolygonSvg(aVertices);
+			aDocument.load_string(aSvg.c_str());
+			pugi::xml_node aPolygon = aDocument.child("svg").child("polygon");
+			Measure("process_polygon", aVertices, 0, [&] { fMapConverter.ProcessPolygon(aPolygon, aBuffer.data(), aRows, aColumns, 10); });
+		}
+	}
+
+	void BenchWriteMapToFile()
+	{
+		std::string aFileName = "/tmp/bridge_bench.pgm";
+		for (uint16_t aSide : {250, 1000, 4000})
+		{
+			std::vector<unsigned char> aBuffer(aSide * aSide, 0xff);
+			Measure("write_map_to_file", aSide, aBuffer.size(), [&] { fMapConverter.WriteMapToFile(aFileName, aBuffer.data(), aSide, aSide); });
+		}
+		std::remove(aFileName.c_str());
+	}
+
+	MessageInterchange fMessageInterchange;
+	EAConnector fEAConnector;
+	RosConnector fRosConnector;
+	MapConverter fMapConverter;
+	TMessageBufferPtr fReply;
+	std::ostream &fResults;
+	std::string fFilter;
+	double fMinTime;
+};
+
+int main(int argc, char* argv[])
+{
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("filter", po::value<std::string>(), "only run benchmarks whose name contains this")
+		("min_time_ms", po::value<double>(), "set minimum time (ms) spent timing each case, default 200")
+		("check_alloc_budget", "after the benchmarks, fail if the message path allocates more than its budget");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << desc << "\n";
+		return 1;
+	}
+	std::string aFilter;
+	if (vm.count("filter"))
+	{
+		aFilter = vm["filter"].as<std::string>();
+	}
+	double aMinTimeMs = 200;
+	if (vm.count("min_time_ms"))
+	{
+		aMinTimeMs = vm["min_time_ms"].as<double>();
+	}
+
+	bool aWithinBudget = true;
+	rclcpp::init(argc, argv);
+	{
+		std::ostream aResults(std::cout.rdbuf());
+		NullBuffer aNullBuffer;
+		std::streambuf *aCout = std::cout.rdbuf(&aNullBuffer);
+		std::streambuf *aCerr = std::cerr.rdbuf(&aNullBuffer);
+
+		boost::asio::io_context io_context;
+		BridgeBench aBench(io_context, aResults, aFilter, aMinTimeMs);
+		aBench.Run();
+		if (vm.count("check_alloc_budget") && !aBench.CheckAllocBudget())
+		{
+			aWithinBudget = false;
+		}
+
+		std::cout.rdbuf(aCout);
+		std::cerr.rdbuf(aCerr);
+	}
+	rclcpp::shutdown();
+	return aWithinBudget ? 0 : 2;
+}
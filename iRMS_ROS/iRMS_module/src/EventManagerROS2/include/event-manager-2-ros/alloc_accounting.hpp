@@ -0,0 +1,105 @@
+/*
+ * alloc_accounting.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef ALLOC_ACCOUNTING_HPP_
+#define ALLOC_ACCOUNTING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Usage: EM_ALLOC_STAGE(AllocAccounting::kAllocConversion);
+// Heap allocations until the end of the enclosing block are charged to the
+// stage. Compiled out unless the build defines EM_ALLOC_ACCOUNTING.
+#ifdef EM_ALLOC_ACCOUNTING
+#define EM_ALLOC_STAGE_JOIN(inName, inLine) inName##inLine
+#define EM_ALLOC_STAGE_NAME(inLine) EM_ALLOC_STAGE_JOIN(aAllocStage, inLine)
+#define EM_ALLOC_STAGE(inStage) AllocAccounting::TScope EM_ALLOC_STAGE_NAME(__LINE__)(inStage)
+#else
+#define EM_ALLOC_STAGE(inStage) do {} while (0)
+#endif
+
+// With EM_ALLOC_ACCOUNTING the global operator new and delete are replaced
+// by ones that count every allocation against the stage of the message path
+// the allocating thread is in. Counting follows MetricsRegistry: each thread
+// owns a shard, so the allocator adds no contention.
+class AllocAccounting
+{
+public:
+	typedef enum EAllocStage
+	{
+		kAllocOther,			// outside any marked stage
+		kAllocRead,				// TcpConnector::handleRead
+		kAllocFraming,			// finding and copying out <robot> frames
+		kAllocConversion,		// XML to JSON
+		kAllocInterchange,		// MessageInterchange send and receive
+		kAllocDecode,			// RosConnector parsing the command and its points
+		kAllocDispatch,			// building and sending goals and replies
+		kAllocStageCount
+	} TAllocStage;
+
+	typedef struct SAllocCounts
+	{
+		uint64_t allocations[kAllocStageCount];
+		uint64_t bytes[kAllocStageCount];
+	} TAllocCounts;
+
+	// Marks the calling thread as working on inStage until destroyed
+	class TScope
+	{
+	public:
+		TScope(const TAllocStage &inStage) : fPrevious(tStage) { tStage = inStage; }
+		~TScope() { tStage = fPrevious; }
+	private:
+		TScope(const TScope &);
+		TScope &operator=(const TScope &);
+		TAllocStage fPrevious;
+	};
+
+	// Allocations one point_list message of kBudgetPoints points may make in
+	// each stage once the bridge is warmed up, checked by
+	// test/test_alloc_budget.cpp and the bench's --check_alloc_budget. Lower
+	// these as the path gets leaner, never raise them to make a change pass.
+	static const std::size_t kBudgetPoints = 10;
+	static const uint64_t kMessageBudget[kAllocStageCount];
+
+	// True when the counting allocator is linked in
+	static bool Enabled();
+	static const char *StageName(const TAllocStage &inStage);
+
+	// Sum over every thread that has allocated
+	static void Snapshot(TAllocCounts &outCounts);
+
+	// Called by the replaced operator new
+	static void Count(const std::size_t &inSize)
+	{
+		TShard *aShard = tShard;
+		if (!aShard)
+		{
+			aShard = RegisterShard();
+		}
+		std::atomic<uint64_t> &aAllocations = aShard->allocations[tStage];
+		std::atomic<uint64_t> &aBytes = aShard->bytes[tStage];
+		aAllocations.store(aAllocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		aBytes.store(aBytes.load(std::memory_order_relaxed) + inSize, std::memory_order_relaxed);
+	}
+private:
+	typedef struct SShard
+	{
+		std::atomic<uint64_t> allocations[kAllocStageCount];
+		std::atomic<uint64_t> bytes[kAllocStageCount];
+		SShard *next;
+	} TShard;
+
+	static TShard *RegisterShard();
+
+	static thread_local TAllocStage tStage;
+	static thread_local TShard *tShard;
+	static std::atomic<TShard *> sShards;
+};
+
+#endif /* ALLOC_ACCOUNTING_HPP_ */
@@ -0,0 +1,263 @@
+/*
+ * async_logger.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef ASYNC_LOGGER_HPP_
+#define ASYNC_LOGGER_HPP_
+
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility/string_view.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Levels above this are removed at compile time, arguments included
+#ifndef EM_LOG_COMPILE_LEVEL
+#define EM_LOG_COMPILE_LEVEL 4
+#endif
+
+// Usage: EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogDebug, "to ROS: {}", aMessage);
+// Arguments are only evaluated when the category and level are enabled.
+#define EM_LOG(inCategory, inLevel, ...) \
+	do \
+	{ \
+		if ((inLevel) <= EM_LOG_COMPILE_LEVEL && AsyncLogger::Enabled((inCategory), (inLevel))) \
+		{ \
+			static AsyncLogger::TRateLimit sRateLimit; \
+			AsyncLogger::Log(sRateLimit, (inCategory), (inLevel), __VA_ARGS__); \
+		} \
+	} while (0)
+
+// Logging off the hot path. A log call copies its format pointer and
+// arguments into a fixed size record on the calling thread's own
+// single-producer ring; text is only formatted by the writer thread. A full
+// ring drops the record and counts it rather than blocking the caller.
+class AsyncLogger
+{
+public:
+	typedef enum ELogCategory
+	{
+		kLogGeneral,
+		kLogEA,				// EA sessions and framing
+		kLogROS,			// RosConnector
+		kLogInterchange,
+		kLogMap,
+		kLogCategoryCount
+	} TLogCategory;
+
+	typedef enum ELogLevel
+	{
+		kLogError = 0,
+		kLogWarn = 1,
+		kLogInfo = 2,
+		kLogDebug = 3,
+		kLogTrace = 4
+	} TLogLevel;
+
+	// One per call site, limits how often that site can log
+	typedef struct SRateLimit
+	{
+		SRateLimit() : window(0), count(0), suppressed(0) {}
+		std::atomic<uint64_t> window;
+		std::atomic<uint32_t> count;
+		std::atomic<uint32_t> suppressed;
+	} TRateLimit;
+
+	static bool Enabled(const TLogCategory &inCategory, const TLogLevel &inLevel)
+	{
+		return inLevel <= sLevels[inCategory].load(std::memory_order_relaxed);
+	}
+
+	template <typename... TArgs>
+	static void Log(TRateLimit &inRateLimit, const TLogCategory &inCategory, const TLogLevel &inLevel, const char *inFormat, const TArgs &... inArgs)
+	{
+		uint32_t aSuppressed = 0;
+		if (!Admit(inRateLimit, inCategory, aSuppressed))
+		{
+			return;
+		}
+		TLogRecord aRecord;
+		aRecord.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		aRecord.format = inFormat;
+		aRecord.category = inCategory;
+		aRecord.level = inLevel;
+		aRecord.suppressed = aSuppressed;
+		aRecord.arg_count = 0;
+		aRecord.text_used = 0;
+		Encode(aRecord, inArgs...);
+		Push(aRecord);
+	}
+
+	// inSpec is a level ("info") or a list of category=level pairs
+	// ("info,ea=debug,ros=warn"). Categories are general, ea, ros,
+	// interchange and map; levels error, warn, info, debug and trace.
+	static bool Configure(const std::string &inSpec);
+	static void SetLevel(const TLogCategory &inCategory, const TLogLevel &inLevel);
+	// Records per second allowed from each call site, 0 for no limit
+	static void SetRateLimit(const TLogCategory &inCategory, const uint32_t &inPerSecond);
+
+	// Starts the writer thread, records logged before are kept until then
+	static void Start();
+	// Writes out everything logged so far and stops the writer
+	static void Stop();
+private:
+	static const uint32_t kMaxArgs = 8;
+	static const uint32_t kTextSize = 320;
+	static const uint32_t kRingSize = 1024;
+
+	typedef enum EArgType
+	{
+		kArgSigned,
+		kArgUnsigned,
+		kArgDouble,
+		kArgBool,
+		kArgText
+	} TArgType;
+
+	typedef struct SLogArg
+	{
+		uint8_t type;
+		union
+		{
+			int64_t i;
+			uint64_t u;
+			double d;
+			struct
+			{
+				uint16_t offset;
+				uint16_t length;
+				uint32_t full_length;	// before truncation
+			} text;
+		};
+	} TLogArg;
+
+	typedef struct SLogRecord
+	{
+		uint64_t timestamp;
+		const char *format;
+		uint32_t suppressed;
+		uint8_t category;
+		uint8_t level;
+		uint8_t arg_count;
+		uint16_t text_used;
+		TLogArg args[kMaxArgs];
+		char text[kTextSize];
+	} TLogRecord;
+
+	typedef struct SRing
+	{
+		SRing() : dropped(0), next(NULL) {}
+		boost::lockfree::spsc_queue<TLogRecord, boost::lockfree::capacity<kRingSize> > records;
+		std::atomic<uint64_t> dropped;
+		SRing *next;
+	} TRing;
+
+	static bool Admit(TRateLimit &inRateLimit, const TLogCategory &inCategory, uint32_t &outSuppressed);
+	static void Push(const TLogRecord &inRecord);
+	static void RunWriter();
+	static bool Drain(std::string &ioBuffer);
+	static void Format(const TLogRecord &inRecord, std::string &outLine);
+	static void FormatArg(const TLogRecord &inRecord, const TLogArg &inArg, std::string &outLine);
+
+	static void Encode(TLogRecord &)
+	{
+	}
+
+	template <typename TArg, typename... TArgs>
+	static void Encode(TLogRecord &ioRecord, const TArg &inArg, const TArgs &... inArgs)
+	{
+		if (ioRecord.arg_count < kMaxArgs)
+		{
+			EncodeArg(ioRecord, ioRecord.args[ioRecord.arg_count++], inArg);
+		}
+		Encode(ioRecord, inArgs...);
+	}
+
+	static void EncodeArg(TLogRecord &, TLogArg &outArg, const bool &inValue)
+	{
+		outArg.type = kArgBool;
+		outArg.u = inValue;
+	}
+
+	template <typename TArg>
+	static typename std::enable_if<std::is_integral<TArg>::value && std::is_signed<TArg>::value>::type
+	EncodeArg(TLogRecord &, TLogArg &outArg, const TArg &inValue)
+	{
+		outArg.type = kArgSigned;
+		outArg.i = inValue;
+	}
+
+	template <typename TArg>
+	static typename std::enable_if<std::is_integral<TArg>::value && std::is_unsigned<TArg>::value>::type
+	EncodeArg(TLogRecord &, TLogArg &outArg, const TArg &inValue)
+	{
+		outArg.type = kArgUnsigned;
+		outArg.u = inValue;
+	}
+
+	template <typename TArg>
+	static typename std::enable_if<std::is_enum<TArg>::value>::type
+	EncodeArg(TLogRecord &, TLogArg &outArg, const TArg &inValue)
+	{
+		outArg.type = kArgSigned;
+		outArg.i = static_cast<int64_t>(inValue);
+	}
+
+	template <typename TArg>
+	static typename std::enable_if<std::is_floating_point<TArg>::value>::type
+	EncodeArg(TLogRecord &, TLogArg &outArg, const TArg &inValue)
+	{
+		outArg.type = kArgDouble;
+		outArg.d = inValue;
+	}
+
+	static void EncodeArg(TLogRecord &ioRecord, TLogArg &outArg, const std::string &inValue)
+	{
+		EncodeText(ioRecord, outArg, inValue.data(), inValue.size());
+	}
+
+	static void EncodeArg(TLogRecord &ioRecord, TLogArg &outArg, const boost::string_view &inValue)
+	{
+		EncodeText(ioRecord, outArg, inValue.data(), inValue.size());
+	}
+
+	static void EncodeArg(TLogRecord &ioRecord, TLogArg &outArg, const char *inValue)
+	{
+		EncodeText(ioRecord, outArg, inValue, inValue ? strlen(inValue) : 0);
+	}
+
+	template <std::size_t N>
+	static void EncodeArg(TLogRecord &ioRecord, TLogArg &outArg, const char (&inValue)[N])
+	{
+		EncodeText(ioRecord, outArg, inValue, strnlen(inValue, N));
+	}
+
+	// Long text, typically whole EA messages, keeps only what fits
+	static void EncodeText(TLogRecord &ioRecord, TLogArg &outArg, const char *inText, const std::size_t &inLength)
+	{
+		std::size_t aLength = std::min<std::size_t>(inLength, kTextSize - ioRecord.text_used);
+		outArg.type = kArgText;
+		outArg.text.offset = ioRecord.text_used;
+		outArg.text.length = aLength;
+		outArg.text.full_length = inLength;
+		memcpy(ioRecord.text + ioRecord.text_used, inText, aLength);
+		ioRecord.text_used += aLength;
+	}
+
+	static std::atomic<int> sLevels[kLogCategoryCount];
+	static std::atomic<uint32_t> sRateLimits[kLogCategoryCount];
+	static thread_local TRing *tRing;
+	static std::atomic<TRing *> sRings;
+	static std::atomic<bool> sRunning;
+	static boost::shared_ptr<boost::thread> sWriter;
+};
+
+#endif /* ASYNC_LOGGER_HPP_ */
@@ -0,0 +1,54 @@
+/*
+ * capture_replayer.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef CAPTURE_REPLAYER_HPP_
+#define CAPTURE_REPLAYER_HPP_
+
+#include "traffic_capture.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Plays a TrafficCapture file back into a running bridge. Every captured EA
+// session becomes a TCP client of the bridge's own listen port and writes
+// exactly the chunks that were read originally, so the replay goes through
+// TcpConnector, EAConnector, MessageInterchange and RosConnector like live
+// traffic does.
+class CaptureReplayer
+{
+public:
+	typedef struct SReplayResult
+	{
+		uint64_t records;
+		uint64_t sessions;
+		uint64_t bytes;				// ingress bytes written
+		uint64_t captured_to_ea;	// messages the ROS side produced when captured
+		uint64_t frames;			// frames the bridge received during the replay
+		uint64_t to_ea;				// messages the ROS side produced during the replay
+		uint64_t elapsed_ns;		// first write until the bridge went quiet
+	} TReplayResult;
+
+	CaptureReplayer();
+	virtual ~CaptureReplayer();
+
+	// Maps inPath and checks its header
+	bool Open(const std::string &inPath);
+	void Close();
+
+	// 0 replays as fast as possible, 1 at the original timing, 2 twice as fast
+	void SetSpeed(const double &inSpeed) { fSpeed = inSpeed; }
+
+	// Blocks until every record has been played and the bridge has finished
+	// with the traffic, or inSettleMs passed without progress
+	bool Run(const std::string &inAddress, const uint16_t &inPort, TReplayResult &outResult, const uint32_t &inSettleMs = 500);
+private:
+	const char *fData;
+	std::size_t fSize;
+	double fSpeed;
+};
+
+#endif /* CAPTURE_REPLAYER_HPP_ */
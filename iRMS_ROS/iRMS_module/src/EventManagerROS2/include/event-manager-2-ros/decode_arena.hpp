@@ -0,0 +1,102 @@
+/*
+ * decode_arena.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef DECODE_ARENA_HPP_
+#define DECODE_ARENA_HPP_
+
+#include <boost/json/memory_resource.hpp>
+#include <boost/json/parser.hpp>
+#include <boost/json/storage_ptr.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace rapidxml
+{
+	template <class Ch> class xml_document;
+}
+
+// Per-thread scratch memory for decoding one message. The XML document, the
+// JSON DOM built from it and the boost::json value RosConnector parses are all
+// carved out of blocks the arena keeps, and all of it is given back at once
+// when the outermost TScope on the thread ends. Nothing is freed piecemeal.
+//
+// A message that outgrows the blocks makes the arena allocate more; at the
+// next reset those are merged into one block big enough for it, so after a
+// few messages of a given size decoding allocates nothing.
+class DecodeArena : public boost::json::memory_resource
+{
+public:
+	// Everything taken from the arena inside a scope stays valid until the
+	// outermost scope on the thread ends
+	class TScope
+	{
+	public:
+		TScope(DecodeArena &inArena) : fArena(inArena) { fArena.fDepth++; }
+		~TScope() { if (--fArena.fDepth == 0) { fArena.Reset(); } }
+	private:
+		TScope(const TScope &);
+		TScope &operator=(const TScope &);
+		DecodeArena &fArena;
+	};
+
+	static DecodeArena &ForThread();
+
+	DecodeArena();
+	~DecodeArena();
+
+	void *Allocate(const std::size_t &inSize, const std::size_t &inAlignment = alignof(std::max_align_t));
+
+	// For boost::json values that live in the arena, does not own it
+	boost::json::storage_ptr Storage() { return boost::json::storage_ptr(this); }
+
+	// Reused across messages so its temporary stack is only grown once
+	boost::json::parser &JsonParser() { return fJsonParser; }
+
+	// An empty document whose node and string pool comes from the arena
+	rapidxml::xml_document<char> &XmlDocument();
+private:
+	typedef struct SBlock
+	{
+		char *data;
+		std::size_t size;
+	} TBlock;
+
+	DecodeArena(const DecodeArena &);
+	DecodeArena &operator=(const DecodeArena &);
+
+	void Reset();
+	void FreeBlocks();
+
+	void *do_allocate(std::size_t inSize, std::size_t inAlignment) override;
+	void do_deallocate(void *, std::size_t, std::size_t) override {}
+	bool do_is_equal(const boost::json::memory_resource &inOther) const noexcept override { return this == &inOther; }
+
+	static void *XmlAllocate(std::size_t inSize);
+	static void XmlFree(void *) {}
+
+	std::vector<TBlock> fBlocks;
+	std::size_t fBlock;
+	std::size_t fOffset;
+	int fDepth;
+	boost::json::parser fJsonParser;
+	std::unique_ptr<rapidxml::xml_document<char> > fXmlDocument;
+};
+
+namespace boost
+{
+	namespace json
+	{
+		template <>
+		struct is_deallocate_trivial<DecodeArena>
+		{
+			static constexpr bool value = true;
+		};
+	}
+}
+
+#endif /* DECODE_ARENA_HPP_ */
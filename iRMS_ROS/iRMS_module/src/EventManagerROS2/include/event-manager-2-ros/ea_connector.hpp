@@ -11,35 +11,93 @@
 #include <string>
 #include <message_interchange.hpp>
 #include <tcp_connector.hpp>
+#include <latency_tracer.hpp>
+#include <flight_recorder.hpp>
+#include <traffic_capture.hpp>
+#include <shm_ring.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/asio/streambuf.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <list>
+#include <memory>
 class EAConnector
 {
 public:
 	EAConnector(boost::asio::io_context& io_context, const std::string &inAddress, const uint16_t &inPort, const std::string &inRobotAddress);
 	virtual ~EAConnector();
 
-	bool Start(MessageInterchange *inMessageInterchange);
+	// inIntegrated: ROS runs on the io thread, replies are written as soon as
+	// they are produced rather than collected from the queue
+	bool Start(MessageInterchange *inMessageInterchange, const bool &inIntegrated = false);
 	void Stop();
+	// Frames from and messages to EA are kept here
+	void SetFlightRecorder(FlightRecorder *inFlightRecorder) { fFlightRecorder = inFlightRecorder; }
+	// Sessions accepted after this are captured for replay
+	void SetTrafficCapture(TrafficCapture *inCapture) { fTrafficCapture = inCapture; }
+	// Also accept sessions on an AF_UNIX stream socket at inPath. Call before Start.
+	bool ListenLocal(const std::string &inPath);
+	// Also take frames from a ShmRing named inName, for an Event Manager on
+	// this host. Replies still go to the socket sessions. Call before Start.
+	bool ListenSharedMemory(const std::string &inName, const std::size_t &inCapacity);
+	// Commands in inLane are not acted on once they have waited this long
+	// since they were received, unless EA gave them a deadline of their own.
+	// 0 (the default) lets them wait indefinitely.
+	void SetDeadline(const MessageInterchange::TLane &inLane, const uint32_t &inMilliseconds) { fDeadlineMs[inLane] = inMilliseconds; }
 
 	void ProcessIncomingMessage(const std::string &inMessage);
-	void ConvertMap();
+	// inMessage[inSize] must be '\0'; the XML is parsed where it lies
+	void ProcessIncomingMessage(const char *inMessage, const std::size_t &inSize, LatencyTracer::TMessageTrace &inTrace);
+	// A serialized ats.base.RobotCommand, passed on to ROS as it is
+	void ProcessIncomingCommand(const char *inCommand, const std::size_t &inSize, LatencyTracer::TMessageTrace &inTrace);
 	void DoAccept();
-	void HandleAsyncRead(const std::string &inBuffer, const std::size_t &bytes_transferred, std::size_t &bytes_processed);
-	void HandleAsyncWrite(const std::string &inBuffer, const std::size_t &bytes_transferred, std::size_t &bytes_processed);
+	// Converts every complete frame in inBuffer, which is left as it was
+	void HandleAsyncRead(std::string &inBuffer, std::size_t &bytes_processed, const uint64_t &inReceivedTime);
+	// Counts how long a reply waited behind earlier writes on its session
+	void HandleAsyncWrite(const MessageBuffer &inBuffer, const std::size_t &bytes_transferred, const uint64_t &inQueuedTime);
+	// One frame of a length prefixed session
+	void HandleFrame(const EAFrame::THeader &inHeader, char *inPayload, const uint64_t &inReceivedTime);
 private:
-	bool FindXml(const std::string &inBuffer, std::size_t &outStart, std::size_t &outEnd);
-	std::string ConvertToJson(const std::string inXmlString);
+	friend class BridgeBench;
+	friend class AllocBudgetTest;
+
+	void DoAcceptLocal();
+	void StartSession(TcpConnector::TSocket inSocket, const std::string &inPeer);
+	void DoPollOutgoing();
+	void RunSharedMemoryWaiter();
+	void DrainSharedMemory();
+	void SendToSessions(const TMessageBufferPtr &inMessage);
+	// inFrame[inSize] is overwritten while an XML frame is processed
+	void ProcessFrame(char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat, const uint64_t &inReceivedTime);
+	bool FindXml(const std::string &inBuffer, const std::size_t &inOffset, std::size_t &outStart, std::size_t &outEnd);
+	TMessageBufferPtr ConvertToJson(const char *inXml, const std::size_t &inSize);
+	void ApplyDeadline(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat, const MessageInterchange::TLane &inLane, LatencyTracer::TMessageTrace &ioTrace);
+	TMessageBufferPtr ConvertToJson(const std::string &inXmlString) { return ConvertToJson(inXmlString.c_str(), inXmlString.size()); }
 	std::string fAddress;
 	uint16_t fPort;
 	std::string fRobotAddress;
 
 	MessageInterchange *fMessageInterchange;
+	FlightRecorder *fFlightRecorder;
+	TrafficCapture *fTrafficCapture;
+	uint32_t fDeadlineMs[MessageInterchange::kLaneCount];
     boost::asio::ip::tcp::acceptor fTcpAcceptor;
+	std::unique_ptr<boost::asio::local::stream_protocol::acceptor> fLocalAcceptor;
+	std::string fLocalPath;
+	boost::asio::steady_timer fOutgoingTimer;
+	// The waiter thread sleeps on the ring and hands draining to the io thread
+	ShmRing fShmRing;
+	boost::thread fShmThread;
+	boost::mutex fShmMutex;
+	boost::condition_variable fShmDrained;
+	bool fShmDrainPending;
+	bool fShmRunning;
+	std::list<std::weak_ptr<TcpConnector> > fSessions;
 	boost::recursive_mutex fMutex;
 };
 
@@ -0,0 +1,96 @@
+/*
+ * ea_frame.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef EA_FRAME_HPP_
+#define EA_FRAME_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// Length prefixed framing for the EA link. Every frame starts with a fixed
+// 12 byte header, all fields little endian:
+//
+//   0  magic    0xEA
+//   1  version  1
+//   2  type     uint16, TFrameType
+//   4  length   uint32, payload bytes after the header
+//   8  sequence uint32, counted per session and direction from 1
+//
+// A session that opens with the magic byte is framed in both directions from
+// then on; one that opens with anything else keeps the <robot>...</robot>
+// sentinel framing. XML cannot start with 0xEA, so the two never collide.
+// Nothing is sent to a session before it has written, and frames whose
+// sequence does not follow the last one are counted, not dropped.
+class EAFrame
+{
+public:
+	static const std::size_t kHeaderSize = 12;
+	static const uint8_t kMagic = 0xEA;
+	static const uint8_t kVersion = 1;
+	// A larger length is taken as a corrupt header rather than waited for
+	static const uint32_t kMaxLength = 16 * 1024 * 1024;
+
+	typedef enum EFrameType
+	{
+		kFrameXml = 1,				// one <robot> document
+		kFrameProtobuf = 2			// ats.base.RobotCommand in, RobotStatus out to sessions that sent one
+	} TFrameType;
+
+	typedef struct SHeader
+	{
+		uint16_t type;
+		uint32_t length;
+		uint32_t sequence;
+	} THeader;
+
+	static bool IsFramed(const char &inFirstByte)
+	{
+		return static_cast<uint8_t>(inFirstByte) == kMagic;
+	}
+
+	static void Encode(const THeader &inHeader, unsigned char *outHeader)
+	{
+		outHeader[0] = kMagic;
+		outHeader[1] = kVersion;
+		Put(inHeader.type, 2, outHeader + 2);
+		Put(inHeader.length, 4, outHeader + 4);
+		Put(inHeader.sequence, 4, outHeader + 8);
+	}
+
+	// False when inHeader is not a header this version understands
+	static bool Decode(const unsigned char *inHeader, THeader &outHeader)
+	{
+		if (inHeader[0] != kMagic || inHeader[1] != kVersion)
+		{
+			return false;
+		}
+		outHeader.type = static_cast<uint16_t>(Get(inHeader + 2, 2));
+		outHeader.length = Get(inHeader + 4, 4);
+		outHeader.sequence = Get(inHeader + 8, 4);
+		return outHeader.length <= kMaxLength;
+	}
+private:
+	static void Put(const uint32_t &inValue, const std::size_t &inBytes, unsigned char *outBytes)
+	{
+		for (std::size_t i = 0; i < inBytes; i++)
+		{
+			outBytes[i] = static_cast<unsigned char>(inValue >> (8 * i));
+		}
+	}
+
+	static uint32_t Get(const unsigned char *inBytes, const std::size_t &inBytesCount)
+	{
+		uint32_t aValue = 0;
+		for (std::size_t i = 0; i < inBytesCount; i++)
+		{
+			aValue |= static_cast<uint32_t>(inBytes[i]) << (8 * i);
+		}
+		return aValue;
+	}
+};
+
+#endif /* EA_FRAME_HPP_ */
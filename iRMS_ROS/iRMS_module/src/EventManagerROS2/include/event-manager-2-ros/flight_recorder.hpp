@@ -0,0 +1,96 @@
+/*
+ * flight_recorder.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef FLIGHT_RECORDER_HPP_
+#define FLIGHT_RECORDER_HPP_
+
+#include "latency_tracer.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Keeps the last few thousand frames, replies and goal events in a ring of
+// fixed size slots in a memory mapped file. Recording is a memcpy into the
+// next slot, no allocation or lock. The file is shared with the kernel so it
+// survives a crash of the process, and a copy of the ring is written to the
+// dump directory on SIGUSR1 or a fatal signal. tools/flight_decoder prints
+// either.
+class FlightRecorder
+{
+public:
+	typedef enum EEntryType
+	{
+		kEntryInbound = 1,		// frame received from EA
+		kEntryOutbound,			// message sent to EA
+		kEntryGoalSent,
+		kEntryGoalAccepted,
+		kEntryGoalRejected,
+		kEntryTrace,			// a message finished processing, see stamps
+		kEntryGoalCanceled		// a stop asked the server to cancel every goal
+	} TEntryType;
+
+	static const uint64_t kMagic = 0x3130524645464D45ull; // "EMFEFR01"
+	static const uint32_t kSlotSize = 1024;
+
+	// File layout: one THeader then slot_count TSlot
+	typedef struct SHeader
+	{
+		uint64_t magic;
+		uint32_t slot_size;
+		uint32_t slot_count;
+		std::atomic<uint64_t> next;		// entries ever written
+		uint8_t reserved[kSlotSize - 24];
+	} THeader;
+
+	typedef struct SSlot
+	{
+		// Odd while the slot is written, 2 * (entry + 1) once complete
+		std::atomic<uint64_t> sequence;
+		uint64_t timestamp;				// realtime, ns
+		uint32_t type;
+		uint32_t length;				// of the original data, may exceed stored
+		uint32_t stored;
+		uint32_t reserved;
+		uint64_t stamps[LatencyTracer::kStageCount];
+		char data[kSlotSize - 32 - 8 * LatencyTracer::kStageCount];
+	} TSlot;
+
+	FlightRecorder();
+	virtual ~FlightRecorder();
+
+	// Maps a fresh inPath for inSlots entries, an existing file is kept as
+	// <inPath>.prev
+	bool Open(const std::string &inPath, const uint32_t &inSlots);
+	void Close();
+	bool IsOpen() const { return fHeader != NULL; }
+
+	void Record(const TEntryType &inType, const char *inData, const std::size_t &inLength, const LatencyTracer::TMessageTrace *inTrace = NULL);
+	void Record(const TEntryType &inType, const std::string &inData, const LatencyTracer::TMessageTrace *inTrace = NULL)
+	{
+		Record(inType, inData.data(), inData.size(), inTrace);
+	}
+
+	// Writes the ring to inPath, async-signal-safe
+	bool Dump(const char *inPath) const;
+
+	// Dumps this recorder to inDirectory on SIGUSR1 and on SIGSEGV, SIGBUS,
+	// SIGILL, SIGFPE and SIGABRT. Only one recorder can be installed.
+	bool InstallSignalHandlers(const std::string &inDirectory);
+private:
+	static void HandleSignal(int inSignal);
+
+	THeader *fHeader;
+	TSlot *fSlots;
+	std::size_t fMappedSize;
+	int fFile;
+
+	static FlightRecorder *sInstalled;
+	static char sDumpPrefix[256];
+};
+
+#endif /* FLIGHT_RECORDER_HPP_ */
@@ -0,0 +1,55 @@
+/*
+ * lane_classifier.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef LANE_CLASSIFIER_HPP_
+#define LANE_CLASSIFIER_HPP_
+
+#include "message_buffer.hpp"
+#include "message_interchange.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Picks the interchange lane of a frame from EA before it is converted, by
+// the command it carries: load_map goes to the bulk lane, point_list and
+// start to the mission lane so a start never overtakes its point list, and
+// anything else (stop, latency_report) to the control lane. Only control
+// overtakes; bulk and mission keep their order between each other. The ROS
+// side handles control on a thread of its own, see RosConnector.
+//
+// Only the first command of an XML document is looked at, within its first
+// few hundred bytes. A protobuf RobotCommand takes the lowest priority lane
+// of the commands it holds.
+//
+// CoalescingKey picks out the frames a later one may supersede while they
+// are queued: a point_list on its own that replaces the whole list, with no
+// op other than replace and no base_version. A patch, or a point list sent
+// together with another command, is always delivered.
+//
+// DeadlineMs is how long after it was received EA allows a frame to wait
+// before it is acted on: the deadline_ms attribute of the <robot> root, or
+// the deadline_ms field of a RobotCommand.
+class LaneClassifier
+{
+public:
+	static MessageInterchange::TLane Classify(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat);
+	// 0 when the frame must not be coalesced
+	static uint64_t CoalescingKey(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat);
+	// 0 when EA set no deadline
+	static uint32_t DeadlineMs(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat);
+private:
+	static MessageInterchange::TLane ClassifyXml(const char *inXml, const std::size_t &inSize);
+	static MessageInterchange::TLane ClassifyCommand(const char *inCommand, const std::size_t &inSize);
+	static uint64_t XmlKey(const char *inXml, const std::size_t &inSize);
+	static uint64_t CommandKey(const char *inCommand, const std::size_t &inSize);
+	static uint32_t XmlDeadlineMs(const char *inXml, const std::size_t &inSize);
+	static uint32_t CommandDeadlineMs(const char *inCommand, const std::size_t &inSize);
+	// First command element of the document, or NULL
+	static const char *FirstCommand(const char *inXml, const std::size_t &inSize, std::size_t &outLength);
+};
+
+#endif /* LANE_CLASSIFIER_HPP_ */
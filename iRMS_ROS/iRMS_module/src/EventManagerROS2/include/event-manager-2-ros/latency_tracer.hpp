@@ -0,0 +1,81 @@
+/*
+ * latency_tracer.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef LATENCY_TRACER_HPP_
+#define LATENCY_TRACER_HPP_
+
+#include <boost/histogram.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class LatencyTracer
+{
+public:
+	// Points a message passes on its way from the EA socket to nav2
+	typedef enum EStage
+	{
+		kStageReceived,		// TcpConnector::handleRead
+		kStageFramed,		// complete <robot> frame found
+		kStageConverted,	// XML converted to JSON
+		kStageEnqueued,		// pushed to the ROS queue
+		kStageDequeued,		// popped by the ROS side
+		kStageDispatched,	// decoded and acted on (goal sent for start commands)
+		kStageGoalAccepted,	// follow_waypoints goal accepted
+		kStageCount
+	} TStage;
+
+	// Monotonic timestamps (ns), 0 for stages a message never reached
+	typedef struct SMessageTrace
+	{
+		SMessageTrace() { Reset(); }
+		void Reset() { id = 0; deadline = 0; for (int i = 0; i < kStageCount; i++) { stamps[i] = 0; } }
+		void Mark(const TStage &inStage) { stamps[inStage] = LatencyTracer::Now(); }
+		bool Expired(const uint64_t &inNow) const { return deadline && inNow > deadline; }
+		uint64_t id;				// see NextMessageId, 0 for messages not from EA
+		uint64_t stamps[kStageCount];
+		uint64_t deadline;			// monotonic (ns) after which the message is not acted on, 0 for none
+	} TMessageTrace;
+
+	typedef struct SSummary
+	{
+		std::string stage;
+		uint64_t count;
+		double p50_us;
+		double p99_us;
+		double p999_us;
+	} TSummary;
+	typedef std::vector<TSummary> TSummaryList;
+
+	LatencyTracer();
+	virtual ~LatencyTracer();
+
+	static uint64_t Now();
+	// Numbers EA frames from 1 in the order they were framed
+	static uint64_t NextMessageId();
+	static const char *StageName(const TStage &inStage);
+
+	// Adds the time spent reaching each stamped stage, measured from the
+	// previous stamped stage, plus the end to end time
+	void Record(const TMessageTrace &inTrace);
+
+	// Latency of reaching inStage; kStageCount selects end to end
+	bool Quantile(const TStage &inStage, const double &inQuantile, double &outMicroseconds) const;
+	void Summarise(TSummaryList &outSummary) const;
+private:
+	typedef boost::histogram::axis::regular<double, boost::histogram::axis::transform::log> TAxis;
+	typedef boost::histogram::histogram<std::tuple<TAxis> > THistogram;
+
+	double QuantileLocked(const THistogram &inHistogram, const double &inQuantile) const;
+
+	mutable boost::mutex fMutex;
+	// One per stage plus end to end in the last slot
+	std::vector<THistogram> fHistograms;
+};
+
+#endif /* LATENCY_TRACER_HPP_ */
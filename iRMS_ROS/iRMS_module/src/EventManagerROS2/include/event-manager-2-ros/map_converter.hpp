@@ -10,6 +10,8 @@
 #include <string>
 #include <pugixml.hpp>
 #include <cmath>
+#include <vector>
+#include <zone_index.hpp>
 
 class MapConverter
 {
@@ -27,11 +29,21 @@ public:
 	MapConverter();
 	virtual ~MapConverter();
 
+	// Reads only the nogo zones of inMapSvg, without writing or uploading anything
+	bool LoadZones(const std::string &inMapSvg);
 	bool ConvertToRos(const std::string &inDestinationAddress, const std::string &inMapSvg, const std::string &inMapName, std::string &outMetaDataPath);
+	// Nogo zones of the last converted map, in map frame metres
+	const ZoneIndex::TZoneList &GetZones() const { return fZones; }
 private:
+	friend class BridgeBench;
+
 	bool LoadXML(const std::string &inMapSvg, pugi::xml_document &outXmlDocument);
+	bool ReadMapInfo(pugi::xml_document &inXmlDocument, TMapInfo &outMapInfo);
 	bool ExtractMetadata(pugi::xml_document &inXmlDocument, const std::string &inMapName, std::string &outMetadataFilePath, TMapInfo &outMapInfo);
+	void ExtractZones(pugi::xml_document &inXmlDocument, const TMapInfo &inMapInfo);
 	bool CreateCostmap(pugi::xml_document &inXmlDocument, const std::string &inMapName, const TMapInfo &inMapInfo, std::string &outMapFilePath);
+	// False, with a warning, when a point of the polygon is not a number
+	bool ParsePolygon(const pugi::xml_node &inPolygonNode, std::vector<ZoneIndex::TPoint> &outPoints);
 	void ProcessPolygon(const pugi::xml_node &inPolygonNode, unsigned char *inBuffer, const uint32_t &inRows, const uint32_t &inColumns, const double_t &inScale);
 	void RasterizeSegment(unsigned char *inBuffer, const uint16_t rows, const uint16_t cols, const double x1, const double y1, const double x2, const double y2);
 	bool WriteMapToFile(const std::string &inFileName, const unsigned char *inBuffer, const uint16_t rows, const uint16_t cols);
@@ -41,6 +53,7 @@ private:
 	double_t fThresholdLow;
 	double_t fThresholdHigh;
 	std::string fOutputDir;
+	ZoneIndex::TZoneList fZones;
 };
 
 #endif /* MAP_CONVERTER_HPP_ */
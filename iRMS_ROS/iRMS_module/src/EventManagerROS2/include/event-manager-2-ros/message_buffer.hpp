@@ -0,0 +1,120 @@
+/*
+ * message_buffer.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef MESSAGE_BUFFER_HPP_
+#define MESSAGE_BUFFER_HPP_
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/utility/string_view.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MessageBuffer;
+typedef boost::intrusive_ptr<MessageBuffer> TMessageBufferPtr;
+
+// A refcounted byte buffer from BufferPool. A message is written into one
+// once by its producer; the interchange, the consumers and every EA session
+// it is written to then share it through TMessageBufferPtr handles, and the
+// last handle to go returns it to the pool.
+class MessageBuffer
+{
+public:
+	typedef enum EFormat
+	{
+		kFormatText,		// JSON towards ROS, XML towards EA
+		kFormatProtobuf		// ats.base.RobotCommand towards ROS, RobotStatus towards EA
+	} TFormat;
+
+	char *Data() { return fData; }
+	const char *Data() const { return fData; }
+	std::size_t Size() const { return fSize; }
+	std::size_t Capacity() const { return fCapacity; }
+	bool Empty() const { return fSize == 0; }
+	boost::string_view View() const { return boost::string_view(fData, fSize); }
+	std::string ToString() const { return std::string(fData, fSize); }
+
+	// inSize must not exceed Capacity
+	void Resize(const std::size_t &inSize) { fSize = inSize; }
+
+	TFormat Format() const { return fFormat; }
+	void SetFormat(const TFormat &inFormat) { fFormat = inFormat; }
+private:
+	friend class BufferPool;
+	friend void intrusive_ptr_add_ref(MessageBuffer *inBuffer);
+	friend void intrusive_ptr_release(MessageBuffer *inBuffer);
+
+	MessageBuffer(char *inData, const std::size_t &inCapacity, const uint8_t &inSizeClass) :
+		fReferences(0), fSizeClass(inSizeClass), fFormat(kFormatText), fSize(0), fCapacity(inCapacity), fData(inData) {}
+	MessageBuffer(const MessageBuffer &);
+	MessageBuffer &operator=(const MessageBuffer &);
+
+	std::atomic<uint32_t> fReferences;
+	uint8_t fSizeClass;
+	TFormat fFormat;
+	std::size_t fSize;
+	std::size_t fCapacity;
+	char *fData;
+};
+
+// Size classed free lists of MessageBuffer. Acquire takes the smallest class
+// that fits and only allocates when that class has none free; buffers above
+// the largest class are allocated and freed each time.
+class BufferPool
+{
+public:
+	static TMessageBufferPtr Acquire(const std::size_t &inCapacity);
+	static TMessageBufferPtr Copy(const char *inData, const std::size_t &inSize);
+	static TMessageBufferPtr Copy(const std::string &inData) { return Copy(inData.data(), inData.size()); }
+
+	// Moves ioBuffer to a buffer of at least inCapacity keeping its contents,
+	// for producers that cannot tell the final size up front
+	static void Grow(TMessageBufferPtr &ioBuffer, const std::size_t &inCapacity);
+private:
+	friend void intrusive_ptr_release(MessageBuffer *inBuffer);
+	static void Release(MessageBuffer *inBuffer);
+};
+
+inline void intrusive_ptr_add_ref(MessageBuffer *inBuffer)
+{
+	inBuffer->fReferences.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(MessageBuffer *inBuffer)
+{
+	if (inBuffer->fReferences.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		BufferPool::Release(inBuffer);
+	}
+}
+
+// rapidjson output stream writing into a pooled buffer
+class MessageBufferStream
+{
+public:
+	typedef char Ch;
+
+	MessageBufferStream(const std::size_t &inExpectedSize) : fBuffer(BufferPool::Acquire(inExpectedSize)) {}
+
+	void Put(const Ch &inChar)
+	{
+		if (fBuffer->Size() == fBuffer->Capacity())
+		{
+			BufferPool::Grow(fBuffer, fBuffer->Capacity() * 2);
+		}
+		fBuffer->Data()[fBuffer->Size()] = inChar;
+		fBuffer->Resize(fBuffer->Size() + 1);
+	}
+	void Flush() {}
+
+	const TMessageBufferPtr &GetBuffer() const { return fBuffer; }
+private:
+	TMessageBufferPtr fBuffer;
+};
+
+#endif /* MESSAGE_BUFFER_HPP_ */
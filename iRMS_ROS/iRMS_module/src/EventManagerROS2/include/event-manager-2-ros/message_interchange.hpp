@@ -3,23 +3,156 @@
 	
 #include <boost/lockfree/policies.hpp>
 #include <boost/lockfree/spsc_queue.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
 #include <string>
+#include "latency_tracer.hpp"
+#include "metrics_registry.hpp"
+#include "traffic_capture.hpp"
+#include "message_buffer.hpp"
+#include "shm_ring.hpp"
 
 #define kMaxQueueLength 128
 
 class MessageInterchange  
 {
 public:
+	typedef boost::function<void(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace)> TMessageHandler;
+
+	// Messages to ROS each go to one lane. GetNextMessageForROS empties the
+	// control lane first; mission and bulk messages leave in the order they
+	// arrived, so a map load is never overtaken by the point lists sent after
+	// it. A ROS side can instead drain control on a consumer of its own, so a
+	// stop is never held up behind a mission message being handled. See
+	// LaneClassifier.
+	typedef enum ELane
+	{
+		kLaneControl,		// stop, cancel and other short commands
+		kLaneMission,		// point lists and start
+		kLaneBulk,			// map loads
+		kLaneCount
+	} TLane;
+
+	// A message sent with a key supersedes the last message queued if that
+	// has the same key: it takes the older one's place and the older one is
+	// never delivered. Nothing queued in between is overtaken. Build keys
+	// with MakeKey; 0 means the message never coalesces.
+	typedef enum EKeyType
+	{
+		kKeyPointList = 1,		// full replacement of the point list with this id
+		kKeyLatencyReport = 2	// latency report sent to EA, id 0
+	} TKeyType;
+
+	static uint64_t MakeKey(const TKeyType &inType, const uint64_t &inId) { return (static_cast<uint64_t>(inType) << 56) | (inId & 0x00ffffffffffffffULL); }
+
 	MessageInterchange();
 	~MessageInterchange();
 
+	// When both sides run on one thread a message can be handed straight to
+	// the consumer instead of crossing the queue. Set before either side starts.
+	void SetDirectHandlerForROS(TMessageHandler inHandler);
+	void SetDirectHandlerForEA(TMessageHandler inHandler);
+	// Messages sent to EA are appended to inCapture
+	void SetTrafficCapture(TrafficCapture *inCapture) { fTrafficCapture = inCapture; }
+
+	// Joins the EA side and the ROS side of a bridge split over two processes.
+	// Each lane to ROS and the direction back become rings in named shared
+	// memory (<inName>-to-ros-<lane> and <inName>-from-ros) that outlive both
+	// processes, so either side can
+	// restart and pick up where it left off; messages are copied into and out
+	// of the ring. Open before either side starts; direct handlers do not apply.
+	bool OpenShared(const std::string &inName, const std::size_t &inCapacity);
+	bool IsShared() const { return fFromRos.ring.IsOpen(); }
+
+	// Only the handle crosses the interchange, never the bytes. The string
+	// overloads copy into a pooled buffer, for small generated replies.
+	// Messages only coalesce in the in-process queues, not when they are
+	// handed to a direct handler or cross a shared interchange.
 	bool SendMessageToROS(const std::string &inMessage);
-	bool SendMessageToEA(const std::string &inMessage);
+	bool SendMessageToEA(const std::string &inMessage, const uint64_t &inKey = 0);
+	// The trace travels with the message and is stamped on enqueue and dequeue
+	bool SendMessageToROS(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const TLane &inLane = kLaneMission, const uint64_t &inKey = 0);
+	bool SendMessageToEA(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey = 0);
 
-	bool GetNextMessageForROS(std::string &outMessage);
-	bool GetNextMessageForEA(std::string &outMessage);
+	bool GetNextMessageForROS(TMessageBufferPtr &outMessage);
+	bool GetNextMessageForEA(TMessageBufferPtr &outMessage);
+	bool GetNextMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
+	bool GetNextMessageForEA(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
+	// The lanes to ROS split between two consumers: control alone, and
+	// mission and bulk in the order they arrived. Each may have one thread.
+	bool GetNextControlMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
+	bool GetNextMissionMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
 private:
-	boost::lockfree::spsc_queue<std::string, boost::lockfree::capacity<kMaxQueueLength>> fToRosQueue;
-	boost::lockfree::spsc_queue<std::string, boost::lockfree::capacity<kMaxQueueLength>> fFromRosQueue;
+	typedef struct SQueuedMessage
+	{
+		TMessageBufferPtr message;
+		LatencyTracer::TMessageTrace trace;
+		int slot;			// keyed messages are held in this coalescing slot instead, or -1
+	} TQueuedMessage;
+
+	// A keyed message waiting in the queue, replaced by newer ones with its key
+	typedef struct SCoalescingSlot
+	{
+		SCoalescingSlot() : key(0) {}
+		uint64_t key;		// 0 while free
+		TMessageBufferPtr message;
+		LatencyTracer::TMessageTrace trace;
+	} TCoalescingSlot;
+
+	typedef boost::lockfree::spsc_queue<TQueuedMessage, boost::lockfree::capacity<kMaxQueueLength>> TQueue;
+	// One queue of the interchange. Only keyed messages take the mutex; there
+	// are never more of them queued than the queue holds, so a slot is free
+	// whenever the queue has room.
+	typedef struct SChannel
+	{
+		SChannel() : tail_slot(-1) {}
+		TQueue queue;
+		ShmRing ring;
+		boost::mutex coalescing_mutex;
+		TCoalescingSlot slots[kMaxQueueLength];
+		int tail_slot;		// slot of the last message pushed, -1 if it had no key. Producer only
+	} TChannel;
+	// Counters used for one direction of the interchange
+	typedef struct SQueueMetrics
+	{
+		MetricsRegistry::TCounter pushed;
+		MetricsRegistry::TCounter popped;
+		MetricsRegistry::TCounter dropped;
+		MetricsRegistry::TCounter coalesced;
+		int queue;			// tracepoint argument, 0 to ROS, 1 to EA
+	} TQueueMetrics;
+
+	// Time spent waiting in each lane to ROS
+	typedef struct SLaneMetrics
+	{
+		MetricsRegistry::TCounter popped;
+		MetricsRegistry::TCounter wait_ns;
+	} TLaneMetrics;
+
+	static const TQueueMetrics kToRosMetrics;
+	static const TQueueMetrics kFromRosMetrics;
+	static const TLaneMetrics kLaneMetrics[kLaneCount];
+	static const char *const kLaneNames[kLaneCount];
+
+	MessageInterchange(const MessageInterchange &);
+	MessageInterchange &operator=(const MessageInterchange &);
+
+	bool Send(TChannel &ioChannel, const TQueueMetrics &inMetrics, TMessageHandler &inHandler, const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey);
+	bool SendKeyed(TChannel &ioChannel, const TQueueMetrics &inMetrics, const TMessageBufferPtr &inMessage, const LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey);
+	bool GetNext(TChannel &ioChannel, const TQueueMetrics &inMetrics, TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
+	// The trace travels ahead of the message bytes in each record
+	bool SendShared(ShmRing &inRing, const TMessageBufferPtr &inMessage, const LatencyTracer::TMessageTrace &inTrace);
+	bool GetNextShared(ShmRing &inRing, TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace);
+	// When the channel's next message was enqueued, false if it is empty
+	bool PeekEnqueued(TChannel &ioChannel, uint64_t &outEnqueued);
+	void CountLaneWait(const TLane &inLane, const LatencyTracer::TMessageTrace &inTrace);
+
+	TChannel fToRos[kLaneCount];
+	TChannel fFromRos;
+	// fFromRos has one producer at a time
+	boost::mutex fFromRosProducerMutex;
+	TMessageHandler fRosHandler;
+	TMessageHandler fEAHandler;
+	TrafficCapture *fTrafficCapture;
 };
 #endif
\ No newline at end of file
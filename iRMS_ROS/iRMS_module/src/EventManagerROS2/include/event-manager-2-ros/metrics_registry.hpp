@@ -0,0 +1,92 @@
+/*
+ * metrics_registry.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef METRICS_REGISTRY_HPP_
+#define METRICS_REGISTRY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Process wide counters for the bridge. Each thread that counts gets its own
+// cache line aligned shard and is the only writer of it, so Add is a plain
+// load and store with no lock or read-modify-write. A scrape only ever reads
+// the shards and sums them.
+class MetricsRegistry
+{
+public:
+	typedef enum ECounter
+	{
+		kFramesReceived,		// complete <robot> frames from EA
+		kBytesReceived,			// bytes read from EA sessions
+		kBytesSent,				// bytes written to EA sessions
+		kToRosPushed,
+		kFromRosPushed,
+		kToRosPopped,
+		kFromRosPopped,
+		kToRosDropped,			// a lane to ROS full
+		kFromRosDropped,		// the queue to EA full
+		kToRosCoalesced,		// superseded while queued by a message with the same key
+		kFromRosCoalesced,
+		kXmlParseErrors,
+		kJsonParseErrors,
+		kProtobufParseErrors,
+		kGoalsSent,
+		kGoalsCanceled,			// stop commands passed on as a cancel of every goal
+		kMapConversions,
+		kMapConversionNanoseconds,
+		kBufferPoolHits,		// message buffers reused from BufferPool
+		kBufferPoolMisses,		// message buffers allocated
+		kFramingErrors,			// length prefixed sessions closed on a bad header
+		kFrameSequenceGaps,		// frames from EA not numbered one after the last
+		kHeldWritesDropped,		// messages to EA dropped before the session's framing was known
+		kInterchangeGaps,		// messages lost between the two processes of a split bridge
+		kControlLanePopped,
+		kControlLaneWaitNanoseconds,
+		kMissionLanePopped,
+		kMissionLaneWaitNanoseconds,
+		kBulkLanePopped,
+		kBulkLaneWaitNanoseconds,
+		kCommandsExpired,		// not acted on because their deadline had passed
+		kCommandsExpiredLateNanoseconds,
+		kEAWrites,				// messages written to an EA session
+		kEAWriteNanoseconds,	// from Send to the write completing
+		kCounterCount
+	} TCounter;
+
+	static void Add(const TCounter &inCounter, const uint64_t &inValue = 1)
+	{
+		TShard *aShard = tShard;
+		if (!aShard)
+		{
+			aShard = RegisterShard();
+		}
+		std::atomic<uint64_t> &aValue = aShard->values[inCounter];
+		aValue.store(aValue.load(std::memory_order_relaxed) + inValue, std::memory_order_relaxed);
+	}
+
+	// Sum over every thread that has counted, including ones that have exited
+	static uint64_t Total(const TCounter &inCounter);
+
+	// Prometheus text exposition format, version 0.0.4
+	static void WritePrometheus(std::string &outText);
+private:
+	static const std::size_t kCacheLineSize = 64;
+
+	typedef struct SShard
+	{
+		std::atomic<uint64_t> values[kCounterCount];
+		SShard *next;
+	} TShard;
+
+	static TShard *RegisterShard();
+
+	static thread_local TShard *tShard;
+	static std::atomic<TShard *> sShards;
+};
+
+#endif /* METRICS_REGISTRY_HPP_ */
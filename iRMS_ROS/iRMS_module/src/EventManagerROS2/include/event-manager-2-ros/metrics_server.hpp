@@ -0,0 +1,36 @@
+/*
+ * metrics_server.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef METRICS_SERVER_HPP_
+#define METRICS_SERVER_HPP_
+
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <string>
+
+// Serves MetricsRegistry to Prometheus over HTTP. Runs on its own io_context
+// and thread so a scrape never competes with EA or ROS traffic.
+class MetricsServer
+{
+public:
+	MetricsServer(const std::string &inAddress, const uint16_t &inPort);
+	virtual ~MetricsServer();
+
+	bool Start();
+	void Stop();
+private:
+	void DoAccept();
+
+	std::string fAddress;
+	uint16_t fPort;
+	boost::asio::io_context fIoContext;
+	boost::asio::ip::tcp::acceptor fAcceptor;
+	boost::shared_ptr<boost::thread> fThread;
+};
+
+#endif /* METRICS_SERVER_HPP_ */
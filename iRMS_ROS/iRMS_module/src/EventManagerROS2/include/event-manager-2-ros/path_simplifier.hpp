@@ -0,0 +1,42 @@
+/*
+ * path_simplifier.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef PATH_SIMPLIFIER_HPP_
+#define PATH_SIMPLIFIER_HPP_
+
+#include <way_point.hpp>
+#include <cmath>
+#include <vector>
+
+class PathSimplifier
+{
+public:
+	PathSimplifier();
+	virtual ~PathSimplifier();
+
+	// Simplify then densify, the stage run on every point list before it is
+	// turned into a FollowWaypoints goal
+	void Process(const TPointList &inPointList, TPointList &outPointList) const;
+
+	// Douglas-Peucker within fTolerance. Points that carry their own timing
+	// or change speed/acceleration are never removed.
+	void Simplify(const TPointList &inPointList, TPointList &outPointList) const;
+	// Splits legs longer than fMaxSpacing into equal pieces, at most 1000
+	// per leg and up to 100000 points in all
+	void Densify(const TPointList &inPointList, TPointList &outPointList) const;
+
+	void SetTolerance(const double_t &inTolerance) { fTolerance = inTolerance; }
+	void SetMaxSpacing(const double_t &inSpacing) { fMaxSpacing = inSpacing; }
+private:
+	bool IsAnchor(const TPointList &inPointList, const size_t &inIndex) const;
+	void SimplifyRange(const TPointList &inPointList, const size_t &inFirst, const size_t &inLast, std::vector<bool> &outKeep) const;
+
+	double_t fTolerance;
+	double_t fMaxSpacing;
+};
+
+#endif /* PATH_SIMPLIFIER_HPP_ */
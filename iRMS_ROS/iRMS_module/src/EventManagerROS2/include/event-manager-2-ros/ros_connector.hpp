@@ -15,39 +15,73 @@
 #include "nav2_msgs/srv/load_map.hpp"
 #include "nav2_msgs/action/follow_waypoints.hpp"
 #include "message_interchange.hpp"
+#include "latency_tracer.hpp"
+#include "flight_recorder.hpp"
+#include "path_simplifier.hpp"
+#include "trajectory_conditioner.hpp"
+#include "way_point.hpp"
+#include "waypoint_store.hpp"
+#include "zone_index.hpp"
 #include <boost/thread.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/json.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/process.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/executor_work_guard.hpp>
 
 #include <yaml-cpp/yaml.h>
 
 #include <vector>
 #include <map>
+#include <atomic>
+
+namespace ats
+{
+	namespace base
+	{
+		class PointList;
+		class RobotStatus;
+	}
+}
+
+class DecodeArena;
 
 class RosConnector {
 public:
-	typedef struct SWayPoint
-	{
-		SWayPoint() : x(0), y(0), v(0), a(0), t(0) {}
-		double_t x;
-		double_t y;
-		double_t v;
-		double_t a;
-		double_t t;
-	} TWayPoint;
-	typedef std::vector<TWayPoint> TPointList;
-	typedef std::map<uint16_t, TPointList> TPointListMap;
+	typedef ::TWayPoint TWayPoint;
+	typedef ::TPointList TPointList;
 
 	RosConnector();
 	virtual ~RosConnector();
 
-	bool Start(MessageInterchange *inMessageInterchange);
+	// inIntegrated: messages from EA are processed on the caller's thread as
+	// they are decoded, no interchange thread is started. Otherwise the
+	// control lane has a thread of its own beside the interchange thread.
+	bool Start(MessageInterchange *inMessageInterchange, const bool &inIntegrated = false);
 	void Stop();
 
+	// Asks the map server to load the uploaded map, without waiting for the answer
 	void SendLoadMapMessage(const std::string &inMapMetadataPath);
+	// Point lists are checked against these zones as they arrive
+	void SetZoneIndex(ZoneIndex *inZoneIndex) { fZoneIndex = inZoneIndex; }
+	// load_map <id> replaces the zones with the nogo zones of
+	// <inDirectory>/<id>_runtime_map.svg, then converts it and uploads the
+	// costmap to inRobotAddress on the map worker
+	void SetMapSource(const std::string &inDirectory, const std::string &inRobotAddress) { fMapDirectory = inDirectory; fRobotAddress = inRobotAddress; }
+	// Completed message traces are recorded here, EA can query the summary
+	void SetLatencyTracer(LatencyTracer *inLatencyTracer) { fLatencyTracer = inLatencyTracer; }
+	// Goal events and completed message traces are kept here
+	void SetFlightRecorder(FlightRecorder *inFlightRecorder) { fFlightRecorder = inFlightRecorder; }
+	// inUseAction: send goals through the action client rather than the ros2 cli
+	void SetGoalDispatch(const bool &inUseAction) { fUseActionClient = inUseAction; }
   rclcpp::Node::SharedPtr GetBaseNode() {return client_node_;}
+  PathSimplifier &GetPathSimplifier() {return fPathSimplifier;}
+  TrajectoryConditioner &GetTrajectoryConditioner() {return fTrajectoryConditioner;}
 private:
+  friend class BridgeBench;
+  friend class AllocBudgetTest;
+
   using WaypointFollowerGoalHandle = rclcpp_action::ClientGoalHandle<nav2_msgs::action::FollowWaypoints>;
 	std::chrono::milliseconds server_timeout_;
 	rclcpp::Node::SharedPtr client_node_;
@@ -61,15 +95,43 @@ private:
     }
 
 	void RunInterchangeThread();
-	void ProcessIncomingMessage(const std::string inMessage);
+	void RunControlThread();
+	void ProcessIncomingMessage(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace);
+	// Only stop and latency_report, the rest of the message is left alone
+	void ProcessControlMessage(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace);
+	bool CheckExpired(const LatencyTracer::TMessageTrace &inTrace);
+	// The <robot> object of a JSON message parsed into outValue, or NULL
+	const boost::json::object *DecodeRobot(const MessageBuffer &inMessage, DecodeArena &inArena, boost::json::value &outValue);
+	// Marks the trace dispatched and records it
+	void CompleteTrace(LatencyTracer::TMessageTrace &inTrace);
+	void DoProcessStopMessage(const boost::json::object &inMessageObj, const LatencyTracer::TMessageTrace &inTrace);
+	// Cancels every follow_waypoints goal, safe from either thread
+	void DoStop(const LatencyTracer::TMessageTrace &inTrace);
 	void DoProcessLoadMessage(const boost::json::object &inMessageObj);
+	void DoLoadMap(const uint64_t &inMapId);
+	// Runs on the map worker; a load superseded by a later one is skipped
+	void RunMapUpload(const uint64_t &inMapId, const uint64_t &inSequence, const std::string &inMapSvg);
 	void DoProcessWaypointsMessage(const boost::json::object &inMessageObj);
-	void DoProcessMoveMessage(const boost::json::object &inMessageObj);
-	void AddPoint(TPointList &inPointList, const std::string &inPointString);
-	void DoFollowWaypointsAction();
+	// Returns true when the trace is completed later by the goal response
+	bool DoProcessMoveMessage(const boost::json::object &inMessageObj, LatencyTracer::TMessageTrace &inTrace);
+	// A binary ats.base.RobotCommand, handled like the equivalent XML
+	bool DoProcessCommand(const MessageBuffer &inMessage, LatencyTracer::TMessageTrace &inTrace);
+	void DoProcessPointList(const ats::base::PointList &inPointList);
+	void DoApplyPatch(const WaypointStore::TPatch &inPatch);
+	bool DoStartMission(const uint64_t &inPointListId, LatencyTracer::TMessageTrace &inTrace);
+	void DoProcessLatencyReportMessage(const boost::json::object &inMessageObj, const bool &inExpired);
+	bool ParsePatch(const boost::json::object &inCommandObj, WaypointStore::TPatch &outPatch, std::string &outError);
+	void ParsePoints(const boost::json::value &inPoints, TPointList &outPointList);
+	// Parses in place, a malformed field throws boost::bad_lexical_cast
+	void AddPoint(TPointList &inPointList, const boost::string_view &inPointString);
+	void ReportPointListStatus(const uint64_t &inPointListId, const std::string &inError, const ZoneIndex::TViolationList &inViolations);
+	// Only EA sessions speaking protobuf are told how a start went
+	void ReportGoalResult(const uint64_t &inPointListId, const bool &inAccepted, const size_t &inPoses);
+	void SendStatusToEA(const ats::base::RobotStatus &inStatus);
+	bool DoFollowWaypointsAction(const LatencyTracer::TMessageTrace &inTrace);
   void DoRunFollowWaypointsActionInShell(const std::string &inActionMessage);
 
-  void BuildFollowWaypointsMessage(TPointList &inWayPoints);
+  double_t BuildFollowWaypointsMessage(const TPointList &inWayPoints);
   void FollowWaypointsMsgToYaml(nav2_msgs::action::FollowWaypoints::Goal &inMsg, YAML::Emitter &outYaml);
   void FollowWaypointsMsgToJson(nav2_msgs::action::FollowWaypoints::Goal &inMsg, std::string &outJson);
 
@@ -80,9 +142,35 @@ private:
   boost::process::ipstream fFollowWaypointsActionProcessStream;
 
 	MessageInterchange *fMessageInterchange;
+	ZoneIndex *fZoneIndex;
+	std::string fMapDirectory;
+	std::string fRobotAddress;
+	LatencyTracer *fLatencyTracer;
+	FlightRecorder *fFlightRecorder;
+	bool fUseActionClient;
+	// Replies go out in the format of the message being handled
+	MessageBuffer::TFormat fReplyFormat;
+	// The message being handled is past its deadline: point lists and starts
+	// in it are rejected and nothing else in it is acted on
+	bool fExpired;
 	boost::shared_ptr<boost::thread> fInterchangeThread;
+	boost::shared_ptr<boost::thread> fControlThread;
 	bool fRunThread;
-	TPointListMap fPointLists;
+	// Costmap conversion and upload take seconds, they run here so the
+	// interchange thread keeps dispatching
+	boost::asio::io_context fMapWorker;
+	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> fMapWorkGuard;
+	boost::shared_ptr<boost::thread> fMapThread;
+	std::atomic<uint64_t> fMapLoadSequence;
+	WaypointStore fWaypointStore;
+	// The patch being decoded and the legs it changes, reused so their points
+	// keep their capacity
+	WaypointStore::TPatch fPatch;
+	TPointList fPatchWindow;
+	// Route of the mission currently executing, unaffected by later patches
+	WaypointStore::TSnapshot fActiveMission;
+	PathSimplifier fPathSimplifier;
+	TrajectoryConditioner fTrajectoryConditioner;
 };
 
 #endif /* ROSINPUTCONNECTOR_HPP_ */
@@ -0,0 +1,93 @@
+/*
+ * shm_ring.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef SHM_RING_HPP_
+#define SHM_RING_HPP_
+
+#include "ea_frame.hpp"
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A ring of EAFrame records in a named POSIX shared memory segment, so an
+// Event Manager on the same host can hand frames to the bridge without a
+// socket. One producer process writes, the bridge reads; a frame is read
+// where the producer wrote it and its space is only reused once the bridge
+// has consumed it.
+//
+// Each record is an EAFrame header and its payload padded to 8 bytes with at
+// least one spare byte, which the consumer may overwrite to terminate XML. A
+// record never wraps: one that does not fit before the end of the ring starts
+// at the beginning, and a zero byte marks the skipped tail. The consumer
+// sleeps on a futex in the segment while the ring is empty.
+//
+// The segment also keeps the sequence of the last record written and of the
+// last one consumed, so a consumer can tell records were lost even across a
+// restart of either side.
+class ShmRing
+{
+public:
+	typedef enum EPeekResult
+	{
+		kPeekEmpty,
+		kPeekFrame,
+		kPeekCorrupt			// the ring was emptied, nothing in it could be trusted
+	} TPeekResult;
+
+	ShmRing();
+	~ShmRing();
+
+	// Consumer side. Replaces any segment of the same name left by a crash.
+	bool Create(const std::string &inName, const std::size_t &inCapacity);
+	// Producer side, the segment must already have been created
+	bool Open(const std::string &inName);
+	// Either side of a ring that outlives both processes: opens the segment,
+	// or creates it if the other side has not yet, and never removes it
+	bool Attach(const std::string &inName, const std::size_t &inCapacity);
+	// The creator also removes the segment
+	void Close();
+	bool IsOpen() const { return fControl != NULL; }
+
+	// False when the ring has no room for the frame yet
+	bool Write(const EAFrame::THeader &inHeader, const char *inPayload);
+	// inHeader.length covers inPrefix followed by inPayload
+	bool Write(const EAFrame::THeader &inHeader, const void *inPrefix, const std::size_t &inPrefixSize, const char *inPayload);
+	uint32_t WrittenSequence() const;
+
+	// outPayload stays valid, followed by one writable byte, until Consume
+	TPeekResult Peek(EAFrame::THeader &outHeader, char *&outPayload);
+	void Consume();
+	uint32_t ConsumedSequence() const;
+	bool Empty() const;
+	// Returns when the ring is not empty, or false after inTimeout
+	bool Wait(const std::chrono::milliseconds &inTimeout);
+private:
+	struct SControl;
+	typedef SControl TControl;
+
+	ShmRing(const ShmRing &);
+	ShmRing &operator=(const ShmRing &);
+
+	static std::size_t RecordSize(const uint32_t &inLength);
+	bool Initialise(const std::string &inName, const std::size_t &inCapacity);
+
+	boost::interprocess::shared_memory_object fSegment;
+	boost::interprocess::mapped_region fRegion;
+	TControl *fControl;
+	char *fData;
+	std::size_t fCapacity;
+	std::string fName;
+	bool fOwner;
+	std::size_t fPeekedSize;
+	uint32_t fPeekedSequence;
+};
+
+#endif /* SHM_RING_HPP_ */
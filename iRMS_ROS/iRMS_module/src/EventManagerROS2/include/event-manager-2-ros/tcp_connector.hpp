@@ -5,36 +5,95 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/streambuf.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/function.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include "traffic_capture.hpp"
+#include "message_buffer.hpp"
+#include "ea_frame.hpp"
+#include <deque>
 #include <string>
 
+// One EA session over any stream socket, TCP or AF_UNIX
 class TcpConnector: public std::enable_shared_from_this<TcpConnector>
 {
 public:
+	typedef boost::asio::generic::stream_protocol::socket TSocket;
+
 	boost::shared_ptr<TcpConnector> SharedFromThis();
-	typedef boost::function<void(std::string &inBuffer, std::size_t &bytes_transferred, std::size_t &bytes_proccessed)> TBoostAsioHandler;
+	// inTimestamp is when the read or write completed, see LatencyTracer::Now.
+	// A read handler gets every byte not yet consumed, in the buffer the
+	// socket reads into, and sets bytes_proccessed to what it has consumed.
+	typedef boost::function<void(std::string &inBuffer, std::size_t &bytes_transferred, std::size_t &bytes_proccessed, const uint64_t &inTimestamp)> TBoostAsioHandler;
+	// inTimestamp is when the message was queued on the session
+	typedef boost::function<void(const MessageBuffer &inBuffer, std::size_t &bytes_transferred, std::size_t &bytes_proccessed, const uint64_t &inTimestamp)> TSentHandler;
+	// Called once per frame on a length prefixed session. inPayload holds
+	// inHeader.length bytes and is followed by one byte the handler may
+	// overwrite while it runs.
+	typedef boost::function<void(const EAFrame::THeader &inHeader, char *inPayload, const uint64_t &inTimestamp)> TFrameHandler;
 
-	TcpConnector(boost::asio::ip::tcp::socket inSocket);
+	TcpConnector(TSocket inSocket);
 	void Start();
+	// Queues a message for the peer, safe to call from any thread. The buffer
+	// is shared, not copied, so one message can be queued on every session.
+	// Protobuf messages only go to sessions that have sent protobuf frames.
+	// Nothing is written until the peer's first bytes show the framing.
+	void Send(const TMessageBufferPtr &inMessage);
 	void RegisterCallbackHandlerReceivedData(TBoostAsioHandler inCallbackHandler);
-	void RegisterCallbackHandlerSentData(TBoostAsioHandler inCallbackHandler);
+	void RegisterCallbackHandlerSentData(TSentHandler inCallbackHandler);
+	void RegisterCallbackHandlerFrame(TFrameHandler inCallbackHandler);
+	// Everything read from the peer is appended to inCapture as inSession
+	void SetTrafficCapture(TrafficCapture *inCapture, const uint16_t &inSession);
 
 private:
+	typedef enum EFraming
+	{
+		kFramingUnknown,			// nothing read yet
+		kFramingSentinel,			// <robot>...</robot>, split by the read handler
+		kFramingLength				// EAFrame headers
+	} TFraming;
+
+	typedef struct SOutgoing
+	{
+		TMessageBufferPtr message;
+		uint64_t queued;			// LatencyTracer::Now() when Send was called
+		std::size_t header_size;	// 0 on a sentinel session or until the framing is known
+		unsigned char header[EAFrame::kHeaderSize];
+	} TOutgoing;
+
 	void DoRead();
   	void DoWrite();
+	// Adds the frame header on a length prefixed session
+	void FrameOutgoing(TOutgoing &ioOutgoing);
+	// False for a binary message on a session that never sent one
+	bool Accepts(const MessageBuffer &inMessage) const;
+	// Frames what was queued before the framing was known and starts writing
+	void ReleaseHeldWrites();
 
 	void handleRead(boost::system::error_code ec, std::size_t length);
+	// Hands every complete frame to fFrameHandler, false on a bad header
+	bool ProcessFrames(const uint64_t &inReceivedTime);
+	std::size_t FrameBytesNeeded() const;
 
 	boost::recursive_mutex fMutex;
 
-	boost::asio::ip::tcp::socket fSocket;
+	TSocket fSocket;
 	TBoostAsioHandler fReadHandler;
-	TBoostAsioHandler fWriteHandler;
-    boost::asio::streambuf fReadBuffer;
-	boost::asio::streambuf fWriteBuffer;
+	TSentHandler fWriteHandler;
+	TFrameHandler fFrameHandler;
+	TFraming fFraming;
+	uint32_t fSendSequence;
+	uint32_t fReceiveSequence;		// of the last frame from the peer
+	bool fSpeaksProtobuf;			// the peer has sent a protobuf frame
+	static const std::size_t kReadSize = 1024;
+	// Messages kept for a peer that has not written yet, the oldest go first
+	static const std::size_t kMaxHeldWrites = 1024;
+	std::string fReadBuffer;
+	std::size_t fReadReserved;		// bytes the pending read may fill
+	std::deque<TOutgoing> fWriteQueue;
+	TrafficCapture *fCapture;
+	uint16_t fSession;
 };
 
 #endif
\ No newline at end of file
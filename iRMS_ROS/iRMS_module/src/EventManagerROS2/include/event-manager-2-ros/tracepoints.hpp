@@ -0,0 +1,50 @@
+/*
+ * tracepoints.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef TRACEPOINTS_HPP_
+#define TRACEPOINTS_HPP_
+
+// USDT probes of provider event_manager_2_ros, built in when CMake finds
+// sys/sdt.h (systemtap-sdt-dev). An unattached probe is a single nop in the
+// instruction stream; perf and bpftrace patch it when they attach, e.g.
+//
+//   bpftrace -e 'usdt:./event-manager-2-ros_node:event_manager_2_ros:dequeue
+//       { @wait_us = hist(arg3 / 1000); }'
+//
+// Message ids come from LatencyTracer::TMessageTrace::id and follow one EA
+// frame from frame_received to goal_accepted. Probes and their arguments:
+//
+//   ea_read(bytes)
+//   ea_write(format, bytes, queued_ns)
+//   frame_received(id, bytes)
+//   frame_parsed(id, json_bytes, ok)
+//   enqueue(id, queue, bytes)              queue 0 to ROS, 1 to EA
+//   dequeue(id, queue, bytes, queued_ns)
+//   goal_sent(id, point_list_id, poses)
+//   goal_accepted(id, since_received_ns)
+//   goal_rejected(id)
+//   map_conversion_start(svg_bytes)
+//   map_conversion_end(ok, elapsed_ns)
+//   map_upload_start()
+//   map_upload_end(ok, elapsed_ns)
+#ifdef EM_USDT
+#include <sys/sdt.h>
+#define EM_TRACE0(inName) DTRACE_PROBE(event_manager_2_ros, inName)
+#define EM_TRACE1(inName, inArg1) DTRACE_PROBE1(event_manager_2_ros, inName, inArg1)
+#define EM_TRACE2(inName, inArg1, inArg2) DTRACE_PROBE2(event_manager_2_ros, inName, inArg1, inArg2)
+#define EM_TRACE3(inName, inArg1, inArg2, inArg3) DTRACE_PROBE3(event_manager_2_ros, inName, inArg1, inArg2, inArg3)
+#define EM_TRACE4(inName, inArg1, inArg2, inArg3, inArg4) DTRACE_PROBE4(event_manager_2_ros, inName, inArg1, inArg2, inArg3, inArg4)
+#else
+// sizeof keeps the arguments referenced without evaluating them
+#define EM_TRACE0(inName) do {} while (0)
+#define EM_TRACE1(inName, inArg1) do { (void)sizeof(inArg1); } while (0)
+#define EM_TRACE2(inName, inArg1, inArg2) do { (void)sizeof(inArg1); (void)sizeof(inArg2); } while (0)
+#define EM_TRACE3(inName, inArg1, inArg2, inArg3) do { (void)sizeof(inArg1); (void)sizeof(inArg2); (void)sizeof(inArg3); } while (0)
+#define EM_TRACE4(inName, inArg1, inArg2, inArg3, inArg4) do { (void)sizeof(inArg1); (void)sizeof(inArg2); (void)sizeof(inArg3); (void)sizeof(inArg4); } while (0)
+#endif
+
+#endif /* TRACEPOINTS_HPP_ */
@@ -0,0 +1,79 @@
+/*
+ * traffic_capture.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef TRAFFIC_CAPTURE_HPP_
+#define TRAFFIC_CAPTURE_HPP_
+
+#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Appends the raw bytes EA sessions send, session opens and closes and the
+// messages the ROS side produces for EA to a capture file that
+// CaptureReplayer can play back through the bridge. The file is a THeader
+// followed by records, each a TRecord and its data padded to 8 bytes, all
+// little endian, so it can be walked in place once mapped.
+class TrafficCapture
+{
+public:
+	typedef enum ERecordType
+	{
+		kRecordSessionOpen = 1,		// data is the peer address
+		kRecordSessionClose,
+		kRecordIngress,				// bytes as read from the session socket
+		kRecordToEA					// message from the ROS side, session 0
+	} TRecordType;
+
+	static const uint64_t kMagic = 0x3130504143324D45ull; // "EM2CAP01"
+	static const uint32_t kVersion = 1;
+
+	typedef struct SHeader
+	{
+		uint64_t magic;
+		uint32_t version;
+		uint32_t reserved;
+		uint64_t wall_clock_ns;		// when the capture started
+		uint64_t monotonic_ns;		// LatencyTracer::Now at the same moment
+	} THeader;
+
+	typedef struct SRecord
+	{
+		uint64_t timestamp;			// LatencyTracer::Now
+		uint32_t length;
+		uint16_t type;
+		uint16_t session;
+	} TRecord;
+
+	static std::size_t PaddedLength(const std::size_t &inLength) { return (inLength + 7) & ~static_cast<std::size_t>(7); }
+
+	TrafficCapture();
+	virtual ~TrafficCapture();
+
+	bool Open(const std::string &inPath);
+	void Close();
+	bool IsOpen() const { return fFile != NULL; }
+
+	// Sessions are numbered from 1 in the order they were accepted
+	uint16_t NextSession() { return ++fSessions; }
+	void Record(const TRecordType &inType, const uint16_t &inSession, const char *inData, const std::size_t &inLength);
+	void Record(const TRecordType &inType, const uint16_t &inSession, const std::string &inData)
+	{
+		Record(inType, inSession, inData.data(), inData.size());
+	}
+private:
+	boost::mutex fMutex;
+	FILE *fFile;
+	// stdio buffer, records reach the disk in large writes
+	std::vector<char> fBuffer;
+	std::atomic<uint16_t> fSessions;
+};
+
+#endif /* TRAFFIC_CAPTURE_HPP_ */
@@ -0,0 +1,72 @@
+/*
+ * trajectory_conditioner.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef TRAJECTORY_CONDITIONER_HPP_
+#define TRAJECTORY_CONDITIONER_HPP_
+
+#include <way_point.hpp>
+#include <cmath>
+#include <vector>
+
+class TrajectoryConditioner
+{
+public:
+	typedef struct STrajectoryPoint
+	{
+		STrajectoryPoint() : x(0), y(0), yaw(0), v(0), t(0), waypoint(false) {}
+		double_t x;
+		double_t y;
+		double_t yaw;
+		double_t v;
+		double_t t;
+		// Set on the one sample that stands for an EA point (the apex of a
+		// blended corner), unset on the extra samples of the blend
+		bool waypoint;
+	} TTrajectoryPoint;
+	typedef std::vector<TTrajectoryPoint> TTrajectory;
+
+	TrajectoryConditioner();
+	virtual ~TrajectoryConditioner();
+
+	// Turns a raw EA point list into a timed path: headings follow the
+	// direction of travel, corners are blended over fCornerRadius and each
+	// point carries the time (s from mission start) it should be reached.
+	// The extra samples of a blend are for a path-following controller, a
+	// waypoint follower should only be given the samples marked waypoint.
+	void Condition(const TPointList &inPointList, TTrajectory &outTrajectory) const;
+
+	void SetCornerRadius(const double_t &inRadius) { fCornerRadius = inRadius; }
+	void SetDefaultSpeed(const double_t &inSpeed) { fDefaultSpeed = inSpeed; }
+	void SetMaxAcceleration(const double_t &inAcceleration) { fMaxAcceleration = inAcceleration; }
+private:
+	typedef struct SPathSample
+	{
+		double_t x;
+		double_t y;
+		double_t yaw;
+		double_t vmax;
+		double_t vleg;
+		double_t a;
+		double_t t;
+		bool waypoint;
+	} TPathSample;
+	typedef std::vector<TPathSample> TPath;
+
+	void BuildPath(const TPointList &inPointList, TPath &outPath) const;
+	void BlendCorner(const TWayPoint &inPrev, const TWayPoint &inCorner, const TWayPoint &inNext, TPath &outPath) const;
+	void TimePath(const TPath &inPath, TTrajectory &outTrajectory) const;
+	double_t PointSpeed(const TWayPoint &inPoint) const;
+	double_t PointAcceleration(const TWayPoint &inPoint) const;
+
+	double_t fCornerRadius;
+	double_t fDefaultSpeed;
+	double_t fMaxAcceleration;
+	double_t fMinTurnAngle;
+	double_t fSampleAngle;
+};
+
+#endif /* TRAJECTORY_CONDITIONER_HPP_ */
@@ -0,0 +1,29 @@
+/*
+ * way_point.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef WAY_POINT_HPP_
+#define WAY_POINT_HPP_
+
+#include <cmath>
+#include <vector>
+
+// A single point as sent by EA: position plus optional speed (m/s),
+// acceleration (m/s^2) and arrival time (s from mission start).
+// Zero means "not specified" for v, a and t.
+typedef struct SWayPoint
+{
+	SWayPoint() : x(0), y(0), v(0), a(0), t(0) {}
+	bool IsFinite() const { return std::isfinite(x) && std::isfinite(y) && std::isfinite(v) && std::isfinite(a) && std::isfinite(t); }
+	double_t x;
+	double_t y;
+	double_t v;
+	double_t a;
+	double_t t;
+} TWayPoint;
+typedef std::vector<TWayPoint> TPointList;
+
+#endif /* WAY_POINT_HPP_ */
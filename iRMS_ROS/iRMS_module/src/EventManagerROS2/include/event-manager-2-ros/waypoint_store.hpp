@@ -0,0 +1,82 @@
+/*
+ * waypoint_store.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef WAYPOINT_STORE_HPP_
+#define WAYPOINT_STORE_HPP_
+
+#include <way_point.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Point lists received from EA, keyed by their 64 bit id. Every change bumps
+// the list's version so EA can patch against a known base, and readers take
+// copy-on-write snapshots: a snapshot held by a running mission is never
+// modified, the next patch copies the list instead.
+// Only the ROS interchange thread modifies the store.
+class WaypointStore
+{
+public:
+	typedef boost::shared_ptr<const TPointList> TSnapshot;
+
+	typedef enum EPatchOperation
+	{
+		kPatchReplace,
+		kPatchAppend,
+		kPatchInsert,
+		kPatchDelete,
+		kPatchReplaceRange
+	} TPatchOperation;
+
+	typedef struct SPatch
+	{
+		SPatch() : operation(kPatchReplace), id(0), index(0), count(0), base_version(0) {}
+		// Back to an empty replace, keeping the points' capacity
+		void Reset() { operation = kPatchReplace; id = 0; index = 0; count = 0; base_version = 0; points.clear(); }
+		TPatchOperation operation;
+		uint64_t id;
+		size_t index;
+		size_t count;
+		// Version the patch was made against, 0 skips the check
+		uint64_t base_version;
+		TPointList points;
+	} TPatch;
+
+	WaypointStore();
+	virtual ~WaypointStore();
+
+	static bool ParseOperation(const std::string &inName, TPatchOperation &outOperation);
+
+	// Checks the patch against the current list and returns the points either
+	// side of the edit as they will be once applied, so callers can validate
+	// just the legs that change. outWindowStart is the index of the first
+	// window point in the patched list.
+	bool PatchWindow(const TPatch &inPatch, TPointList &outWindow, size_t &outWindowStart, std::string &outError) const;
+	bool Apply(const TPatch &inPatch, std::string &outError);
+
+	bool Snapshot(const uint64_t &inId, TSnapshot &outSnapshot, uint64_t &outVersion) const;
+	uint64_t Version(const uint64_t &inId) const;
+	size_t Size(const uint64_t &inId) const;
+	void Remove(const uint64_t &inId);
+	void Clear();
+private:
+	typedef struct SEntry
+	{
+		SEntry() : version(0) {}
+		uint64_t version;
+		boost::shared_ptr<TPointList> points;
+	} TEntry;
+	typedef std::map<uint64_t, TEntry> TEntryMap;
+
+	// Every operation except replace is a range replacement on the current list
+	bool ResolveRange(const TPatch &inPatch, const size_t &inSize, size_t &outIndex, size_t &outCount, std::string &outError) const;
+
+	TEntryMap fEntries;
+};
+
+#endif /* WAYPOINT_STORE_HPP_ */
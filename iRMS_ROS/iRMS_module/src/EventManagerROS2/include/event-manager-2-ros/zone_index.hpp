@@ -0,0 +1,75 @@
+/*
+ * zone_index.hpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#ifndef ZONE_INDEX_HPP_
+#define ZONE_INDEX_HPP_
+
+#include <way_point.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/segment.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Spatial index over the nogo zones of the last loaded map. Each SetZones
+// builds a fresh immutable index and swaps it in, so point lists can be
+// checked from any thread while a map is being loaded.
+class ZoneIndex
+{
+public:
+	typedef boost::geometry::model::d2::point_xy<double_t> TPoint;
+	typedef boost::geometry::model::polygon<TPoint> TPolygon;
+	typedef boost::geometry::model::box<TPoint> TBox;
+	typedef boost::geometry::model::segment<TPoint> TSegment;
+
+	typedef struct SZone
+	{
+		std::string id;
+		TPolygon polygon;
+	} TZone;
+	typedef std::vector<TZone> TZoneList;
+
+	typedef struct SViolation
+	{
+		// Index of the offending point, or of the first point of the leg
+		size_t index;
+		bool leg;
+		std::string zone;
+	} TViolation;
+	typedef std::vector<TViolation> TViolationList;
+
+	ZoneIndex();
+	virtual ~ZoneIndex();
+
+	void SetZones(const TZoneList &inZones);
+	size_t ZoneCount() const;
+
+	// Returns true when no point lies in, and no leg crosses, a nogo zone.
+	// At most inMaxViolations are reported.
+	bool Validate(const TPointList &inPointList, TViolationList &outViolations, const size_t &inMaxViolations = 32) const;
+private:
+	typedef std::pair<TBox, size_t> TIndexValue;
+	typedef boost::geometry::index::rtree<TIndexValue, boost::geometry::index::rstar<16> > TRTree;
+	typedef struct SIndex
+	{
+		TZoneList zones;
+		TRTree tree;
+	} TIndex;
+
+	boost::shared_ptr<const TIndex> Snapshot() const;
+
+	mutable boost::mutex fMutex;
+	boost::shared_ptr<const TIndex> fIndex;
+};
+
+#endif /* ZONE_INDEX_HPP_ */
@@ -0,0 +1,146 @@
+/*
+ * alloc_accounting.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "alloc_accounting.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	const char *kStageNames[] = {"other", "read", "framing", "conversion", "interchange", "decode", "dispatch"};
+
+	static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) == AllocAccounting::kAllocStageCount, "every stage needs a name");
+}
+
+thread_local AllocAccounting::TAllocStage AllocAccounting::tStage = AllocAccounting::kAllocOther;
+thread_local AllocAccounting::TShard *AllocAccounting::tShard = NULL;
+std::atomic<AllocAccounting::TShard *> AllocAccounting::sShards(NULL);
+
+const std::size_t AllocAccounting::kBudgetPoints;
+const uint64_t AllocAccounting::kMessageBudget[AllocAccounting::kAllocStageCount] =
+{
+	0,		// other
+	0,		// read, the tests hand frames to the read handler directly
+	0,		// framing
+	0,		// conversion
+	0,		// interchange
+	0,		// decode
+	0		// dispatch
+};
+
+bool AllocAccounting::Enabled()
+{
+#ifdef EM_ALLOC_ACCOUNTING
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char *AllocAccounting::StageName(const TAllocStage &inStage)
+{
+	return kStageNames[inStage];
+}
+
+AllocAccounting::TShard *AllocAccounting::RegisterShard()
+{
+	// Called from operator new, so the shard must not come from it
+	void *aMemory = NULL;
+	if (posix_memalign(&aMemory, 64, sizeof(TShard)) != 0)
+	{
+		throw std::bad_alloc();
+	}
+	TShard *aShard = new (aMemory) TShard();
+	for (int i = 0; i < kAllocStageCount; i++)
+	{
+		aShard->allocations[i].store(0, std::memory_order_relaxed);
+		aShard->bytes[i].store(0, std::memory_order_relaxed);
+	}
+	aShard->next = sShards.load(std::memory_order_relaxed);
+	while (!sShards.compare_exchange_weak(aShard->next, aShard, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+	tShard = aShard;
+	return aShard;
+}
+
+void AllocAccounting::Snapshot(TAllocCounts &outCounts)
+{
+	for (int i = 0; i < kAllocStageCount; i++)
+	{
+		outCounts.allocations[i] = 0;
+		outCounts.bytes[i] = 0;
+	}
+	for (TShard *aShard = sShards.load(std::memory_order_acquire); aShard; aShard = aShard->next)
+	{
+		for (int i = 0; i < kAllocStageCount; i++)
+		{
+			outCounts.allocations[i] += aShard->allocations[i].load(std::memory_order_relaxed);
+			outCounts.bytes[i] += aShard->bytes[i].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+#ifdef EM_ALLOC_ACCOUNTING
+void *operator new(std::size_t inSize)
+{
+	AllocAccounting::Count(inSize);
+	void *aMemory = std::malloc(inSize ? inSize : 1);
+	if (!aMemory)
+	{
+		throw std::bad_alloc();
+	}
+	return aMemory;
+}
+
+void *operator new[](std::size_t inSize)
+{
+	return operator new(inSize);
+}
+
+void *operator new(std::size_t inSize, const std::nothrow_t &) noexcept
+{
+	AllocAccounting::Count(inSize);
+	return std::malloc(inSize ? inSize : 1);
+}
+
+void *operator new[](std::size_t inSize, const std::nothrow_t &inTag) noexcept
+{
+	return operator new(inSize, inTag);
+}
+
+void operator delete(void *inMemory) noexcept
+{
+	std::free(inMemory);
+}
+
+void operator delete[](void *inMemory) noexcept
+{
+	std::free(inMemory);
+}
+
+void operator delete(void *inMemory, std::size_t) noexcept
+{
+	std::free(inMemory);
+}
+
+void operator delete[](void *inMemory, std::size_t) noexcept
+{
+	std::free(inMemory);
+}
+
+void operator delete(void *inMemory, const std::nothrow_t &) noexcept
+{
+	std::free(inMemory);
+}
+
+void operator delete[](void *inMemory, const std::nothrow_t &) noexcept
+{
+	std::free(inMemory);
+}
+#endif
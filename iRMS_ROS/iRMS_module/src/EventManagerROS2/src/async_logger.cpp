@@ -0,0 +1,252 @@
+/*
+ * async_logger.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "async_logger.hpp"
+
+#include <boost/algorithm/string.hpp>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+	const char *kCategoryNames[] = {"general", "ea", "ros", "interchange", "map"};
+	const char *kLevelNames[] = {"error", "warn", "info", "debug", "trace"};
+	const char *kLevelTags[] = {"ERROR", "WARN ", "INFO ", "DEBUG", "TRACE"};
+
+	bool FindName(const char *inNames[], const int &inCount, const std::string &inName, int &outIndex)
+	{
+		for (int i = 0; i < inCount; i++)
+		{
+			if (inName == inNames[i])
+			{
+				outIndex = i;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+std::atomic<int> AsyncLogger::sLevels[kLogCategoryCount] = {{kLogInfo}, {kLogInfo}, {kLogInfo}, {kLogInfo}, {kLogInfo}};
+std::atomic<uint32_t> AsyncLogger::sRateLimits[kLogCategoryCount] = {{100}, {100}, {100}, {100}, {100}};
+thread_local AsyncLogger::TRing *AsyncLogger::tRing = NULL;
+std::atomic<AsyncLogger::TRing *> AsyncLogger::sRings(NULL);
+std::atomic<bool> AsyncLogger::sRunning(false);
+boost::shared_ptr<boost::thread> AsyncLogger::sWriter;
+
+bool AsyncLogger::Configure(const std::string &inSpec)
+{
+	std::vector<std::string> aEntries;
+	boost::split(aEntries, inSpec, boost::is_any_of(","), boost::token_compress_on);
+	for (std::vector<std::string>::iterator aIter = aEntries.begin(); aIter != aEntries.end(); aIter++)
+	{
+		std::string aEntry = boost::trim_copy(*aIter);
+		if (aEntry.empty())
+		{
+			continue;
+		}
+		std::size_t aSeparator = aEntry.find('=');
+		int aLevel = 0;
+		if (!FindName(kLevelNames, 5, aEntry.substr(aSeparator == std::string::npos ? 0 : aSeparator + 1), aLevel))
+		{
+			return false;
+		}
+		if (aSeparator == std::string::npos)
+		{
+			for (int i = 0; i < kLogCategoryCount; i++)
+			{
+				SetLevel(static_cast<TLogCategory>(i), static_cast<TLogLevel>(aLevel));
+			}
+			continue;
+		}
+		int aCategory = 0;
+		if (!FindName(kCategoryNames, kLogCategoryCount, aEntry.substr(0, aSeparator), aCategory))
+		{
+			return false;
+		}
+		SetLevel(static_cast<TLogCategory>(aCategory), static_cast<TLogLevel>(aLevel));
+	}
+	return true;
+}
+
+void AsyncLogger::SetLevel(const TLogCategory &inCategory, const TLogLevel &inLevel)
+{
+	sLevels[inCategory].store(inLevel, std::memory_order_relaxed);
+}
+
+void AsyncLogger::SetRateLimit(const TLogCategory &inCategory, const uint32_t &inPerSecond)
+{
+	sRateLimits[inCategory].store(inPerSecond, std::memory_order_relaxed);
+}
+
+bool AsyncLogger::Admit(TRateLimit &inRateLimit, const TLogCategory &inCategory, uint32_t &outSuppressed)
+{
+	uint32_t aLimit = sRateLimits[inCategory].load(std::memory_order_relaxed);
+	if (!aLimit)
+	{
+		return true;
+	}
+	// One second windows; the first record of a window reports how many the
+	// previous windows suppressed
+	uint64_t aWindow = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	uint64_t aCurrent = inRateLimit.window.load(std::memory_order_relaxed);
+	if (aWindow != aCurrent && inRateLimit.window.compare_exchange_strong(aCurrent, aWindow, std::memory_order_relaxed))
+	{
+		inRateLimit.count.store(0, std::memory_order_relaxed);
+	}
+	if (inRateLimit.count.fetch_add(1, std::memory_order_relaxed) >= aLimit)
+	{
+		inRateLimit.suppressed.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	outSuppressed = inRateLimit.suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+void AsyncLogger::Push(const TLogRecord &inRecord)
+{
+	TRing *aRing = tRing;
+	if (!aRing)
+	{
+		aRing = new TRing();
+		aRing->next = sRings.load(std::memory_order_relaxed);
+		while (!sRings.compare_exchange_weak(aRing->next, aRing, std::memory_order_release, std::memory_order_relaxed))
+		{
+		}
+		tRing = aRing;
+	}
+	if (!aRing->records.push(inRecord))
+	{
+		aRing->dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void AsyncLogger::Start()
+{
+	if (sRunning.exchange(true))
+	{
+		return;
+	}
+	sWriter = boost::shared_ptr<boost::thread>(new boost::thread(&AsyncLogger::RunWriter));
+}
+
+void AsyncLogger::Stop()
+{
+	if (!sRunning.exchange(false))
+	{
+		return;
+	}
+	sWriter->join();
+	sWriter.reset();
+}
+
+void AsyncLogger::RunWriter()
+{
+	std::string aBuffer;
+	while (sRunning.load(std::memory_order_relaxed))
+	{
+		if (!Drain(aBuffer))
+		{
+			usleep(1000);
+		}
+	}
+	// Everything logged before Stop is written, however much is queued
+	while (Drain(aBuffer))
+	{
+	}
+}
+
+bool AsyncLogger::Drain(std::string &ioBuffer)
+{
+	ioBuffer.clear();
+	TLogRecord aRecord;
+	for (TRing *aRing = sRings.load(std::memory_order_acquire); aRing; aRing = aRing->next)
+	{
+		// Bounded per pass so that a busy thread cannot starve the others
+		for (int i = 0; i < 256 && aRing->records.pop(aRecord); i++)
+		{
+			Format(aRecord, ioBuffer);
+		}
+		uint64_t aDropped = aRing->dropped.exchange(0, std::memory_order_relaxed);
+		if (aDropped)
+		{
+			ioBuffer += "log ring full, " + std::to_string(aDropped) + " records dropped\n";
+		}
+	}
+	if (ioBuffer.empty())
+	{
+		return false;
+	}
+	fwrite(ioBuffer.data(), 1, ioBuffer.size(), stdout);
+	fflush(stdout);
+	return true;
+}
+
+void AsyncLogger::Format(const TLogRecord &inRecord, std::string &outLine)
+{
+	time_t aSeconds = inRecord.timestamp / 1000000;
+	struct tm aTime;
+	gmtime_r(&aSeconds, &aTime);
+	char aStamp[64];
+	strftime(aStamp, sizeof(aStamp), "%Y-%m-%dT%H:%M:%S", &aTime);
+	char aPrefix[128];
+	snprintf(aPrefix, sizeof(aPrefix), "%s.%06uZ %s [%s] ", aStamp, static_cast<unsigned>(inRecord.timestamp % 1000000),
+		kLevelTags[inRecord.level], kCategoryNames[inRecord.category]);
+	outLine += aPrefix;
+
+	// {} is replaced by the next argument, surplus arguments are dropped
+	uint8_t aArg = 0;
+	for (const char *aChar = inRecord.format; *aChar; aChar++)
+	{
+		if (aChar[0] == '{' && aChar[1] == '}' && aArg < inRecord.arg_count)
+		{
+			FormatArg(inRecord, inRecord.args[aArg++], outLine);
+			aChar++;
+		}
+		else
+		{
+			outLine += *aChar;
+		}
+	}
+	if (inRecord.suppressed)
+	{
+		outLine += " (" + std::to_string(inRecord.suppressed) + " similar suppressed)";
+	}
+	outLine += '\n';
+}
+
+void AsyncLogger::FormatArg(const TLogRecord &inRecord, const TLogArg &inArg, std::string &outLine)
+{
+	char aValue[32];
+	switch (inArg.type)
+	{
+	case kArgSigned:
+		snprintf(aValue, sizeof(aValue), "%lld", static_cast<long long>(inArg.i));
+		outLine += aValue;
+		break;
+	case kArgUnsigned:
+		snprintf(aValue, sizeof(aValue), "%llu", static_cast<unsigned long long>(inArg.u));
+		outLine += aValue;
+		break;
+	case kArgDouble:
+		snprintf(aValue, sizeof(aValue), "%g", inArg.d);
+		outLine += aValue;
+		break;
+	case kArgBool:
+		outLine += (inArg.u ? "true" : "false");
+		break;
+	case kArgText:
+		outLine.append(inRecord.text + inArg.text.offset, inArg.text.length);
+		if (inArg.text.length < inArg.text.full_length)
+		{
+			outLine += "...(" + std::to_string(inArg.text.full_length) + " bytes)";
+		}
+		break;
+	}
+}
@@ -0,0 +1,199 @@
+/*
+ * capture_replayer.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "capture_replayer.hpp"
+#include "latency_tracer.hpp"
+#include "metrics_registry.hpp"
+#include "async_logger.hpp"
+
+#include <boost/asio.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	typedef std::shared_ptr<boost::asio::ip::tcp::socket> TSocketPtr;
+	typedef std::map<uint16_t, TSocketPtr> TSocketMap;
+
+	// Replies are discarded so that the bridge never blocks writing to us
+	void DiscardReplies(boost::asio::ip::tcp::socket &inSocket)
+	{
+		char aDiscard[4096];
+		boost::system::error_code aError;
+		while (inSocket.available(aError) && !aError)
+		{
+			inSocket.read_some(boost::asio::buffer(aDiscard), aError);
+		}
+	}
+
+	void SleepUntil(const uint64_t &inMonotonicNs)
+	{
+		uint64_t aNow = LatencyTracer::Now();
+		if (inMonotonicNs > aNow)
+		{
+			usleep((inMonotonicNs - aNow) / 1000);
+		}
+	}
+}
+
+CaptureReplayer::CaptureReplayer() : fData(NULL), fSize(0), fSpeed(0)
+{
+}
+
+CaptureReplayer::~CaptureReplayer()
+{
+	Close();
+}
+
+bool CaptureReplayer::Open(const std::string &inPath)
+{
+	Close();
+	int aFile = open(inPath.c_str(), O_RDONLY);
+	if (aFile < 0)
+	{
+		return false;
+	}
+	struct stat aStat;
+	if (fstat(aFile, &aStat) != 0 || static_cast<std::size_t>(aStat.st_size) < sizeof(TrafficCapture::THeader))
+	{
+		close(aFile);
+		return false;
+	}
+	void *aMemory = mmap(NULL, aStat.st_size, PROT_READ, MAP_PRIVATE, aFile, 0);
+	close(aFile);
+	if (aMemory == MAP_FAILED)
+	{
+		return false;
+	}
+	fData = static_cast<const char *>(aMemory);
+	fSize = aStat.st_size;
+
+	const TrafficCapture::THeader *aHeader = reinterpret_cast<const TrafficCapture::THeader *>(fData);
+	if (aHeader->magic != TrafficCapture::kMagic || aHeader->version != TrafficCapture::kVersion)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void CaptureReplayer::Close()
+{
+	if (fData)
+	{
+		munmap(const_cast<char *>(fData), fSize);
+		fData = NULL;
+		fSize = 0;
+	}
+}
+
+bool CaptureReplayer::Run(const std::string &inAddress, const uint16_t &inPort, TReplayResult &outResult, const uint32_t &inSettleMs)
+{
+	memset(&outResult, 0, sizeof(outResult));
+	if (!fData)
+	{
+		return false;
+	}
+	boost::asio::io_context aContext;
+	boost::asio::ip::tcp::endpoint aEndpoint(boost::asio::ip::address::from_string(inAddress), inPort);
+	TSocketMap aSockets;
+
+	uint64_t aFramesBefore = MetricsRegistry::Total(MetricsRegistry::kFramesReceived);
+	uint64_t aToEABefore = MetricsRegistry::Total(MetricsRegistry::kFromRosPushed);
+	uint64_t aFirstRecord = 0;
+	uint64_t aStart = LatencyTracer::Now();
+
+	std::size_t aOffset = sizeof(TrafficCapture::THeader);
+	while (aOffset + sizeof(TrafficCapture::TRecord) <= fSize)
+	{
+		// The header and every record start 8 byte aligned
+		const TrafficCapture::TRecord *aRecord = reinterpret_cast<const TrafficCapture::TRecord *>(fData + aOffset);
+		const char *aData = fData + aOffset + sizeof(TrafficCapture::TRecord);
+		aOffset += sizeof(TrafficCapture::TRecord) + TrafficCapture::PaddedLength(aRecord->length);
+		if (aOffset > fSize)
+		{
+			// A capture cut short by a crash ends with a partial record
+			break;
+		}
+		outResult.records++;
+		if (!aFirstRecord)
+		{
+			aFirstRecord = aRecord->timestamp;
+		}
+		if (fSpeed > 0)
+		{
+			SleepUntil(aStart + static_cast<uint64_t>((aRecord->timestamp - aFirstRecord) / fSpeed));
+		}
+
+		boost::system::error_code aError;
+		switch (aRecord->type)
+		{
+		case TrafficCapture::kRecordSessionOpen:
+		{
+			TSocketPtr aSocket = std::make_shared<boost::asio::ip::tcp::socket>(aContext);
+			aSocket->connect(aEndpoint, aError);
+			if (aError)
+			{
+				EM_LOG(AsyncLogger::kLogGeneral, AsyncLogger::kLogError, "Replay could not connect to {}:{}: {}", inAddress, inPort, aError.message());
+				return false;
+			}
+			aSocket->set_option(boost::asio::ip::tcp::no_delay(true));
+			aSockets[aRecord->session] = aSocket;
+			outResult.sessions++;
+			break;
+		}
+		case TrafficCapture::kRecordSessionClose:
+			aSockets.erase(aRecord->session);
+			break;
+		case TrafficCapture::kRecordIngress:
+		{
+			TSocketMap::iterator aSocket = aSockets.find(aRecord->session);
+			if (aSocket == aSockets.end())
+			{
+				// Capture started while the session was already open
+				break;
+			}
+			boost::asio::write(*aSocket->second, boost::asio::buffer(aData, aRecord->length), aError);
+			DiscardReplies(*aSocket->second);
+			outResult.bytes += aRecord->length;
+			break;
+		}
+		case TrafficCapture::kRecordToEA:
+			outResult.captured_to_ea++;
+			break;
+		}
+	}
+
+	// Done once the ROS queue is empty and no frame arrived for inSettleMs
+	uint64_t aFrames = MetricsRegistry::Total(MetricsRegistry::kFramesReceived);
+	uint64_t aLastProgress = LatencyTracer::Now();
+	uint64_t aSettleNs = static_cast<uint64_t>(inSettleMs) * 1000000;
+	while (LatencyTracer::Now() - aLastProgress < aSettleNs)
+	{
+		for (TSocketMap::iterator aIter = aSockets.begin(); aIter != aSockets.end(); aIter++)
+		{
+			DiscardReplies(*aIter->second);
+		}
+		uint64_t aNow = MetricsRegistry::Total(MetricsRegistry::kFramesReceived);
+		bool aQueued = MetricsRegistry::Total(MetricsRegistry::kToRosPushed) > MetricsRegistry::Total(MetricsRegistry::kToRosPopped);
+		if (aNow != aFrames || aQueued)
+		{
+			aFrames = aNow;
+			aLastProgress = LatencyTracer::Now();
+		}
+		usleep(1000);
+	}
+	outResult.frames = aFrames - aFramesBefore;
+	outResult.to_ea = MetricsRegistry::Total(MetricsRegistry::kFromRosPushed) - aToEABefore;
+	outResult.elapsed_ns = aLastProgress - aStart;
+	return true;
+}
@@ -0,0 +1,123 @@
+/*
+ * decode_arena.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "decode_arena.hpp"
+
+#include "rapidxml/rapidxml.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+namespace
+{
+	// Enough for a point list of a few hundred points without growing
+	const std::size_t kInitialBlockSize = 64 * 1024;
+	// A one-off huge message is not kept pinned to the thread
+	const std::size_t kMaxRetainedSize = 8 * 1024 * 1024;
+}
+
+DecodeArena &DecodeArena::ForThread()
+{
+	static thread_local DecodeArena tArena;
+	return tArena;
+}
+
+DecodeArena::DecodeArena() :
+	fBlock(0), fOffset(0), fDepth(0)
+{
+}
+
+DecodeArena::~DecodeArena()
+{
+	fXmlDocument.reset();
+	FreeBlocks();
+}
+
+void *DecodeArena::Allocate(const std::size_t &inSize, const std::size_t &inAlignment)
+{
+	for (;;)
+	{
+		if (fBlock < fBlocks.size())
+		{
+			TBlock &aBlock = fBlocks[fBlock];
+			uintptr_t aBase = reinterpret_cast<uintptr_t>(aBlock.data);
+			uintptr_t aAligned = (aBase + fOffset + inAlignment - 1) & ~(static_cast<uintptr_t>(inAlignment) - 1);
+			std::size_t aStart = aAligned - aBase;
+			if (aStart + inSize <= aBlock.size)
+			{
+				fOffset = aStart + inSize;
+				return aBlock.data + aStart;
+			}
+			fBlock++;
+			fOffset = 0;
+			continue;
+		}
+		std::size_t aSize = std::max(fBlocks.empty() ? kInitialBlockSize : fBlocks.back().size * 2, inSize + inAlignment);
+		TBlock aBlock;
+		aBlock.data = static_cast<char *>(::operator new(aSize));
+		aBlock.size = aSize;
+		fBlocks.push_back(aBlock);
+	}
+}
+
+rapidxml::xml_document<char> &DecodeArena::XmlDocument()
+{
+	if (!fXmlDocument)
+	{
+		fXmlDocument.reset(new rapidxml::xml_document<char>());
+		fXmlDocument->set_allocator(&DecodeArena::XmlAllocate, &DecodeArena::XmlFree);
+	}
+	return *fXmlDocument;
+}
+
+void DecodeArena::Reset()
+{
+	if (fXmlDocument)
+	{
+		fXmlDocument->clear();
+	}
+	if (fBlocks.size() > 1)
+	{
+		// Merge what this message needed into one block for the next
+		std::size_t aTotal = 0;
+		for (std::vector<TBlock>::const_iterator aIter = fBlocks.begin(); aIter != fBlocks.end(); aIter++)
+		{
+			aTotal += aIter->size;
+		}
+		FreeBlocks();
+		TBlock aBlock;
+		aBlock.size = std::min(aTotal, kMaxRetainedSize);
+		aBlock.data = static_cast<char *>(::operator new(aBlock.size));
+		fBlocks.push_back(aBlock);
+	}
+	else if (!fBlocks.empty() && fBlocks.front().size > kMaxRetainedSize)
+	{
+		FreeBlocks();
+	}
+	fBlock = 0;
+	fOffset = 0;
+}
+
+void DecodeArena::FreeBlocks()
+{
+	for (std::vector<TBlock>::iterator aIter = fBlocks.begin(); aIter != fBlocks.end(); aIter++)
+	{
+		::operator delete(aIter->data);
+	}
+	fBlocks.clear();
+}
+
+void *DecodeArena::do_allocate(std::size_t inSize, std::size_t inAlignment)
+{
+	return Allocate(inSize, inAlignment);
+}
+
+void *DecodeArena::XmlAllocate(std::size_t inSize)
+{
+	return ForThread().Allocate(inSize);
+}
@@ -8,32 +8,127 @@
 #include <boost/asio.hpp>
 #include <string>
 #include "ea_connector.hpp"
-#include "map_converter.hpp"
+#include "metrics_registry.hpp"
+#include "async_logger.hpp"
+#include "alloc_accounting.hpp"
+#include "tracepoints.hpp"
+#include "decode_arena.hpp"
+#include "lane_classifier.hpp"
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/bind/bind.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <xml2json.hpp>
 
+namespace
+{
+	// Frames drained from the shared memory ring before other io work gets a turn
+	const int kShmDrainBatch = 64;
+
+	// The XML parser needs a terminated string but does not modify it, so a
+	// frame is parsed where it lies in the receive buffer with the byte after
+	// it set to '\0' for as long as it takes
+	class TFrameTerminator
+	{
+	public:
+		TFrameTerminator(char *inEnd) : fEnd(inEnd), fSaved(*inEnd) { *fEnd = '\0'; }
+		~TFrameTerminator() { *fEnd = fSaved; }
+	private:
+		TFrameTerminator(const TFrameTerminator &);
+		TFrameTerminator &operator=(const TFrameTerminator &);
+		char *fEnd;
+		char fSaved;
+	};
+}
 
 EAConnector::EAConnector(boost::asio::io_context& io_context, const std::string &inAddress, const uint16_t &inPort, const std::string &inRobotAddress) :
    fAddress(inAddress)
   ,fPort(inPort)
   ,fRobotAddress(inRobotAddress)
+  ,fMessageInterchange(NULL)
+  ,fFlightRecorder(NULL)
+  ,fTrafficCapture(NULL)
   ,fTcpAcceptor(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(inAddress), inPort))
+  ,fOutgoingTimer(io_context)
+  ,fShmDrainPending(false)
+  ,fShmRunning(false)
 {
+	for (int i = 0; i < MessageInterchange::kLaneCount; i++)
+	{
+		fDeadlineMs[i] = 0;
+	}
 }
 
 EAConnector::~EAConnector()
 {
+	Stop();
 }
 
-bool EAConnector::Start(MessageInterchange *inMessageInterchange)
+bool EAConnector::ListenLocal(const std::string &inPath)
+{
+	// A socket file left by a previous run would make bind fail
+	struct stat aStat;
+	if (stat(inPath.c_str(), &aStat) == 0 && S_ISSOCK(aStat.st_mode))
+	{
+		unlink(inPath.c_str());
+	}
+	boost::system::error_code aError;
+	boost::asio::local::stream_protocol::endpoint aEndpoint(inPath);
+	fLocalAcceptor.reset(new boost::asio::local::stream_protocol::acceptor(fTcpAcceptor.get_executor()));
+	fLocalAcceptor->open(aEndpoint.protocol(), aError);
+	if (!aError)
+	{
+		fLocalAcceptor->bind(aEndpoint, aError);
+	}
+	if (!aError)
+	{
+		fLocalAcceptor->listen(boost::asio::socket_base::max_listen_connections, aError);
+	}
+	if (aError)
+	{
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogError, "Could not listen on {}: {}", inPath, aError.message());
+		fLocalAcceptor.reset();
+		return false;
+	}
+	fLocalPath = inPath;
+	return true;
+}
+
+bool EAConnector::ListenSharedMemory(const std::string &inName, const std::size_t &inCapacity)
+{
+	if (!fShmRing.Create(inName, inCapacity))
+	{
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogError, "Could not create shared memory ring {} of {} bytes", inName, inCapacity);
+		return false;
+	}
+	return true;
+}
+
+bool EAConnector::Start(MessageInterchange *inMessageInterchange, const bool &inIntegrated)
 {
 	fMessageInterchange = inMessageInterchange;
 	DoAccept();
+	if (fLocalAcceptor)
+	{
+		DoAcceptLocal();
+	}
+	if (fShmRing.IsOpen())
+	{
+		fShmRunning = true;
+		fShmThread = boost::thread(&EAConnector::RunSharedMemoryWaiter, this);
+	}
+	if (inIntegrated)
+	{
+		fMessageInterchange->SetDirectHandlerForEA(boost::bind(&EAConnector::SendToSessions, this, boost::placeholders::_1));
+	}
+	else
+	{
+		DoPollOutgoing();
+	}
 
 	return true;
 }
@@ -45,47 +140,69 @@ void EAConnector::DoAccept()
 		{
 			if (!ec)
 			{
-				std::shared_ptr<TcpConnector> aConnector = std::make_shared<TcpConnector>(std::move(socket));
-				aConnector->RegisterCallbackHandlerReceivedData(boost::bind(&EAConnector::HandleAsyncRead, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
-				aConnector->RegisterCallbackHandlerSentData(boost::bind(&EAConnector::HandleAsyncWrite, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
-				aConnector->Start();
+				boost::system::error_code aError;
+				boost::asio::ip::tcp::endpoint aPeer = socket.remote_endpoint(aError);
+				StartSession(std::move(socket), aPeer.address().to_string() + ":" + std::to_string(aPeer.port()));
 			}
  			else 
           	{
-            	std::cout << ec.message() << std::endl;
+            	EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "EA accept failed: {}", ec.message());
 			}
        		DoAccept();
 		}
 	);
 }
 
-void EAConnector::ConvertMap()
+void EAConnector::DoAcceptLocal()
 {
-	MapConverter aConverter;
-	std::string aMapPath = "/home/chawksley/aros-ROBOT-DEMO/RangeData/Infantry/Maps/9999_runtime_map.svg";
-	std::string aMapName = "test_map_9999";
+	fLocalAcceptor->async_accept(
+		[this](boost::system::error_code ec, boost::asio::local::stream_protocol::socket socket)
+		{
+			if (ec == boost::asio::error::operation_aborted)
+			{
+				return;
+			}
+			if (!ec)
+			{
+				StartSession(std::move(socket), "unix:" + fLocalPath);
+			}
+			else
+			{
+				EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "EA local accept failed: {}", ec.message());
+			}
+			DoAcceptLocal();
+		}
+	);
+}
 
-	std::ifstream aFileStream(aMapPath);
-	if (aFileStream.is_open())
+void EAConnector::StartSession(TcpConnector::TSocket inSocket, const std::string &inPeer)
+{
+	std::shared_ptr<TcpConnector> aConnector = std::make_shared<TcpConnector>(std::move(inSocket));
+	if (fTrafficCapture)
 	{
-		std::stringstream aMapSvg;
-		aMapSvg << aFileStream.rdbuf();
-		std::string aOutputMetaDataPath;
-		aConverter.ConvertToRos(fRobotAddress, aMapSvg.str(), aMapName, aOutputMetaDataPath);
-		aFileStream.close();
-//		fRosConnector->SendLoadMapMessage(aOutputMetaDataPath);
+		uint16_t aSession = fTrafficCapture->NextSession();
+		fTrafficCapture->Record(TrafficCapture::kRecordSessionOpen, aSession, inPeer);
+		aConnector->SetTrafficCapture(fTrafficCapture, aSession);
+	}
+	aConnector->RegisterCallbackHandlerReceivedData(boost::bind(&EAConnector::HandleAsyncRead, this, boost::placeholders::_1, boost::placeholders::_3, boost::placeholders::_4));
+	aConnector->RegisterCallbackHandlerSentData(boost::bind(&EAConnector::HandleAsyncWrite, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_4));
+	aConnector->RegisterCallbackHandlerFrame(boost::bind(&EAConnector::HandleFrame, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
+	aConnector->Start();
+	{
+		boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
+		fSessions.push_back(aConnector);
 	}
 }
 
-bool EAConnector::FindXml(const std::string &inBuffer, std::size_t &outStart, std::size_t &outEnd)
+bool EAConnector::FindXml(const std::string &inBuffer, const std::size_t &inOffset, std::size_t &outStart, std::size_t &outEnd)
 {
 	outEnd = 0;
 	outStart = 0;
 	
-	std::size_t aStart = inBuffer.find("<robot");
+	std::size_t aStart = inBuffer.find("<robot", inOffset);
 	if (aStart != std::string::npos)
 	{
-		std::size_t aEnd = inBuffer.find("</robot>");
+		std::size_t aEnd = inBuffer.find("</robot>", aStart);
 		if (aEnd != std::string::npos)
 		{
 			aEnd += strlen("</robot>");
@@ -97,47 +214,271 @@ bool EAConnector::FindXml(const std::string &inBuffer, std::size_t &outStart, st
 	return (outEnd != 0);
 }
 
-std::string EAConnector::ConvertToJson(const std::string inXmlString)
+TMessageBufferPtr EAConnector::ConvertToJson(const char *inXml, const std::size_t &inSize)
 {
-	std::string aReturn = "";
+	TMessageBufferPtr aReturn;
+	DecodeArena &aArena = DecodeArena::ForThread();
+	DecodeArena::TScope aScope(aArena);
 	try {
-		aReturn = xml2json(inXmlString.c_str());
+		// The JSON DOM and the writer's stack come from the arena too. A point
+		// list needs under three times its XML size; chunks past that would
+		// come from malloc.
+		std::size_t aPoolSize = inSize * 3 + 4096;
+		rapidjson::CrtAllocator aChunkAllocator;
+		rapidjson::Document::AllocatorType aAllocator(aArena.Allocate(aPoolSize), aPoolSize, aPoolSize, &aChunkAllocator);
+		// JSON from xml2json runs at most about twice the XML
+		MessageBufferStream aStream(inSize * 2);
+		xml2json(inXml, aArena.XmlDocument(), aAllocator, aStream);
+		aReturn = aStream.GetBuffer();
 	}
 	catch(std::exception &e)
 	{
-		std::cerr << "Processing XML " << inXmlString << " : " << e.what() << std::endl;
+		MetricsRegistry::Add(MetricsRegistry::kXmlParseErrors);
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "Processing XML {} : {}", boost::string_view(inXml, inSize), e.what());
 	}
 	return aReturn;
 }
 
-void EAConnector::HandleAsyncRead(const std::string &inBuffer, const std::size_t &bytes_transferred, std::size_t &bytes_processed)
+void EAConnector::HandleAsyncRead(std::string &inBuffer, std::size_t &bytes_processed, const uint64_t &inReceivedTime)
 {
+	EM_ALLOC_STAGE(AllocAccounting::kAllocFraming);
 	bytes_processed = 0;
 	std::size_t aStart, aEnd;
-	if (FindXml(inBuffer, aStart, aEnd))
+	// One read can hold several frames when EA sends faster than we read
+	while (FindXml(inBuffer, bytes_processed, aStart, aEnd))
 	{
-		std::string aXmlString = inBuffer.substr(aStart, aEnd);
-		ProcessIncomingMessage(aXmlString);
-		bytes_processed = aEnd;
+		// aEnd is the index of the closing '>'
+		ProcessFrame(&inBuffer[aStart], aEnd - aStart + 1, MessageBuffer::kFormatText, inReceivedTime);
+		bytes_processed = aEnd + 1;
 	}
 }
 
-void EAConnector::HandleAsyncWrite(const std::string &inBuffer, const std::size_t &bytes_transferred, std::size_t &bytes_processed)
+void EAConnector::HandleFrame(const EAFrame::THeader &inHeader, char *inPayload, const uint64_t &inReceivedTime)
 {
+	EM_ALLOC_STAGE(AllocAccounting::kAllocFraming);
+	switch (inHeader.type)
+	{
+	case EAFrame::kFrameXml:
+		ProcessFrame(inPayload, inHeader.length, MessageBuffer::kFormatText, inReceivedTime);
+		break;
+	case EAFrame::kFrameProtobuf:
+		ProcessFrame(inPayload, inHeader.length, MessageBuffer::kFormatProtobuf, inReceivedTime);
+		break;
+	default:
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "Ignoring EA frame {} of unknown type {}", inHeader.sequence, inHeader.type);
+		break;
+	}
+}
+
+void EAConnector::ProcessFrame(char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat, const uint64_t &inReceivedTime)
+{
+	MetricsRegistry::Add(MetricsRegistry::kFramesReceived);
+	LatencyTracer::TMessageTrace aTrace;
+	aTrace.id = LatencyTracer::NextMessageId();
+	aTrace.stamps[LatencyTracer::kStageReceived] = inReceivedTime;
+	aTrace.Mark(LatencyTracer::kStageFramed);
+	EM_TRACE2(frame_received, aTrace.id, inSize);
+	if (fFlightRecorder)
+	{
+		fFlightRecorder->Record(FlightRecorder::kEntryInbound, inFrame, inSize, &aTrace);
+	}
+	if (inFormat == MessageBuffer::kFormatProtobuf)
+	{
+		ProcessIncomingCommand(inFrame, inSize, aTrace);
+		return;
+	}
+	TFrameTerminator aTerminator(inFrame + inSize);
+	ProcessIncomingMessage(inFrame, inSize, aTrace);
+}
+
+void EAConnector::HandleAsyncWrite(const MessageBuffer &inBuffer, const std::size_t &bytes_transferred, const uint64_t &inQueuedTime)
+{
+	uint64_t aElapsed = LatencyTracer::Now() - inQueuedTime;
+	MetricsRegistry::Add(MetricsRegistry::kEAWrites);
+	MetricsRegistry::Add(MetricsRegistry::kEAWriteNanoseconds, aElapsed);
+	EM_TRACE3(ea_write, inBuffer.Format(), bytes_transferred, aElapsed);
 }
 
 void EAConnector::ProcessIncomingMessage(const std::string &inMessage)
 {
-	if (fMessageInterchange->SendMessageToROS(ConvertToJson(inMessage)))
+	LatencyTracer::TMessageTrace aTrace;
+	ProcessIncomingMessage(inMessage.c_str(), inMessage.size(), aTrace);
+}
+
+void EAConnector::ProcessIncomingMessage(const char *inMessage, const std::size_t &inSize, LatencyTracer::TMessageTrace &inTrace)
+{
+	// Classified before conversion, from the XML as EA sent it
+	MessageInterchange::TLane aLane = LaneClassifier::Classify(inMessage, inSize, MessageBuffer::kFormatText);
+	uint64_t aKey = LaneClassifier::CoalescingKey(inMessage, inSize, MessageBuffer::kFormatText);
+	ApplyDeadline(inMessage, inSize, MessageBuffer::kFormatText, aLane, inTrace);
+	TMessageBufferPtr aJson;
+	{
+		EM_ALLOC_STAGE(AllocAccounting::kAllocConversion);
+		aJson = ConvertToJson(inMessage, inSize);
+	}
+	inTrace.Mark(LatencyTracer::kStageConverted);
+	EM_TRACE3(frame_parsed, inTrace.id, aJson ? aJson->Size() : 0, aJson && !aJson->Empty());
+	if (fMessageInterchange->SendMessageToROS(aJson, inTrace, aLane, aKey))
 	{
-		std::cout << "to ROS:" << inMessage << std::endl;
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogDebug, "to ROS: {}", boost::string_view(inMessage, inSize));
 	};
 }
 
+void EAConnector::ProcessIncomingCommand(const char *inCommand, const std::size_t &inSize, LatencyTracer::TMessageTrace &inTrace)
+{
+	// Nothing to convert, RosConnector decodes the command itself
+	TMessageBufferPtr aCommand;
+	{
+		EM_ALLOC_STAGE(AllocAccounting::kAllocConversion);
+		aCommand = BufferPool::Copy(inCommand, inSize);
+		aCommand->SetFormat(MessageBuffer::kFormatProtobuf);
+	}
+	inTrace.Mark(LatencyTracer::kStageConverted);
+	EM_TRACE3(frame_parsed, inTrace.id, inSize, true);
+	MessageInterchange::TLane aLane = LaneClassifier::Classify(inCommand, inSize, MessageBuffer::kFormatProtobuf);
+	ApplyDeadline(inCommand, inSize, MessageBuffer::kFormatProtobuf, aLane, inTrace);
+	if (fMessageInterchange->SendMessageToROS(aCommand, inTrace, aLane, LaneClassifier::CoalescingKey(inCommand, inSize, MessageBuffer::kFormatProtobuf)))
+	{
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogDebug, "to ROS: {} byte command", inSize);
+	}
+}
+
+void EAConnector::ApplyDeadline(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat, const MessageInterchange::TLane &inLane, LatencyTracer::TMessageTrace &ioTrace)
+{
+	uint32_t aDeadlineMs = LaneClassifier::DeadlineMs(inFrame, inSize, inFormat);
+	if (!aDeadlineMs)
+	{
+		aDeadlineMs = fDeadlineMs[inLane];
+	}
+	if (!aDeadlineMs)
+	{
+		return;
+	}
+	// Counted from when the frame was read from EA, messages injected
+	// without a receive time from now
+	uint64_t aReceived = ioTrace.stamps[LatencyTracer::kStageReceived];
+	ioTrace.deadline = (aReceived ? aReceived : LatencyTracer::Now()) + static_cast<uint64_t>(aDeadlineMs) * 1000000;
+}
+
+void EAConnector::DoPollOutgoing()
+{
+	// Replies from the ROS side are picked up on the io thread so that all
+	// socket writes happen where the sessions live
+	fOutgoingTimer.expires_after(std::chrono::milliseconds(10));
+	fOutgoingTimer.async_wait(
+		[this](boost::system::error_code ec)
+		{
+			if (ec == boost::asio::error::operation_aborted)
+			{
+				return;
+			}
+			TMessageBufferPtr aMessage;
+			while (fMessageInterchange->GetNextMessageForEA(aMessage))
+			{
+				SendToSessions(aMessage);
+			}
+			DoPollOutgoing();
+		}
+	);
+}
+
+void EAConnector::SendToSessions(const TMessageBufferPtr &inMessage)
+{
+	EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+	if (fFlightRecorder)
+	{
+		fFlightRecorder->Record(FlightRecorder::kEntryOutbound, inMessage->Data(), inMessage->Size());
+	}
+	boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
+	for (std::list<std::weak_ptr<TcpConnector> >::iterator aIter = fSessions.begin(); aIter != fSessions.end();)
+	{
+		std::shared_ptr<TcpConnector> aConnector = aIter->lock();
+		if (aConnector)
+		{
+			aConnector->Send(inMessage);
+			aIter++;
+		}
+		else
+		{
+			aIter = fSessions.erase(aIter);
+		}
+	}
+}
+
+void EAConnector::RunSharedMemoryWaiter()
+{
+	boost::unique_lock<boost::mutex> aLock(fShmMutex);
+	while (fShmRunning)
+	{
+		aLock.unlock();
+		bool aReady = fShmRing.Wait(std::chrono::milliseconds(100));
+		aLock.lock();
+		if (!aReady || !fShmRunning)
+		{
+			continue;
+		}
+		// The ring is only read on the io thread so that, like the sockets,
+		// it is the single producer of the interchange
+		fShmDrainPending = true;
+		boost::asio::post(fTcpAcceptor.get_executor(), boost::bind(&EAConnector::DrainSharedMemory, this));
+		while (fShmDrainPending && fShmRunning)
+		{
+			fShmDrained.wait(aLock);
+		}
+	}
+}
+
+void EAConnector::DrainSharedMemory()
+{
+	uint64_t aReceivedTime = LatencyTracer::Now();
+	EAFrame::THeader aHeader;
+	char *aPayload = NULL;
+	ShmRing::TPeekResult aResult = ShmRing::kPeekEmpty;
+	for (int i = 0; i < kShmDrainBatch && (aResult = fShmRing.Peek(aHeader, aPayload)) == ShmRing::kPeekFrame; i++)
+	{
+		MetricsRegistry::Add(MetricsRegistry::kBytesReceived, EAFrame::kHeaderSize + aHeader.length);
+		// The frame is converted where the producer wrote it
+		HandleFrame(aHeader, aPayload, aReceivedTime);
+		fShmRing.Consume();
+	}
+	if (aResult == ShmRing::kPeekCorrupt)
+	{
+		MetricsRegistry::Add(MetricsRegistry::kFramingErrors);
+		EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "Shared memory ring held an invalid frame header, its contents were dropped");
+	}
+	if (aResult == ShmRing::kPeekFrame)
+	{
+		// More than a batch was waiting, let the sessions in first
+		boost::asio::post(fTcpAcceptor.get_executor(), boost::bind(&EAConnector::DrainSharedMemory, this));
+		return;
+	}
+	boost::lock_guard<boost::mutex> aLock(fShmMutex);
+	fShmDrainPending = false;
+	fShmDrained.notify_one();
+}
+
 void EAConnector::Stop()
 {
 	{
 		boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
+		fOutgoingTimer.cancel();
+	}
+	if (fLocalAcceptor)
+	{
+		boost::system::error_code aError;
+		fLocalAcceptor->close(aError);
+		unlink(fLocalPath.c_str());
+		fLocalAcceptor.reset();
+	}
+	{
+		boost::lock_guard<boost::mutex> aLock(fShmMutex);
+		fShmRunning = false;
+		fShmDrained.notify_one();
+	}
+	if (fShmThread.joinable())
+	{
+		fShmThread.join();
 	}
+	fShmRing.Close();
 }
 
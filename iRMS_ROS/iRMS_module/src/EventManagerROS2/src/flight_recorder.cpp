@@ -0,0 +1,227 @@
+/*
+ * flight_recorder.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "flight_recorder.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static_assert(sizeof(FlightRecorder::THeader) == FlightRecorder::kSlotSize, "header must fill one slot");
+static_assert(sizeof(FlightRecorder::TSlot) == FlightRecorder::kSlotSize, "slot size is part of the file format");
+
+FlightRecorder *FlightRecorder::sInstalled = NULL;
+char FlightRecorder::sDumpPrefix[256] = "";
+
+namespace
+{
+	// snprintf is not async-signal-safe
+	char *AppendNumber(char *outText, const char *inEnd, uint64_t inValue)
+	{
+		char aDigits[24];
+		int aCount = 0;
+		do
+		{
+			aDigits[aCount++] = '0' + inValue % 10;
+			inValue /= 10;
+		} while (inValue);
+		while (aCount && outText < inEnd)
+		{
+			*outText++ = aDigits[--aCount];
+		}
+		return outText;
+	}
+
+	char *AppendText(char *outText, const char *inEnd, const char *inValue)
+	{
+		while (*inValue && outText < inEnd)
+		{
+			*outText++ = *inValue++;
+		}
+		return outText;
+	}
+}
+
+FlightRecorder::FlightRecorder() : fHeader(NULL), fSlots(NULL), fMappedSize(0), fFile(-1)
+{
+}
+
+FlightRecorder::~FlightRecorder()
+{
+	Close();
+}
+
+bool FlightRecorder::Open(const std::string &inPath, const uint32_t &inSlots)
+{
+	Close();
+	if (!inSlots)
+	{
+		return false;
+	}
+	fMappedSize = sizeof(THeader) + static_cast<std::size_t>(inSlots) * sizeof(TSlot);
+	// The previous run's ring is what explains a crash, keep it for the decoder
+	std::string aPreviousPath = inPath + ".prev";
+	if (rename(inPath.c_str(), aPreviousPath.c_str()) != 0 && errno != ENOENT)
+	{
+		return false;
+	}
+	fFile = open(inPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fFile < 0 || ftruncate(fFile, fMappedSize) != 0)
+	{
+		Close();
+		return false;
+	}
+	void *aMemory = mmap(NULL, fMappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fFile, 0);
+	if (aMemory == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	// The file is freshly truncated so every slot reads as empty
+	fHeader = static_cast<THeader *>(aMemory);
+	fSlots = reinterpret_cast<TSlot *>(fHeader + 1);
+	fHeader->slot_size = sizeof(TSlot);
+	fHeader->slot_count = inSlots;
+	fHeader->next.store(0, std::memory_order_relaxed);
+	fHeader->magic = kMagic;
+	return true;
+}
+
+void FlightRecorder::Close()
+{
+	if (sInstalled == this)
+	{
+		sInstalled = NULL;
+	}
+	if (fHeader)
+	{
+		munmap(fHeader, fMappedSize);
+		fHeader = NULL;
+		fSlots = NULL;
+	}
+	if (fFile >= 0)
+	{
+		close(fFile);
+		fFile = -1;
+	}
+}
+
+void FlightRecorder::Record(const TEntryType &inType, const char *inData, const std::size_t &inLength, const LatencyTracer::TMessageTrace *inTrace)
+{
+	if (!fHeader)
+	{
+		return;
+	}
+	uint64_t aEntry = fHeader->next.fetch_add(1, std::memory_order_relaxed);
+	TSlot &aSlot = fSlots[aEntry % fHeader->slot_count];
+
+	// Seqlock style, a reader that sees the same even sequence before and
+	// after copying a slot has a consistent entry
+	aSlot.sequence.store(2 * aEntry + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	aSlot.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	aSlot.type = inType;
+	aSlot.length = inLength;
+	aSlot.stored = (inLength < sizeof(aSlot.data) ? inLength : sizeof(aSlot.data));
+	if (inTrace)
+	{
+		memcpy(aSlot.stamps, inTrace->stamps, sizeof(aSlot.stamps));
+	}
+	else
+	{
+		memset(aSlot.stamps, 0, sizeof(aSlot.stamps));
+	}
+	if (aSlot.stored)
+	{
+		memcpy(aSlot.data, inData, aSlot.stored);
+	}
+	aSlot.sequence.store(2 * aEntry + 2, std::memory_order_release);
+}
+
+bool FlightRecorder::Dump(const char *inPath) const
+{
+	if (!fHeader)
+	{
+		return false;
+	}
+	int aFile = open(inPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (aFile < 0)
+	{
+		return false;
+	}
+	const char *aData = reinterpret_cast<const char *>(fHeader);
+	std::size_t aWritten = 0;
+	while (aWritten < fMappedSize)
+	{
+		ssize_t aResult = write(aFile, aData + aWritten, fMappedSize - aWritten);
+		if (aResult <= 0)
+		{
+			break;
+		}
+		aWritten += aResult;
+	}
+	close(aFile);
+	return aWritten == fMappedSize;
+}
+
+bool FlightRecorder::InstallSignalHandlers(const std::string &inDirectory)
+{
+	if (!fHeader || inDirectory.size() + 64 > sizeof(sDumpPrefix))
+	{
+		return false;
+	}
+	// Everything the handler needs is prepared here
+	char *aEnd = sDumpPrefix + sizeof(sDumpPrefix) - 1;
+	char *aText = AppendText(sDumpPrefix, aEnd, inDirectory.c_str());
+	aText = AppendText(aText, aEnd, "/flight-");
+	aText = AppendNumber(aText, aEnd, getpid());
+	*aText = '\0';
+	sInstalled = this;
+
+	struct sigaction aAction;
+	memset(&aAction, 0, sizeof(aAction));
+	aAction.sa_handler = &FlightRecorder::HandleSignal;
+	sigemptyset(&aAction.sa_mask);
+	aAction.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &aAction, NULL);
+
+	aAction.sa_flags = SA_RESETHAND;
+	int aFatalSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+	for (int aSignal : aFatalSignals)
+	{
+		sigaction(aSignal, &aAction, NULL);
+	}
+	return true;
+}
+
+void FlightRecorder::HandleSignal(int inSignal)
+{
+	static std::atomic<uint32_t> sDumps(0);
+	int aErrno = errno;
+	if (sInstalled)
+	{
+		char aPath[sizeof(sDumpPrefix) + 48];
+		char *aEnd = aPath + sizeof(aPath) - 1;
+		char *aText = AppendText(aPath, aEnd, sDumpPrefix);
+		aText = AppendText(aText, aEnd, inSignal == SIGUSR1 ? "-usr1-" : "-crash-");
+		aText = AppendNumber(aText, aEnd, sDumps.fetch_add(1));
+		aText = AppendText(aText, aEnd, ".bin");
+		*aText = '\0';
+		sInstalled->Dump(aPath);
+	}
+	errno = aErrno;
+	if (inSignal != SIGUSR1)
+	{
+		// SA_RESETHAND restored the default action, let it end the process
+		raise(inSignal);
+	}
+}
@@ -0,0 +1,395 @@
+/*
+ * lane_classifier.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "lane_classifier.hpp"
+
+#include <boost/utility/string_view.hpp>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+	// The first command is expected well within this many bytes
+	const std::size_t kXmlScanLimit = 512;
+
+	typedef struct SCommandLane
+	{
+		const char *element;
+		uint32_t field;					// in ats.base.RobotCommand
+		MessageInterchange::TLane lane;
+	} TCommandLane;
+
+	// Commands not listed here are control too
+	const TCommandLane kCommandLanes[] =
+	{
+		{"load_map", 1, MessageInterchange::kLaneBulk},
+		{"point_list", 2, MessageInterchange::kLaneMission},
+		{"start", 3, MessageInterchange::kLaneMission},
+		{"stop", 5, MessageInterchange::kLaneControl}
+	};
+	const std::size_t kCommandLaneCount = sizeof(kCommandLanes) / sizeof(kCommandLanes[0]);
+
+	// Fields of the ats.base.PointList a coalescing key is read from
+	const char *const kPointList = "point_list";
+	const uint32_t kPointListField = 2;
+	const uint32_t kPointListIdField = 1;
+	const uint32_t kPointListOpField = 2;
+	const uint32_t kPointListBaseVersionField = 5;
+
+	// Where EA puts the deadline of a frame
+	const char *const kDeadlineAttribute = "deadline_ms=";
+	const uint32_t kDeadlineField = 4;		// in ats.base.RobotCommand
+
+	// inSuffix ends at inEnd, which is no earlier than inBegin
+	bool EndsWith(const char *inBegin, const char *inEnd, const char *inSuffix)
+	{
+		std::size_t aLength = strlen(inSuffix);
+		return static_cast<std::size_t>(inEnd - inBegin) >= aLength && memcmp(inEnd - aLength, inSuffix, aLength) == 0;
+	}
+
+	bool ReadVarint(const unsigned char *&ioCursor, const unsigned char *inEnd, uint64_t &outValue)
+	{
+		outValue = 0;
+		for (int aShift = 0; ioCursor < inEnd && aShift < 64; aShift += 7)
+		{
+			unsigned char aByte = *ioCursor++;
+			outValue |= static_cast<uint64_t>(aByte & 0x7f) << aShift;
+			if (!(aByte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+MessageInterchange::TLane LaneClassifier::Classify(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat)
+{
+	if (inFormat == MessageBuffer::kFormatProtobuf)
+	{
+		return ClassifyCommand(inFrame, inSize);
+	}
+	return ClassifyXml(inFrame, inSize);
+}
+
+const char *LaneClassifier::FirstCommand(const char *inXml, const std::size_t &inSize, std::size_t &outLength)
+{
+	const char *aEnd = inXml + (inSize < kXmlScanLimit ? inSize : kXmlScanLimit);
+	const char *aCursor = inXml;
+	while (aCursor < aEnd)
+	{
+		const char *aTag = static_cast<const char *>(memchr(aCursor, '<', aEnd - aCursor));
+		if (!aTag)
+		{
+			break;
+		}
+		const char *aName = aTag + 1;
+		const char *aNameEnd = aName;
+		while (aNameEnd < aEnd && *aNameEnd != '>' && *aNameEnd != '/' && *aNameEnd != ' ' && *aNameEnd != '\t' && *aNameEnd != '\r' && *aNameEnd != '\n')
+		{
+			aNameEnd++;
+		}
+		aCursor = aNameEnd;
+		std::size_t aLength = aNameEnd - aName;
+		// Declarations, comments, closing tags, the root and the <map> that
+		// point lists come wrapped in are not commands
+		if (aLength == 0 || *aName == '?' || *aName == '!' || (aLength == 5 && memcmp(aName, "robot", 5) == 0)
+			|| (aLength == 3 && memcmp(aName, "map", 3) == 0))
+		{
+			continue;
+		}
+		outLength = aLength;
+		return aName;
+	}
+	return NULL;
+}
+
+MessageInterchange::TLane LaneClassifier::ClassifyXml(const char *inXml, const std::size_t &inSize)
+{
+	std::size_t aLength = 0;
+	const char *aName = FirstCommand(inXml, inSize, aLength);
+	if (!aName)
+	{
+		return MessageInterchange::kLaneMission;
+	}
+	for (std::size_t i = 0; i < kCommandLaneCount; i++)
+	{
+		if (aLength == strlen(kCommandLanes[i].element) && memcmp(aName, kCommandLanes[i].element, aLength) == 0)
+		{
+			return kCommandLanes[i].lane;
+		}
+	}
+	return MessageInterchange::kLaneControl;
+}
+
+MessageInterchange::TLane LaneClassifier::ClassifyCommand(const char *inCommand, const std::size_t &inSize)
+{
+	// Walks the top level fields only; every command is a length delimited message
+	const unsigned char *aCursor = reinterpret_cast<const unsigned char *>(inCommand);
+	const unsigned char *aEnd = aCursor + inSize;
+	MessageInterchange::TLane aLane = MessageInterchange::kLaneControl;
+	while (aCursor < aEnd)
+	{
+		uint64_t aTag = 0;
+		uint64_t aLength = 0;
+		if (!ReadVarint(aCursor, aEnd, aTag))
+		{
+			return MessageInterchange::kLaneMission;
+		}
+		// deadline_ms, not a command
+		if ((aTag & 7) == 0 && ReadVarint(aCursor, aEnd, aLength))
+		{
+			continue;
+		}
+		if ((aTag & 7) != 2 || !ReadVarint(aCursor, aEnd, aLength) || aLength > static_cast<uint64_t>(aEnd - aCursor))
+		{
+			// RosConnector reports it when it fails to parse
+			return MessageInterchange::kLaneMission;
+		}
+		aCursor += aLength;
+		for (std::size_t i = 0; i < kCommandLaneCount; i++)
+		{
+			if ((aTag >> 3) == kCommandLanes[i].field && kCommandLanes[i].lane > aLane)
+			{
+				aLane = kCommandLanes[i].lane;
+			}
+		}
+	}
+	return aLane;
+}
+
+uint64_t LaneClassifier::CoalescingKey(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat)
+{
+	if (inFormat == MessageBuffer::kFormatProtobuf)
+	{
+		return CommandKey(inFrame, inSize);
+	}
+	return XmlKey(inFrame, inSize);
+}
+
+uint64_t LaneClassifier::XmlKey(const char *inXml, const std::size_t &inSize)
+{
+	std::size_t aLength = 0;
+	const char *aName = FirstCommand(inXml, inSize, aLength);
+	if (!aName || aLength != strlen(kPointList) || memcmp(aName, kPointList, aLength) != 0)
+	{
+		return 0;
+	}
+	// Nothing but closing tags may follow the point list, or another command
+	// would be lost with it
+	const char *aTail = inXml + inSize;
+	for (;;)
+	{
+		while (aTail > aName && isspace(static_cast<unsigned char>(aTail[-1])))
+		{
+			aTail--;
+		}
+		if (EndsWith(aName, aTail, "</robot>"))
+		{
+			aTail -= strlen("</robot>");
+		}
+		else if (EndsWith(aName, aTail, "</map>"))
+		{
+			aTail -= strlen("</map>");
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (!EndsWith(aName, aTail, "</point_list>"))
+	{
+		return 0;
+	}
+	boost::string_view aBody(aName, aTail - aName);
+	std::size_t aOp = aBody.find("<op>");
+	if (aOp != boost::string_view::npos && aBody.substr(aOp + 4, 8) != "replace<")
+	{
+		return 0;
+	}
+	std::size_t aBase = aBody.find("<base_version>");
+	if (aBase != boost::string_view::npos && aBody.substr(aBase + 14, 2) != "0<")
+	{
+		return 0;
+	}
+	std::size_t aId = aBody.find("<id>");
+	if (aId == boost::string_view::npos)
+	{
+		return 0;
+	}
+	uint64_t aValue = 0;
+	std::size_t aDigits = 0;
+	for (std::size_t i = aId + 4; i < aBody.size() && isdigit(static_cast<unsigned char>(aBody[i])); i++, aDigits++)
+	{
+		aValue = aValue * 10 + (aBody[i] - '0');
+	}
+	if (!aDigits || aId + 4 + aDigits >= aBody.size() || aBody[aId + 4 + aDigits] != '<')
+	{
+		return 0;
+	}
+	return MessageInterchange::MakeKey(MessageInterchange::kKeyPointList, aValue);
+}
+
+uint64_t LaneClassifier::CommandKey(const char *inCommand, const std::size_t &inSize)
+{
+	const unsigned char *aCursor = reinterpret_cast<const unsigned char *>(inCommand);
+	const unsigned char *aEnd = aCursor + inSize;
+	const unsigned char *aPointList = NULL;
+	uint64_t aPointListSize = 0;
+	while (aCursor < aEnd)
+	{
+		uint64_t aTag = 0;
+		uint64_t aLength = 0;
+		if (!ReadVarint(aCursor, aEnd, aTag))
+		{
+			return 0;
+		}
+		// A superseding point list brings a deadline of its own
+		if ((aTag & 7) == 0 && (aTag >> 3) == kDeadlineField && ReadVarint(aCursor, aEnd, aLength))
+		{
+			continue;
+		}
+		if ((aTag & 7) != 2 || !ReadVarint(aCursor, aEnd, aLength) || aLength > static_cast<uint64_t>(aEnd - aCursor))
+		{
+			return 0;
+		}
+		// Only a command holding a point list and nothing else
+		if ((aTag >> 3) != kPointListField || aPointList)
+		{
+			return 0;
+		}
+		aPointList = aCursor;
+		aPointListSize = aLength;
+		aCursor += aLength;
+	}
+	if (!aPointList)
+	{
+		return 0;
+	}
+	aCursor = aPointList;
+	aEnd = aPointList + aPointListSize;
+	uint64_t aId = 0;
+	while (aCursor < aEnd)
+	{
+		uint64_t aTag = 0;
+		uint64_t aValue = 0;
+		if (!ReadVarint(aCursor, aEnd, aTag))
+		{
+			return 0;
+		}
+		switch (aTag & 7)
+		{
+		case 0:
+			if (!ReadVarint(aCursor, aEnd, aValue))
+			{
+				return 0;
+			}
+			// op other than REPLACE, or a base_version to check against
+			if (((aTag >> 3) == kPointListOpField || (aTag >> 3) == kPointListBaseVersionField) && aValue != 0)
+			{
+				return 0;
+			}
+			if ((aTag >> 3) == kPointListIdField)
+			{
+				aId = aValue;
+			}
+			break;
+		case 1:
+			aCursor += 8;
+			break;
+		case 2:
+			if (!ReadVarint(aCursor, aEnd, aValue) || aValue > static_cast<uint64_t>(aEnd - aCursor))
+			{
+				return 0;
+			}
+			aCursor += aValue;
+			break;
+		case 5:
+			aCursor += 4;
+			break;
+		default:
+			return 0;
+		}
+	}
+	if (aCursor != aEnd)
+	{
+		return 0;
+	}
+	return MessageInterchange::MakeKey(MessageInterchange::kKeyPointList, aId);
+}
+
+uint32_t LaneClassifier::DeadlineMs(const char *inFrame, const std::size_t &inSize, const MessageBuffer::TFormat &inFormat)
+{
+	if (inFormat == MessageBuffer::kFormatProtobuf)
+	{
+		return CommandDeadlineMs(inFrame, inSize);
+	}
+	return XmlDeadlineMs(inFrame, inSize);
+}
+
+uint32_t LaneClassifier::XmlDeadlineMs(const char *inXml, const std::size_t &inSize)
+{
+	// Only the attributes of the root are looked at
+	boost::string_view aXml(inXml, inSize < kXmlScanLimit ? inSize : kXmlScanLimit);
+	std::size_t aRoot = aXml.find("<robot");
+	std::size_t aRootEnd = (aRoot == boost::string_view::npos ? aRoot : aXml.find('>', aRoot));
+	if (aRootEnd == boost::string_view::npos)
+	{
+		return 0;
+	}
+	boost::string_view aTag = aXml.substr(aRoot, aRootEnd - aRoot);
+	std::size_t aAttribute = aTag.find(kDeadlineAttribute);
+	if (aAttribute == boost::string_view::npos)
+	{
+		return 0;
+	}
+	std::size_t aValue = aAttribute + strlen(kDeadlineAttribute);
+	if (aValue >= aTag.size() || (aTag[aValue] != '"' && aTag[aValue] != '\''))
+	{
+		return 0;
+	}
+	uint64_t aDeadline = 0;
+	for (std::size_t i = aValue + 1; i < aTag.size() && isdigit(static_cast<unsigned char>(aTag[i])); i++)
+	{
+		aDeadline = aDeadline * 10 + (aTag[i] - '0');
+		if (aDeadline > UINT32_MAX)
+		{
+			return UINT32_MAX;
+		}
+	}
+	return static_cast<uint32_t>(aDeadline);
+}
+
+uint32_t LaneClassifier::CommandDeadlineMs(const char *inCommand, const std::size_t &inSize)
+{
+	const unsigned char *aCursor = reinterpret_cast<const unsigned char *>(inCommand);
+	const unsigned char *aEnd = aCursor + inSize;
+	while (aCursor < aEnd)
+	{
+		uint64_t aTag = 0;
+		uint64_t aValue = 0;
+		if (!ReadVarint(aCursor, aEnd, aTag) || !ReadVarint(aCursor, aEnd, aValue))
+		{
+			return 0;
+		}
+		if ((aTag & 7) == 0)
+		{
+			if ((aTag >> 3) == kDeadlineField)
+			{
+				return static_cast<uint32_t>(aValue > UINT32_MAX ? UINT32_MAX : aValue);
+			}
+			continue;
+		}
+		if ((aTag & 7) != 2 || aValue > static_cast<uint64_t>(aEnd - aCursor))
+		{
+			return 0;
+		}
+		aCursor += aValue;
+	}
+	return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * latency_tracer.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "latency_tracer.hpp"
+
+#include <boost/thread/lock_guard.hpp>
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+	// 0.1 us to 100 s on a log scale, ~5% bin width
+	const unsigned kBins = 430;
+	const double kMinMicroseconds = 0.1;
+	const double kMaxMicroseconds = 1e8;
+
+	const char *kStageNames[] =
+	{
+		"received",
+		"framed",
+		"converted",
+		"enqueued",
+		"dequeued",
+		"dispatched",
+		"goal_accepted",
+		"total"
+	};
+}
+
+LatencyTracer::LatencyTracer()
+{
+	for (int i = 0; i <= kStageCount; i++)
+	{
+		fHistograms.push_back(boost::histogram::make_histogram(TAxis(kBins, kMinMicroseconds, kMaxMicroseconds)));
+	}
+}
+
+LatencyTracer::~LatencyTracer()
+{
+}
+
+uint64_t LatencyTracer::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t LatencyTracer::NextMessageId()
+{
+	static std::atomic<uint64_t> sNextId(0);
+	return sNextId.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+const char *LatencyTracer::StageName(const TStage &inStage)
+{
+	return kStageNames[inStage];
+}
+
+void LatencyTracer::Record(const TMessageTrace &inTrace)
+{
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	uint64_t aFirst = 0;
+	uint64_t aPrevious = 0;
+	for (int i = 0; i < kStageCount; i++)
+	{
+		uint64_t aStamp = inTrace.stamps[i];
+		if (!aStamp)
+		{
+			continue;
+		}
+		if (aPrevious)
+		{
+			fHistograms[i](aStamp > aPrevious ? (aStamp - aPrevious) / 1000.0 : 0.0);
+		}
+		else
+		{
+			aFirst = aStamp;
+		}
+		aPrevious = aStamp;
+	}
+	if (aFirst && aPrevious > aFirst)
+	{
+		fHistograms[kStageCount]((aPrevious - aFirst) / 1000.0);
+	}
+}
+
+double LatencyTracer::QuantileLocked(const THistogram &inHistogram, const double &inQuantile) const
+{
+	// Values outside the axis land in the flow bins, count them so the
+	// quantile never under-reports a slow tail
+	double aTotal = 0;
+	for (auto &&aBin : boost::histogram::indexed(inHistogram, boost::histogram::coverage::all))
+	{
+		aTotal += *aBin;
+	}
+	double aTarget = inQuantile * aTotal;
+	double aCumulative = 0;
+	for (auto &&aBin : boost::histogram::indexed(inHistogram, boost::histogram::coverage::all))
+	{
+		aCumulative += *aBin;
+		if (aCumulative >= aTarget && *aBin > 0)
+		{
+			if (aBin.index() < 0)
+			{
+				return kMinMicroseconds;
+			}
+			if (aBin.index() >= static_cast<int>(kBins))
+			{
+				return kMaxMicroseconds;
+			}
+			return aBin.bin().upper();
+		}
+	}
+	return 0;
+}
+
+bool LatencyTracer::Quantile(const TStage &inStage, const double &inQuantile, double &outMicroseconds) const
+{
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	const THistogram &aHistogram = fHistograms[inStage];
+	if (boost::histogram::algorithm::sum(aHistogram, boost::histogram::coverage::all) == 0)
+	{
+		return false;
+	}
+	outMicroseconds = QuantileLocked(aHistogram, inQuantile);
+	return true;
+}
+
+void LatencyTracer::Summarise(TSummaryList &outSummary) const
+{
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	outSummary.clear();
+	for (int i = kStageFramed; i <= kStageCount; i++)
+	{
+		const THistogram &aHistogram = fHistograms[i];
+		TSummary aSummary;
+		aSummary.stage = kStageNames[i];
+		aSummary.count = boost::histogram::algorithm::sum(aHistogram, boost::histogram::coverage::all);
+		aSummary.p50_us = (aSummary.count ? QuantileLocked(aHistogram, 0.5) : 0);
+		aSummary.p99_us = (aSummary.count ? QuantileLocked(aHistogram, 0.99) : 0);
+		aSummary.p999_us = (aSummary.count ? QuantileLocked(aHistogram, 0.999) : 0);
+		outSummary.push_back(aSummary);
+	}
+}
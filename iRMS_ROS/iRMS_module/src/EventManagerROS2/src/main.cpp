@@ -8,6 +8,7 @@
 
 #include <boost/program_options.hpp>
 #include <boost/thread.hpp>
+#include <chrono>
 #include <string>
 #include <cstdlib>
 #include <signal.h>
@@ -15,6 +16,9 @@
 
 #include "ea_connector.hpp"
 #include "ros_connector.hpp"
+#include "metrics_server.hpp"
+#include "async_logger.hpp"
+#include "capture_replayer.hpp"
 
 namespace po = boost::program_options;
 
@@ -33,14 +37,68 @@ bool wait_for_quit()
 	return (!result);
 }
 
+// Plays the capture into our own listen port, reports and shuts down
+void replay_capture(CaptureReplayer *inReplayer, const std::string &inAddress, const uint16_t &inPort, const uint32_t &inSettleMs)
+{
+	CaptureReplayer::TReplayResult aResult;
+	if (inReplayer->Run(inAddress, inPort, aResult, inSettleMs))
+	{
+		double aSeconds = aResult.elapsed_ns / 1e9;
+		std::cout << "{\"records\":" << aResult.records
+			<< ",\"sessions\":" << aResult.sessions
+			<< ",\"bytes\":" << aResult.bytes
+			<< ",\"frames\":" << aResult.frames
+			<< ",\"to_ea\":" << aResult.to_ea
+			<< ",\"captured_to_ea\":" << aResult.captured_to_ea
+			<< ",\"elapsed_s\":" << aSeconds
+			<< ",\"bytes_per_s\":" << (aSeconds > 0 ? aResult.bytes / aSeconds : 0)
+			<< ",\"frames_per_s\":" << (aSeconds > 0 ? aResult.frames / aSeconds : 0)
+			<< "}" << std::endl;
+	}
+	else
+	{
+		std::cout << "Replay failed" << std::endl;
+	}
+	rclcpp::shutdown();
+}
+
 int main(int argc, char* argv[]) {
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
 		("listen_address", po::value<std::string>(), "set address to listen on")
 		("listen_port", po::value<uint16_t>(), "set port to listen on")
+		("listen_local", po::value<std::string>(), "set path of an AF_UNIX socket to also listen on, for an Event Manager on this host")
+		("shm_ingress", po::value<std::string>(), "set name of a shared memory ring to also take EA frames from, e.g. /event-manager-2-ros")
+		("shm_ingress_size", po::value<uint32_t>(), "set size (bytes) of the shared memory ring, default 4194304")
 		("ros_domain", po::value<std::string>(), "set ROS2 domain for RWM connection")
-		("ros_address", po::value<std::string>(), "set address of ROS device");
+		("ros_address", po::value<std::string>(), "set address of ROS device")
+		("map_dir", po::value<std::string>(), "set directory load_map <id> reads <id>_runtime_map.svg from, point lists are not checked against nogo zones unless set")
+		("event_loop", po::value<std::string>(), "threaded (default) runs EA, interchange and ROS on their own threads, integrated runs them all on one")
+		("process", po::value<std::string>(), "all (default) runs the EA and ROS sides in this process, ea or ros runs only that side and exchanges messages with the other through interchange_shm")
+		("interchange_shm", po::value<std::string>(), "set name of the shared memory the EA and ROS sides exchange messages through, e.g. /event-manager-2-ros-interchange")
+		("interchange_shm_size", po::value<uint32_t>(), "set size (bytes) of each direction of the shared memory interchange, default 16777216")
+		("control_deadline_ms", po::value<uint32_t>(), "set how long (ms) after it was received a control command (stop, cancel, ...) may still be acted on, unless EA sets deadline_ms itself, 0 (default) for no limit")
+		("mission_deadline_ms", po::value<uint32_t>(), "set how long (ms) after it was received a point_list or start may still be acted on, unless EA sets deadline_ms itself, 0 (default) for no limit")
+		("bulk_deadline_ms", po::value<uint32_t>(), "set how long (ms) after it was received a load_map may still be acted on, unless EA sets deadline_ms itself, 0 (default) for no limit")
+		("event_loop_slice_us", po::value<uint32_t>(), "set how long (us) the integrated loop waits for EA traffic before servicing ROS")
+		("log_level", po::value<std::string>(), "set log levels, a level or category=level list e.g. info,ea=debug (categories general, ea, ros, interchange, map)")
+		("log_rate_limit", po::value<uint32_t>(), "set how many records per second each log statement may write, 0 for no limit, default 100")
+		("flight_recorder_path", po::value<std::string>(), "set file holding the ring of recent messages, default /tmp/event-manager-2-ros-<listen_port>.flight, none disables it, the previous run's file is kept as <path>.prev")
+		("flight_recorder_slots", po::value<uint32_t>(), "set how many recent messages the flight recorder keeps, default 4096")
+		("flight_recorder_dump_dir", po::value<std::string>(), "set directory the flight recorder is dumped to on SIGUSR1 or a crash, default /tmp")
+		("capture_path", po::value<std::string>(), "set file EA ingress and messages to EA are captured to for replay, not captured unless set")
+		("replay", po::value<std::string>(), "set capture file to replay into this bridge's listen port, the bridge exits once it has been processed")
+		("replay_speed", po::value<double>(), "set replay speed, 0 (default) as fast as possible, 1 original timing, 2 twice as fast")
+		("replay_settle_ms", po::value<uint32_t>(), "set how long (ms) the bridge must be idle before a replay is considered processed, default 500")
+		("metrics_address", po::value<std::string>(), "set address the Prometheus metrics endpoint listens on, default 127.0.0.1")
+		("metrics_port", po::value<uint16_t>(), "set port of the Prometheus metrics endpoint, not served unless set")
+		("goal_dispatch", po::value<std::string>(), "shell (default) sends follow_waypoints goals with the ros2 cli, action uses the action client and traces goal acceptance")
+		("simplify_tolerance", po::value<double>(), "set distance (m) a point list may deviate when removing redundant points, 0 disables simplification")
+		("max_point_spacing", po::value<double>(), "set maximum distance (m) between consecutive waypoints, 0 disables resampling")
+		("corner_radius", po::value<double>(), "set radius (m) used to blend corners between waypoints, 0 disables blending")
+		("default_speed", po::value<double>(), "set speed (m/s) used for waypoints that do not specify one")
+		("max_acceleration", po::value<double>(), "set acceleration limit (m/s^2) used for waypoints that do not specify one");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -51,15 +109,83 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	if (!vm.count("listen_address") || !vm.count("listen_port") || !vm.count("ros_address"))
+	bool aRunEA = true;
+	bool aRunRos = true;
+	if (vm.count("process"))
+	{
+		std::string aProcess = vm["process"].as<std::string>();
+		if (aProcess == "ea")
+		{
+			aRunRos = false;
+		}
+		else if (aProcess == "ros")
+		{
+			aRunEA = false;
+		}
+		else if (aProcess != "all")
+		{
+			std::cout << "process must be all, ea or ros" << std::endl;
+			return 1;
+		}
+	}
+	if ((!aRunEA || !aRunRos) && !vm.count("interchange_shm"))
+	{
+		std::cout << "interchange_shm MUST be specified to run one side of the bridge" << std::endl;
+		return 1;
+	}
+
+	if (aRunEA && (!vm.count("listen_address") || !vm.count("listen_port") || !vm.count("ros_address")))
 	{
 		std::cout << "listen_address, list_port and ros_address MUST be specified" << std::endl;
 		return 1;
 	}
-	std::string aListenAddress = vm["listen_address"].as<std::string>();
-	uint16_t aListenPort = vm["listen_port"].as<uint16_t>();
+	std::string aListenAddress = (aRunEA ? vm["listen_address"].as<std::string>() : "");
+	uint16_t aListenPort = (aRunEA ? vm["listen_port"].as<uint16_t>() : 0);
 
-	std::string aRobotAddress = vm["ros_address"].as<std::string>();
+	std::string aRobotAddress = (vm.count("ros_address") ? vm["ros_address"].as<std::string>() : "");
+	bool aIntegrated = false;
+	if (vm.count("event_loop"))
+	{
+		std::string aEventLoop = vm["event_loop"].as<std::string>();
+		if (aEventLoop == "integrated")
+		{
+			aIntegrated = true;
+		}
+		else if (aEventLoop != "threaded")
+		{
+			std::cout << "event_loop must be threaded or integrated" << std::endl;
+			return 1;
+		}
+	}
+	if (aIntegrated && (!aRunEA || !aRunRos))
+	{
+		std::cout << "event_loop integrated needs both sides of the bridge in one process" << std::endl;
+		return 1;
+	}
+	if (vm.count("replay") && (!aRunEA || !aRunRos))
+	{
+		std::cout << "replay needs both sides of the bridge in one process" << std::endl;
+		return 1;
+	}
+	std::chrono::microseconds aSlice(1000);
+	if (vm.count("event_loop_slice_us"))
+	{
+		aSlice = std::chrono::microseconds(vm["event_loop_slice_us"].as<uint32_t>());
+	}
+	bool aUseActionClient = false;
+	if (vm.count("goal_dispatch"))
+	{
+		std::string aGoalDispatch = vm["goal_dispatch"].as<std::string>();
+		if (aGoalDispatch == "action")
+		{
+			aUseActionClient = true;
+		}
+		else if (aGoalDispatch != "shell")
+		{
+			std::cout << "goal_dispatch must be shell or action" << std::endl;
+			return 1;
+		}
+	}
 	std::string aRosDomain = "0";
 	if (vm.count("ros_domain"))
 	{
@@ -75,26 +201,244 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-    rclcpp::init(argc, argv);
+	if (vm.count("log_level") && !AsyncLogger::Configure(vm["log_level"].as<std::string>()))
+	{
+		std::cout << "log_level not understood" << std::endl;
+		return 1;
+	}
+	if (vm.count("log_rate_limit"))
+	{
+		for (int i = 0; i < AsyncLogger::kLogCategoryCount; i++)
+		{
+			AsyncLogger::SetRateLimit(static_cast<AsyncLogger::TLogCategory>(i), vm["log_rate_limit"].as<uint32_t>());
+		}
+	}
+	AsyncLogger::Start();
+
+	FlightRecorder aFlightRecorder;
+	// A ROS side on its own has no port to tell it apart
+	std::string aFlightRecorderPath = "/tmp/event-manager-2-ros-" + (aRunEA ? std::to_string(aListenPort) : std::string("ros")) + ".flight";
+	if (vm.count("flight_recorder_path"))
+	{
+		aFlightRecorderPath = vm["flight_recorder_path"].as<std::string>();
+	}
+	if (aFlightRecorderPath != "none")
+	{
+		uint32_t aSlots = (vm.count("flight_recorder_slots") ? vm["flight_recorder_slots"].as<uint32_t>() : 4096);
+		std::string aDumpDir = (vm.count("flight_recorder_dump_dir") ? vm["flight_recorder_dump_dir"].as<std::string>() : "/tmp");
+		if (!aFlightRecorder.Open(aFlightRecorderPath, aSlots) || !aFlightRecorder.InstallSignalHandlers(aDumpDir))
+		{
+			std::cout << "Flight recorder " << aFlightRecorderPath << " could not be opened" << std::endl;
+			return 1;
+		}
+	}
+
+	TrafficCapture aTrafficCapture;
+	if (vm.count("capture_path") && !aTrafficCapture.Open(vm["capture_path"].as<std::string>()))
+	{
+		std::cout << "Capture file " << vm["capture_path"].as<std::string>() << " could not be opened" << std::endl;
+		return 1;
+	}
+	CaptureReplayer aReplayer;
+	if (vm.count("replay"))
+	{
+		if (!aReplayer.Open(vm["replay"].as<std::string>()))
+		{
+			std::cout << "Capture file " << vm["replay"].as<std::string>() << " could not be read" << std::endl;
+			return 1;
+		}
+		if (vm.count("replay_speed"))
+		{
+			aReplayer.SetSpeed(vm["replay_speed"].as<double>());
+		}
+	}
+	uint32_t aReplaySettleMs = (vm.count("replay_settle_ms") ? vm["replay_settle_ms"].as<uint32_t>() : 500);
+
+	std::string aMetricsAddress = "127.0.0.1";
+	if (vm.count("metrics_address"))
+	{
+		aMetricsAddress = vm["metrics_address"].as<std::string>();
+	}
+	boost::shared_ptr<MetricsServer> aMetricsServer;
+	if (vm.count("metrics_port"))
+	{
+		aMetricsServer = boost::shared_ptr<MetricsServer>(new MetricsServer(aMetricsAddress, vm["metrics_port"].as<uint16_t>()));
+		if (!aMetricsServer->Start())
+		{
+			return 1;
+		}
+	}
+
 	MessageInterchange aMessageInterchange;
-	RosConnector aRosConnector;
-	std::cout << "Starting EA connection" << std::endl;
+	if (vm.count("interchange_shm"))
+	{
+		uint32_t aInterchangeSize = (vm.count("interchange_shm_size") ? vm["interchange_shm_size"].as<uint32_t>() : 16 * 1024 * 1024);
+		if (!aMessageInterchange.OpenShared(vm["interchange_shm"].as<std::string>(), aInterchangeSize))
+		{
+			std::cout << "Could not open shared memory interchange " << vm["interchange_shm"].as<std::string>() << std::endl;
+			return 1;
+		}
+	}
+	if (aTrafficCapture.IsOpen())
+	{
+		aMessageInterchange.SetTrafficCapture(&aTrafficCapture);
+	}
+	ZoneIndex aZoneIndex;
+	LatencyTracer aLatencyTracer;
+	boost::shared_ptr<RosConnector> aRosConnector;
+	if (aRunRos)
+	{
+		rclcpp::init(argc, argv);
+		aRosConnector = boost::shared_ptr<RosConnector>(new RosConnector());
+		aRosConnector->SetZoneIndex(&aZoneIndex);
+		if (vm.count("map_dir"))
+		{
+			aRosConnector->SetMapSource(vm["map_dir"].as<std::string>(), aRobotAddress);
+		}
+		aRosConnector->SetLatencyTracer(&aLatencyTracer);
+		aRosConnector->SetFlightRecorder(&aFlightRecorder);
+		aRosConnector->SetGoalDispatch(aUseActionClient);
+		if (vm.count("simplify_tolerance"))
+		{
+			aRosConnector->GetPathSimplifier().SetTolerance(vm["simplify_tolerance"].as<double>());
+		}
+		if (vm.count("max_point_spacing"))
+		{
+			aRosConnector->GetPathSimplifier().SetMaxSpacing(vm["max_point_spacing"].as<double>());
+		}
+		if (vm.count("corner_radius"))
+		{
+			aRosConnector->GetTrajectoryConditioner().SetCornerRadius(vm["corner_radius"].as<double>());
+		}
+		if (vm.count("default_speed"))
+		{
+			aRosConnector->GetTrajectoryConditioner().SetDefaultSpeed(vm["default_speed"].as<double>());
+		}
+		if (vm.count("max_acceleration"))
+		{
+			aRosConnector->GetTrajectoryConditioner().SetMaxAcceleration(vm["max_acceleration"].as<double>());
+		}
+	}
 	boost::asio::io_context io_context;
-	EAConnector aEventManagerConnector(io_context, aListenAddress, aListenPort, aRobotAddress);
-	aEventManagerConnector.Start(&aMessageInterchange);
-	boost::thread aThread([&]
+	boost::shared_ptr<EAConnector> aEventManagerConnector;
+	if (aRunEA)
 	{
- 		io_context.run();
-	});
+		std::cout << "Starting EA connection" << std::endl;
+		aEventManagerConnector = boost::shared_ptr<EAConnector>(new EAConnector(io_context, aListenAddress, aListenPort, aRobotAddress));
+		aEventManagerConnector->SetFlightRecorder(&aFlightRecorder);
+		if (aTrafficCapture.IsOpen())
+		{
+			aEventManagerConnector->SetTrafficCapture(&aTrafficCapture);
+		}
+		if (vm.count("listen_local") && !aEventManagerConnector->ListenLocal(vm["listen_local"].as<std::string>()))
+		{
+			std::cout << "Could not listen on " << vm["listen_local"].as<std::string>() << std::endl;
+			return 1;
+		}
+		if (vm.count("shm_ingress"))
+		{
+			uint32_t aRingSize = (vm.count("shm_ingress_size") ? vm["shm_ingress_size"].as<uint32_t>() : 4 * 1024 * 1024);
+			if (!aEventManagerConnector->ListenSharedMemory(vm["shm_ingress"].as<std::string>(), aRingSize))
+			{
+				std::cout << "Could not create shared memory ring " << vm["shm_ingress"].as<std::string>() << std::endl;
+				return 1;
+			}
+		}
+		const char *kDeadlineOptions[MessageInterchange::kLaneCount] = {"control_deadline_ms", "mission_deadline_ms", "bulk_deadline_ms"};
+		for (int i = 0; i < MessageInterchange::kLaneCount; i++)
+		{
+			if (vm.count(kDeadlineOptions[i]))
+			{
+				aEventManagerConnector->SetDeadline(static_cast<MessageInterchange::TLane>(i), vm[kDeadlineOptions[i]].as<uint32_t>());
+			}
+		}
+		aEventManagerConnector->Start(&aMessageInterchange, aIntegrated);
+	}
+
+	if (!aRunRos)
+	{
+		// The EA side on its own: the io thread is all there is, until SIGINT or SIGTERM
+		std::cout << "Running EA side only, ROS side joins through " << vm["interchange_shm"].as<std::string>() << std::endl;
+		boost::asio::signal_set aSignals(io_context, SIGINT, SIGTERM);
+		aSignals.async_wait([&](const boost::system::error_code &, int)
+		{
+			io_context.stop();
+		});
+		io_context.run();
+
+		std::cout << "Stopping" << std::endl;
+		aEventManagerConnector->Stop();
+		aTrafficCapture.Close();
+		AsyncLogger::Stop();
+		return 0;
+	}
+
+	boost::thread aReplayThread;
+	if (vm.count("replay"))
+	{
+		// The acceptor is already listening, connects queue until it runs
+		aReplayThread = boost::thread(&replay_capture, &aReplayer, aListenAddress, aListenPort, aReplaySettleMs);
+	}
+
+	if (aIntegrated)
+	{
+		// One thread: a TCP read is decoded and acted on without a queue hop,
+		// ROS callbacks are serviced between slices of socket work
+		std::cout << "Starting ROS connection (integrated event loop)" << std::endl;
+		aRosConnector->Start(&aMessageInterchange, true);
+		rclcpp::executors::SingleThreadedExecutor aExecutor;
+		aExecutor.add_node(aRosConnector->GetBaseNode());
+		while (rclcpp::ok())
+		{
+			io_context.run_for(aSlice);
+			if (io_context.stopped())
+			{
+				io_context.restart();
+			}
+			aExecutor.spin_some();
+		}
+		rclcpp::shutdown();
+
+		std::cout << "Stopping" << std::endl;
+		if (aReplayThread.joinable())
+		{
+			aReplayThread.join();
+		}
+		aRosConnector->Stop();
+		aEventManagerConnector->Stop();
+		aTrafficCapture.Close();
+		AsyncLogger::Stop();
+		return 0;
+	}
+
+	boost::thread aThread;
+	if (aEventManagerConnector)
+	{
+		aThread = boost::thread([&]
+		{
+			io_context.run();
+		});
+	}
 
 	std::cout << "Starting ROS connection" << std::endl;
-	aRosConnector.Start(&aMessageInterchange);
+	aRosConnector->Start(&aMessageInterchange);
 
-    rclcpp::spin(aRosConnector.GetBaseNode());
+	rclcpp::spin(aRosConnector->GetBaseNode());
 	rclcpp::shutdown();
 
 	std::cout << "Stopping" << std::endl;
-	aEventManagerConnector.Stop();
-	aThread.join();
+	if (aReplayThread.joinable())
+	{
+		aReplayThread.join();
+	}
+	// A message taken off a shared interchange is finished before exiting
+	aRosConnector->Stop();
+	if (aEventManagerConnector)
+	{
+		aEventManagerConnector->Stop();
+		aThread.join();
+	}
+	aTrafficCapture.Close();
+	AsyncLogger::Stop();
 	return 0;
 }
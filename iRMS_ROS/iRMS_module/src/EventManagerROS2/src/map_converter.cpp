@@ -7,10 +7,12 @@
 
 
 #include "map_converter.hpp"
+#include "latency_tracer.hpp"
+#include "tracepoints.hpp"
+#include "async_logger.hpp"
 
 #include <pugixml.hpp>
 #include <yaml-cpp/yaml.h>
-#include <iostream>
 #include <sstream>
 #include <fstream>
 #include <cmath>
@@ -35,19 +37,14 @@ bool MapConverter::LoadXML(const std::string &inMapSvg, pugi::xml_document &outX
 {
 	if (!outXmlDocument.load_string(inMapSvg.c_str()))
 	{
-		std::cout << "MapConverter::ConvertToRos : Error in XML document" << std::endl;
+		EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Map SVG is not a valid XML document");
 		return false;
 	}
 	return true;
 }
 
-bool MapConverter::ExtractMetadata(pugi::xml_document &inXmlDocument, const std::string &inMapName, std::string &outMetadataFilePath, TMapInfo &outMapInfo)
+bool MapConverter::ReadMapInfo(pugi::xml_document &inXmlDocument, TMapInfo &outMapInfo)
 {
-	std::string aImageFile = inMapName + ".pgm";
-	double_t aResolution = fResolution;
-	double_t aOccupiedThreshold = fThresholdHigh;
-	double_t aFreeThreshold = fThresholdLow;
-
 	pugi::xpath_node aXpathNode = inXmlDocument.select_node("/svg");
 	if (!aXpathNode)
 	{
@@ -67,6 +64,20 @@ bool MapConverter::ExtractMetadata(pugi::xml_document &inXmlDocument, const std:
 	north_x -= outMapInfo.origin_x;
 	north_y -= outMapInfo.origin_y;
 	outMapInfo.rotation = atan(north_x / north_y);
+	return true;
+}
+
+bool MapConverter::ExtractMetadata(pugi::xml_document &inXmlDocument, const std::string &inMapName, std::string &outMetadataFilePath, TMapInfo &outMapInfo)
+{
+	std::string aImageFile = inMapName + ".pgm";
+	double_t aResolution = fResolution;
+	double_t aOccupiedThreshold = fThresholdHigh;
+	double_t aFreeThreshold = fThresholdLow;
+
+	if (!ReadMapInfo(inXmlDocument, outMapInfo))
+	{
+		return false;
+	}
 
 	YAML::Emitter aMetadata;
 	aMetadata << YAML::BeginMap;
@@ -101,6 +112,47 @@ bool MapConverter::ExtractMetadata(pugi::xml_document &inXmlDocument, const std:
 	return true;
 }
 
+void MapConverter::ExtractZones(pugi::xml_document &inXmlDocument, const TMapInfo &inMapInfo)
+{
+	fZones.clear();
+	// A map with its north marker on the origin has no usable rotation
+	double_t aRotation = (std::isfinite(inMapInfo.rotation) ? inMapInfo.rotation : 0);
+	double_t aCos = cos(aRotation);
+	double_t aSin = sin(aRotation);
+	pugi::xpath_node_set aXpathNodes = inXmlDocument.select_nodes("//polygon");
+	for (pugi::xpath_node_set::iterator aIter = aXpathNodes.begin(); aIter != aXpathNodes.end(); aIter++)
+	{
+		pugi::xml_node aNode = aIter->node();
+		std::string aZoneType = aNode.attribute("map:type").as_string();
+		std::vector<ZoneIndex::TPoint> aPoints;
+		if (aZoneType != "nogo" || !ParsePolygon(aNode, aPoints))
+		{
+			continue;
+		}
+
+		ZoneIndex::TZone aZone;
+		aZone.id = aNode.attribute("id").as_string();
+		if (aZone.id.empty())
+		{
+			aZone.id = boost::lexical_cast<std::string>(fZones.size());
+		}
+		for (std::vector<ZoneIndex::TPoint>::const_iterator aPoint = aPoints.begin(); aPoint != aPoints.end(); aPoint++)
+		{
+			// Same placement as the costmap: map:scale metres per SVG unit,
+			// turned by the origin's yaw about the map origin
+			double_t dx = aPoint->x() * inMapInfo.scale;
+			double_t dy = aPoint->y() * inMapInfo.scale;
+			double_t x = inMapInfo.origin_x + dx * aCos - dy * aSin;
+			double_t y = inMapInfo.origin_y + dx * aSin + dy * aCos;
+			aZone.polygon.outer().push_back(ZoneIndex::TPoint(x, y));
+		}
+		if (aZone.polygon.outer().size() > 2)
+		{
+			fZones.push_back(aZone);
+		}
+	}
+}
+
 bool MapConverter::CreateCostmap(pugi::xml_document &inXmlDocument, const std::string &inMapName, const TMapInfo &inMapInfo, std::string &outMapFilePath)
 {
 	uint32_t rows = ceil(inMapInfo.height * inMapInfo.scale / fResolution);
@@ -139,22 +191,48 @@ bool MapConverter::CreateCostmap(pugi::xml_document &inXmlDocument, const std::s
 	return result;
 }
 
-void MapConverter::ProcessPolygon(const pugi::xml_node &inPolygonNode, unsigned char *inBuffer, const uint32_t &inRows, const uint32_t &inColumns, const double_t &inScale)
+bool MapConverter::ParsePolygon(const pugi::xml_node &inPolygonNode, std::vector<ZoneIndex::TPoint> &outPoints)
 {
+	outPoints.clear();
 	std::string aPolygonString = inPolygonNode.attribute("points").as_string();
+	boost::algorithm::trim(aPolygonString);
 	if (aPolygonString.empty())
 	{
-		return;
+		return false;
 	}
 	std::vector<std::string> aTokens;
 	boost::split(aTokens, aPolygonString, boost::is_any_of(" ,"), boost::token_compress_on);
+	size_t i = 0;
+	try {
+		for (; i + 1 < aTokens.size(); i += 2)
+		{
+			outPoints.push_back(ZoneIndex::TPoint(boost::lexical_cast<double_t>(aTokens[i]), boost::lexical_cast<double_t>(aTokens[i+1])));
+		}
+	}
+	catch (boost::bad_lexical_cast &e)
+	{
+		// One bad polygon in a hand edited map should not cost the whole map
+		EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Polygon {} skipped, malformed point {},{}", inPolygonNode.attribute("id").as_string(), aTokens[i], aTokens[i+1]);
+		outPoints.clear();
+		return false;
+	}
+	return true;
+}
+
+void MapConverter::ProcessPolygon(const pugi::xml_node &inPolygonNode, unsigned char *inBuffer, const uint32_t &inRows, const uint32_t &inColumns, const double_t &inScale)
+{
+	std::vector<ZoneIndex::TPoint> aPoints;
+	if (!ParsePolygon(inPolygonNode, aPoints) || aPoints.empty())
+	{
+		return;
+	}
 	double_t last_x = 0, last_y = 0;
 	double_t first_x = 0, first_y = 0;
 	bool first_pass = true;
-	for (size_t i = 0; i < aTokens.size() - 1; i += 2)
+	for (std::vector<ZoneIndex::TPoint>::const_iterator aPoint = aPoints.begin(); aPoint != aPoints.end(); aPoint++)
 	{
-		double_t x = boost::lexical_cast<double_t>(aTokens[i]);
-		double_t y = boost::lexical_cast<double_t>(aTokens[i+1]);
+		double_t x = aPoint->x();
+		double_t y = aPoint->y();
 		if (first_pass)
 		{
 			first_pass = false;
@@ -230,7 +308,7 @@ bool MapConverter::WriteMapToFile(const std::string &inFileName, const unsigned
 		{
 			for (uint16_t i = 0; i < cols; i++)
 			{
-				uint64_t offset = i + (j * cols);
+				uint64_t offset = i + ((j - 1) * cols);
 				unsigned char aCharVal = *(inBuffer + offset);
 				aFileStream << aCharVal;
 			}
@@ -270,7 +348,7 @@ bool MapConverter::FtpFiles(const std::string &inFtpAddress, const std::string &
 	}
 	catch (Poco::Exception &e)
 	{
-		std::cout << e.displayText() << std::endl;
+		EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Map upload to {} failed: {}", inFtpAddress, e.displayText());
 	}
 	return false;
 }
@@ -285,30 +363,51 @@ void MapConverter::CreateTempDirectory()
 	fOutputDir = result;
 }
 
+bool MapConverter::LoadZones(const std::string &inMapSvg)
+{
+	pugi::xml_document aDocument;
+	TMapInfo aMapInfo;
+	fZones.clear();
+	if (!LoadXML(inMapSvg, aDocument) || !ReadMapInfo(aDocument, aMapInfo))
+	{
+		return false;
+	}
+	ExtractZones(aDocument, aMapInfo);
+	return true;
+}
+
 bool MapConverter::ConvertToRos(const std::string &inDestinationAddress, const std::string &inMapSvg, const std::string &inMapName, std::string &outMetaDataPath)
 {
+	uint64_t aStartTime = LatencyTracer::Now();
+	EM_TRACE1(map_conversion_start, inMapSvg.size());
 	pugi::xml_document aDocument;
+	std::string aMetadataPath;
+	std::string aOutputPath;
+	TMapInfo aMapInfo;
 
-	if (LoadXML(inMapSvg, aDocument))
+	bool aConverted = LoadXML(inMapSvg, aDocument) && ExtractMetadata(aDocument, inMapName, aMetadataPath, aMapInfo);
+	if (aConverted)
 	{
-		std::string aMetadataPath;
-		std::string aOutputPath;
-		TMapInfo aMapInfo;
-		if (ExtractMetadata(aDocument, inMapName, aMetadataPath, aMapInfo))
-		{
-			if (CreateCostmap(aDocument, inMapName, aMapInfo, aOutputPath))
-			{
-				std::string aUploadedFilePath;
-				if (FtpFiles(inDestinationAddress, aOutputPath, aMetadataPath, aUploadedFilePath))
-				{
-					std::remove(aOutputPath.c_str());
-					std::remove(aMetadataPath.c_str());
-					outMetaDataPath = aUploadedFilePath;
-					return true;
-				}
-			}
-		}
+		ExtractZones(aDocument, aMapInfo);
+		aConverted = CreateCostmap(aDocument, inMapName, aMapInfo, aOutputPath);
+	}
+	EM_TRACE2(map_conversion_end, aConverted, LatencyTracer::Now() - aStartTime);
+	if (!aConverted)
+	{
+		return false;
 	}
 
+	uint64_t aUploadStartTime = LatencyTracer::Now();
+	EM_TRACE0(map_upload_start);
+	std::string aUploadedFilePath;
+	bool aUploaded = FtpFiles(inDestinationAddress, aOutputPath, aMetadataPath, aUploadedFilePath);
+	EM_TRACE2(map_upload_end, aUploaded, LatencyTracer::Now() - aUploadStartTime);
+	if (aUploaded)
+	{
+		std::remove(aOutputPath.c_str());
+		std::remove(aMetadataPath.c_str());
+		outMetaDataPath = aUploadedFilePath;
+		return true;
+	}
 	return false;
 }
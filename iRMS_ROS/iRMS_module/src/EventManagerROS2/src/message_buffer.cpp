@@ -0,0 +1,103 @@
+/*
+ * message_buffer.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "message_buffer.hpp"
+#include "metrics_registry.hpp"
+
+#include <boost/lockfree/stack.hpp>
+#include <cstring>
+#include <new>
+
+namespace
+{
+	// 512 B to 2 MB in steps of four. Fewer of the large buffers are kept
+	// so an idle bridge holds at most ~24 MB.
+	const int kSizeClassCount = 7;
+	const uint8_t kUnpooled = 0xff;
+	const std::size_t kClassCapacities[kSizeClassCount] = {512, 2048, 8192, 32768, 131072, 524288, 2097152};
+	const std::size_t kClassRetained[kSizeClassCount] = {256, 256, 128, 64, 32, 16, 8};
+
+	typedef boost::lockfree::stack<MessageBuffer *> TFreeList;
+
+	// Built on first use so buffers can be taken during static initialisation
+	TFreeList &FreeList(const uint8_t &inSizeClass)
+	{
+		static TFreeList *sFreeLists[kSizeClassCount] =
+		{
+			new TFreeList(kClassRetained[0]), new TFreeList(kClassRetained[1]), new TFreeList(kClassRetained[2]),
+			new TFreeList(kClassRetained[3]), new TFreeList(kClassRetained[4]), new TFreeList(kClassRetained[5]),
+			new TFreeList(kClassRetained[6])
+		};
+		return *sFreeLists[inSizeClass];
+	}
+
+	uint8_t SizeClass(const std::size_t &inCapacity)
+	{
+		for (uint8_t i = 0; i < kSizeClassCount; i++)
+		{
+			if (inCapacity <= kClassCapacities[i])
+			{
+				return i;
+			}
+		}
+		return kUnpooled;
+	}
+}
+
+TMessageBufferPtr BufferPool::Acquire(const std::size_t &inCapacity)
+{
+	uint8_t aSizeClass = SizeClass(inCapacity);
+	MessageBuffer *aBuffer = NULL;
+	if (aSizeClass != kUnpooled && FreeList(aSizeClass).pop(aBuffer))
+	{
+		MetricsRegistry::Add(MetricsRegistry::kBufferPoolHits);
+		aBuffer->fSize = 0;
+		aBuffer->fFormat = MessageBuffer::kFormatText;
+		return TMessageBufferPtr(aBuffer);
+	}
+	MetricsRegistry::Add(MetricsRegistry::kBufferPoolMisses);
+
+	// Header and data in one allocation, through operator new so that
+	// AllocAccounting sees pool misses
+	std::size_t aCapacity = (aSizeClass == kUnpooled ? inCapacity : kClassCapacities[aSizeClass]);
+	void *aMemory = ::operator new(sizeof(MessageBuffer) + aCapacity);
+	char *aData = static_cast<char *>(aMemory) + sizeof(MessageBuffer);
+	aBuffer = new (aMemory) MessageBuffer(aData, aCapacity, aSizeClass);
+	return TMessageBufferPtr(aBuffer);
+}
+
+TMessageBufferPtr BufferPool::Copy(const char *inData, const std::size_t &inSize)
+{
+	TMessageBufferPtr aBuffer = Acquire(inSize);
+	memcpy(aBuffer->Data(), inData, inSize);
+	aBuffer->Resize(inSize);
+	return aBuffer;
+}
+
+void BufferPool::Grow(TMessageBufferPtr &ioBuffer, const std::size_t &inCapacity)
+{
+	if (ioBuffer->Capacity() >= inCapacity)
+	{
+		return;
+	}
+	TMessageBufferPtr aLarger = Acquire(inCapacity);
+	memcpy(aLarger->Data(), ioBuffer->Data(), ioBuffer->Size());
+	aLarger->Resize(ioBuffer->Size());
+	aLarger->fFormat = ioBuffer->fFormat;
+	ioBuffer.swap(aLarger);
+}
+
+void BufferPool::Release(MessageBuffer *inBuffer)
+{
+	// A full free list frees rather than allocating another node
+	if (inBuffer->fSizeClass != kUnpooled && FreeList(inBuffer->fSizeClass).bounded_push(inBuffer))
+	{
+		return;
+	}
+	inBuffer->~MessageBuffer();
+	::operator delete(inBuffer);
+}
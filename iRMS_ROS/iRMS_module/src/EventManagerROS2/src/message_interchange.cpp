@@ -1,7 +1,21 @@
 #include "message_interchange.hpp"
+#include "alloc_accounting.hpp"
+#include "async_logger.hpp"
+#include "tracepoints.hpp"
+#include <cstring>
 #include <iostream>
 
-MessageInterchange::MessageInterchange()
+const MessageInterchange::TQueueMetrics MessageInterchange::kToRosMetrics = {MetricsRegistry::kToRosPushed, MetricsRegistry::kToRosPopped, MetricsRegistry::kToRosDropped, MetricsRegistry::kToRosCoalesced, 0};
+const MessageInterchange::TQueueMetrics MessageInterchange::kFromRosMetrics = {MetricsRegistry::kFromRosPushed, MetricsRegistry::kFromRosPopped, MetricsRegistry::kFromRosDropped, MetricsRegistry::kFromRosCoalesced, 1};
+const MessageInterchange::TLaneMetrics MessageInterchange::kLaneMetrics[kLaneCount] =
+{
+    {MetricsRegistry::kControlLanePopped, MetricsRegistry::kControlLaneWaitNanoseconds},
+    {MetricsRegistry::kMissionLanePopped, MetricsRegistry::kMissionLaneWaitNanoseconds},
+    {MetricsRegistry::kBulkLanePopped, MetricsRegistry::kBulkLaneWaitNanoseconds}
+};
+const char *const MessageInterchange::kLaneNames[kLaneCount] = {"control", "mission", "bulk"};
+
+MessageInterchange::MessageInterchange() : fTrafficCapture(NULL)
 {
 }
 	
@@ -9,31 +23,341 @@ MessageInterchange::~MessageInterchange()
 {	
 }
 
+void MessageInterchange::SetDirectHandlerForROS(TMessageHandler inHandler)
+{
+    fRosHandler = inHandler;
+}
+
+void MessageInterchange::SetDirectHandlerForEA(TMessageHandler inHandler)
+{
+    fEAHandler = inHandler;
+}
+
+bool MessageInterchange::OpenShared(const std::string &inName, const std::size_t &inCapacity)
+{
+    bool aOpened = fFromRos.ring.Attach(inName + "-from-ros", inCapacity);
+    for (int i = 0; aOpened && i < kLaneCount; i++)
+    {
+        aOpened = fToRos[i].ring.Attach(inName + "-to-ros-" + kLaneNames[i], inCapacity);
+    }
+    if (!aOpened)
+    {
+        fFromRos.ring.Close();
+        for (int i = 0; i < kLaneCount; i++)
+        {
+            fToRos[i].ring.Close();
+        }
+    }
+    return aOpened;
+}
+
+bool MessageInterchange::Send(TChannel &ioChannel, const TQueueMetrics &inMetrics, TMessageHandler &inHandler, const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey)
+{
+    if (!inMessage || inMessage->Empty())
+    {
+        return true;
+    }
+    inTrace.Mark(LatencyTracer::kStageEnqueued);
+    EM_TRACE3(enqueue, inTrace.id, inMetrics.queue, inMessage->Size());
+    if (inHandler)
+    {
+        MetricsRegistry::Add(inMetrics.pushed);
+        MetricsRegistry::Add(inMetrics.popped);
+        inTrace.stamps[LatencyTracer::kStageDequeued] = inTrace.stamps[LatencyTracer::kStageEnqueued];
+        EM_TRACE4(dequeue, inTrace.id, inMetrics.queue, inMessage->Size(), 0);
+        inHandler(inMessage, inTrace);
+        return true;
+    }
+    EM_ALLOC_STAGE(AllocAccounting::kAllocInterchange);
+    if (ioChannel.ring.IsOpen())
+    {
+        if (!SendShared(ioChannel.ring, inMessage, inTrace))
+        {
+            MetricsRegistry::Add(inMetrics.dropped);
+            return false;
+        }
+        MetricsRegistry::Add(inMetrics.pushed);
+        return true;
+    }
+    if (inKey)
+    {
+        return SendKeyed(ioChannel, inMetrics, inMessage, inTrace, inKey);
+    }
+    TQueuedMessage aQueued;
+    aQueued.message = inMessage;
+    aQueued.trace = inTrace;
+    aQueued.slot = -1;
+    if (!ioChannel.queue.push(aQueued))
+    {
+        MetricsRegistry::Add(inMetrics.dropped);
+        return false;
+    }
+    ioChannel.tail_slot = -1;
+    MetricsRegistry::Add(inMetrics.pushed);
+    return true;
+}
+
+bool MessageInterchange::SendKeyed(TChannel &ioChannel, const TQueueMetrics &inMetrics, const TMessageBufferPtr &inMessage, const LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey)
+{
+    boost::lock_guard<boost::mutex> aLock(ioChannel.coalescing_mutex);
+    // Only the last message queued can be superseded, replacing one further
+    // up would deliver this one ahead of the messages queued after it. A
+    // slot the consumer has already taken is free again.
+    if (ioChannel.tail_slot >= 0 && ioChannel.slots[ioChannel.tail_slot].key == inKey)
+    {
+        TCoalescingSlot &aSlot = ioChannel.slots[ioChannel.tail_slot];
+        aSlot.message = inMessage;
+        aSlot.trace = inTrace;
+        MetricsRegistry::Add(inMetrics.coalesced);
+        return true;
+    }
+    int aFree = -1;
+    for (int i = 0; i < kMaxQueueLength && aFree < 0; i++)
+    {
+        if (!ioChannel.slots[i].key)
+        {
+            aFree = i;
+        }
+    }
+    TQueuedMessage aQueued;
+    aQueued.slot = aFree;
+    if (aFree < 0 || !ioChannel.queue.push(aQueued))
+    {
+        MetricsRegistry::Add(inMetrics.dropped);
+        return false;
+    }
+    TCoalescingSlot &aSlot = ioChannel.slots[aFree];
+    aSlot.key = inKey;
+    aSlot.message = inMessage;
+    aSlot.trace = inTrace;
+    ioChannel.tail_slot = aFree;
+    MetricsRegistry::Add(inMetrics.pushed);
+    return true;
+}
+
+bool MessageInterchange::GetNext(TChannel &ioChannel, const TQueueMetrics &inMetrics, TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    EM_ALLOC_STAGE(AllocAccounting::kAllocInterchange);
+    if (ioChannel.ring.IsOpen())
+    {
+        if (!GetNextShared(ioChannel.ring, outMessage, outTrace))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        TQueuedMessage aQueued;
+        if (!ioChannel.queue.pop(aQueued))
+        {
+            return false;
+        }
+        if (aQueued.slot >= 0)
+        {
+            boost::lock_guard<boost::mutex> aLock(ioChannel.coalescing_mutex);
+            TCoalescingSlot &aSlot = ioChannel.slots[aQueued.slot];
+            aQueued.message.swap(aSlot.message);
+            aQueued.trace = aSlot.trace;
+            aSlot.key = 0;
+        }
+        outMessage.swap(aQueued.message);
+        outTrace = aQueued.trace;
+    }
+    MetricsRegistry::Add(inMetrics.popped);
+    outTrace.Mark(LatencyTracer::kStageDequeued);
+    EM_TRACE4(dequeue, outTrace.id, inMetrics.queue, outMessage->Size(), outTrace.stamps[LatencyTracer::kStageDequeued] - outTrace.stamps[LatencyTracer::kStageEnqueued]);
+    return true;
+}
+
+// Shared records carry the trace as it is laid out here
+static_assert(sizeof(LatencyTracer::TMessageTrace) == 8 * (LatencyTracer::kStageCount + 2), "the trace changed, bump kRingVersion in shm_ring.cpp");
+
+bool MessageInterchange::SendShared(ShmRing &inRing, const TMessageBufferPtr &inMessage, const LatencyTracer::TMessageTrace &inTrace)
+{
+    if (inMessage->Size() > EAFrame::kMaxLength - sizeof(inTrace))
+    {
+        return false;
+    }
+    EAFrame::THeader aHeader;
+    aHeader.type = (inMessage->Format() == MessageBuffer::kFormatProtobuf ? EAFrame::kFrameProtobuf : EAFrame::kFrameXml);
+    aHeader.length = static_cast<uint32_t>(sizeof(inTrace) + inMessage->Size());
+    aHeader.sequence = inRing.WrittenSequence() + 1;
+    return inRing.Write(aHeader, &inTrace, sizeof(inTrace), inMessage->Data());
+}
+
+bool MessageInterchange::PeekEnqueued(TChannel &ioChannel, uint64_t &outEnqueued)
+{
+    if (ioChannel.ring.IsOpen())
+    {
+        EAFrame::THeader aHeader;
+        char *aPayload = NULL;
+        LatencyTracer::TMessageTrace aTrace;
+        ShmRing::TPeekResult aResult = ioChannel.ring.Peek(aHeader, aPayload);
+        if (aResult == ShmRing::kPeekCorrupt)
+        {
+            EM_LOG(AsyncLogger::kLogInterchange, AsyncLogger::kLogError, "Shared memory interchange held an invalid record, its contents were dropped");
+        }
+        if (aResult != ShmRing::kPeekFrame || aHeader.length < sizeof(aTrace))
+        {
+            // GetNextShared skips a record too short to hold a trace
+            return aResult == ShmRing::kPeekFrame;
+        }
+        memcpy(&aTrace, aPayload, sizeof(aTrace));
+        outEnqueued = aTrace.stamps[LatencyTracer::kStageEnqueued];
+        return true;
+    }
+    if (!ioChannel.queue.read_available())
+    {
+        return false;
+    }
+    const TQueuedMessage &aQueued = ioChannel.queue.front();
+    if (aQueued.slot >= 0)
+    {
+        boost::lock_guard<boost::mutex> aLock(ioChannel.coalescing_mutex);
+        outEnqueued = ioChannel.slots[aQueued.slot].trace.stamps[LatencyTracer::kStageEnqueued];
+        return true;
+    }
+    outEnqueued = aQueued.trace.stamps[LatencyTracer::kStageEnqueued];
+    return true;
+}
+
+bool MessageInterchange::GetNextShared(ShmRing &inRing, TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    for (;;)
+    {
+        EAFrame::THeader aHeader;
+        char *aPayload = NULL;
+        ShmRing::TPeekResult aResult = inRing.Peek(aHeader, aPayload);
+        if (aResult == ShmRing::kPeekEmpty)
+        {
+            return false;
+        }
+        if (aResult == ShmRing::kPeekCorrupt)
+        {
+            EM_LOG(AsyncLogger::kLogInterchange, AsyncLogger::kLogError, "Shared memory interchange held an invalid record, its contents were dropped");
+            continue;
+        }
+        // A gap means records were dropped as corrupt, not that the ring overflowed
+        uint32_t aExpected = inRing.ConsumedSequence() + 1;
+        if (aHeader.sequence != aExpected)
+        {
+            MetricsRegistry::Add(MetricsRegistry::kInterchangeGaps, aHeader.sequence - aExpected);
+            EM_LOG(AsyncLogger::kLogInterchange, AsyncLogger::kLogWarn, "Shared memory interchange skipped from {} to {}", aExpected, aHeader.sequence);
+        }
+        if (aHeader.length < sizeof(outTrace))
+        {
+            inRing.Consume();
+            continue;
+        }
+        memcpy(&outTrace, aPayload, sizeof(outTrace));
+        outMessage = BufferPool::Copy(aPayload + sizeof(outTrace), aHeader.length - sizeof(outTrace));
+        outMessage->SetFormat(aHeader.type == EAFrame::kFrameProtobuf ? MessageBuffer::kFormatProtobuf : MessageBuffer::kFormatText);
+        inRing.Consume();
+        return true;
+    }
+}
+
 bool MessageInterchange::SendMessageToROS(const std::string &inMessage)
 {
     if (inMessage.empty())
     {
         return true;
     }
-    return fToRosQueue.push(inMessage);
+    LatencyTracer::TMessageTrace aTrace;
+    return SendMessageToROS(BufferPool::Copy(inMessage), aTrace);
 }
 
-bool MessageInterchange::SendMessageToEA(const std::string &inMessage)
+bool MessageInterchange::SendMessageToEA(const std::string &inMessage, const uint64_t &inKey)
 {
     if (inMessage.empty())
     {
         return true;
     }
-    return fFromRosQueue.push(inMessage);
+    LatencyTracer::TMessageTrace aTrace;
+    return SendMessageToEA(BufferPool::Copy(inMessage), aTrace, inKey);
 }
 
-bool MessageInterchange::GetNextMessageForROS(std::string &outMessage)
+bool MessageInterchange::SendMessageToROS(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const TLane &inLane, const uint64_t &inKey)
 {
-    return fToRosQueue.pop(outMessage);
+    return Send(fToRos[inLane], kToRosMetrics, fRosHandler, inMessage, inTrace, inKey);
 }
 
-bool MessageInterchange::GetNextMessageForEA(std::string &outMessage)
+bool MessageInterchange::SendMessageToEA(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace, const uint64_t &inKey)
 {
-    return fFromRosQueue.pop(outMessage);
+    if (fTrafficCapture && inMessage && !inMessage->Empty())
+    {
+        fTrafficCapture->Record(TrafficCapture::kRecordToEA, 0, inMessage->Data(), inMessage->Size());
+    }
+    // The ROS side sends from its mission and its control consumer
+    boost::lock_guard<boost::mutex> aLock(fFromRosProducerMutex);
+    return Send(fFromRos, kFromRosMetrics, fEAHandler, inMessage, inTrace, inKey);
+}
+
+bool MessageInterchange::GetNextMessageForROS(TMessageBufferPtr &outMessage)
+{
+    LatencyTracer::TMessageTrace aTrace;
+    return GetNextMessageForROS(outMessage, aTrace);
 }
 
+bool MessageInterchange::GetNextMessageForEA(TMessageBufferPtr &outMessage)
+{
+    LatencyTracer::TMessageTrace aTrace;
+    return GetNext(fFromRos, kFromRosMetrics, outMessage, aTrace);
+}
+
+bool MessageInterchange::GetNextMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    return GetNextControlMessageForROS(outMessage, outTrace) || GetNextMissionMessageForROS(outMessage, outTrace);
+}
+
+bool MessageInterchange::GetNextControlMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    if (!GetNext(fToRos[kLaneControl], kToRosMetrics, outMessage, outTrace))
+    {
+        return false;
+    }
+    CountLaneWait(kLaneControl, outTrace);
+    return true;
+}
+
+bool MessageInterchange::GetNextMissionMessageForROS(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    // Mission and bulk leave in the order they arrived: a map load clears the
+    // point lists, so later mission messages must not overtake it. Mission is
+    // peeked first so that a map load queued before the mission message seen
+    // is seen too.
+    TLane aLane;
+    uint64_t aMissionEnqueued = 0;
+    uint64_t aBulkEnqueued = 0;
+    bool aHasMission = PeekEnqueued(fToRos[kLaneMission], aMissionEnqueued);
+    bool aHasBulk = PeekEnqueued(fToRos[kLaneBulk], aBulkEnqueued);
+    if (aHasMission && (!aHasBulk || aMissionEnqueued < aBulkEnqueued))
+    {
+        aLane = kLaneMission;
+    }
+    else if (aHasBulk)
+    {
+        aLane = kLaneBulk;
+    }
+    else
+    {
+        return false;
+    }
+    if (!GetNext(fToRos[aLane], kToRosMetrics, outMessage, outTrace))
+    {
+        return false;
+    }
+    CountLaneWait(aLane, outTrace);
+    return true;
+}
+
+void MessageInterchange::CountLaneWait(const TLane &inLane, const LatencyTracer::TMessageTrace &inTrace)
+{
+    MetricsRegistry::Add(kLaneMetrics[inLane].popped);
+    MetricsRegistry::Add(kLaneMetrics[inLane].wait_ns, inTrace.stamps[LatencyTracer::kStageDequeued] - inTrace.stamps[LatencyTracer::kStageEnqueued]);
+}
+
+bool MessageInterchange::GetNextMessageForEA(TMessageBufferPtr &outMessage, LatencyTracer::TMessageTrace &outTrace)
+{
+    return GetNext(fFromRos, kFromRosMetrics, outMessage, outTrace);
+}
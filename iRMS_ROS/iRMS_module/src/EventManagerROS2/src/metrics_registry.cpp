@@ -0,0 +1,160 @@
+/*
+ * metrics_registry.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "metrics_registry.hpp"
+#include "alloc_accounting.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+namespace
+{
+	typedef struct SDescriptor
+	{
+		const char *family;		// HELP and TYPE are written once per family
+		const char *sample;
+		const char *labels;
+		const char *type;
+		const char *help;
+		double scale;
+	} TDescriptor;
+
+	const TDescriptor kDescriptors[] =
+	{
+		{"ea_bridge_frames_received_total", "ea_bridge_frames_received_total", "", "counter", "Complete robot frames read from EA.", 1},
+		{"ea_bridge_bytes_total", "ea_bridge_bytes_total", "{direction=\"received\"}", "counter", "Bytes exchanged with EA sessions.", 1},
+		{"ea_bridge_bytes_total", "ea_bridge_bytes_total", "{direction=\"sent\"}", "counter", "", 1},
+		{"ea_bridge_queue_pushed_total", "ea_bridge_queue_pushed_total", "{queue=\"to_ros\"}", "counter", "Messages handed to the interchange.", 1},
+		{"ea_bridge_queue_pushed_total", "ea_bridge_queue_pushed_total", "{queue=\"from_ros\"}", "counter", "", 1},
+		{"ea_bridge_queue_popped_total", "ea_bridge_queue_popped_total", "{queue=\"to_ros\"}", "counter", "Messages taken from the interchange.", 1},
+		{"ea_bridge_queue_popped_total", "ea_bridge_queue_popped_total", "{queue=\"from_ros\"}", "counter", "", 1},
+		{"ea_bridge_queue_dropped_total", "ea_bridge_queue_dropped_total", "{queue=\"to_ros\"}", "counter", "Messages lost because the interchange queue was full.", 1},
+		{"ea_bridge_queue_dropped_total", "ea_bridge_queue_dropped_total", "{queue=\"from_ros\"}", "counter", "", 1},
+		{"ea_bridge_queue_coalesced_total", "ea_bridge_queue_coalesced_total", "{queue=\"to_ros\"}", "counter", "Queued messages replaced by a newer one with the same key.", 1},
+		{"ea_bridge_queue_coalesced_total", "ea_bridge_queue_coalesced_total", "{queue=\"from_ros\"}", "counter", "", 1},
+		{"ea_bridge_parse_errors_total", "ea_bridge_parse_errors_total", "{format=\"xml\"}", "counter", "Messages that could not be parsed.", 1},
+		{"ea_bridge_parse_errors_total", "ea_bridge_parse_errors_total", "{format=\"json\"}", "counter", "", 1},
+		{"ea_bridge_parse_errors_total", "ea_bridge_parse_errors_total", "{format=\"protobuf\"}", "counter", "", 1},
+		{"ea_bridge_goals_sent_total", "ea_bridge_goals_sent_total", "", "counter", "follow_waypoints goals dispatched.", 1},
+		{"ea_bridge_goal_cancels_total", "ea_bridge_goal_cancels_total", "", "counter", "Stop commands sent to the follow_waypoints server as a cancel.", 1},
+		{"ea_bridge_map_conversion_seconds", "ea_bridge_map_conversion_seconds_count", "", "summary", "Time spent converting EA maps for nav2.", 1},
+		{"ea_bridge_map_conversion_seconds", "ea_bridge_map_conversion_seconds_sum", "", "summary", "", 1e-9},
+		{"ea_bridge_message_buffers_total", "ea_bridge_message_buffers_total", "{source=\"pool\"}", "counter", "Message buffers acquired, from the pool or newly allocated.", 1},
+		{"ea_bridge_message_buffers_total", "ea_bridge_message_buffers_total", "{source=\"allocated\"}", "counter", "", 1},
+		{"ea_bridge_framing_errors_total", "ea_bridge_framing_errors_total", "", "counter", "EA sessions closed because a frame header was invalid.", 1},
+		{"ea_bridge_frame_sequence_gaps_total", "ea_bridge_frame_sequence_gaps_total", "", "counter", "Frames from EA whose sequence number did not follow the previous frame's.", 1},
+		{"ea_bridge_held_writes_dropped_total", "ea_bridge_held_writes_dropped_total", "", "counter", "Messages to EA dropped while waiting for a new session to show its framing.", 1},
+		{"ea_bridge_interchange_lost_total", "ea_bridge_interchange_lost_total", "", "counter", "Messages missing from the shared memory interchange, by sequence number.", 1},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_count", "{lane=\"control\"}", "summary", "Time messages to ROS waited in their interchange lane.", 1},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_sum", "{lane=\"control\"}", "summary", "", 1e-9},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_count", "{lane=\"mission\"}", "summary", "", 1},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_sum", "{lane=\"mission\"}", "summary", "", 1e-9},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_count", "{lane=\"bulk\"}", "summary", "", 1},
+		{"ea_bridge_lane_wait_seconds", "ea_bridge_lane_wait_seconds_sum", "{lane=\"bulk\"}", "summary", "", 1e-9},
+		{"ea_bridge_commands_expired_total", "ea_bridge_commands_expired_total", "", "counter", "Commands from EA not acted on because their deadline passed before they were dispatched.", 1},
+		{"ea_bridge_commands_expired_late_seconds_total", "ea_bridge_commands_expired_late_seconds_total", "", "counter", "How far past their deadline expired commands were dequeued.", 1e-9},
+		{"ea_bridge_write_seconds", "ea_bridge_write_seconds_count", "", "summary", "Time messages to EA took from being queued on a session to being written.", 1},
+		{"ea_bridge_write_seconds", "ea_bridge_write_seconds_sum", "", "summary", "", 1e-9}
+	};
+
+	static_assert(sizeof(kDescriptors) / sizeof(kDescriptors[0]) == MetricsRegistry::kCounterCount, "every counter needs a descriptor");
+}
+
+thread_local MetricsRegistry::TShard *MetricsRegistry::tShard = NULL;
+std::atomic<MetricsRegistry::TShard *> MetricsRegistry::sShards(NULL);
+
+MetricsRegistry::TShard *MetricsRegistry::RegisterShard()
+{
+	// Shards outlive their threads so that totals never go backwards
+	void *aMemory = NULL;
+	std::size_t aSize = (sizeof(TShard) + kCacheLineSize - 1) / kCacheLineSize * kCacheLineSize;
+	if (posix_memalign(&aMemory, kCacheLineSize, aSize) != 0)
+	{
+		throw std::bad_alloc();
+	}
+	TShard *aShard = new (aMemory) TShard();
+	for (int i = 0; i < kCounterCount; i++)
+	{
+		aShard->values[i].store(0, std::memory_order_relaxed);
+	}
+	aShard->next = sShards.load(std::memory_order_relaxed);
+	while (!sShards.compare_exchange_weak(aShard->next, aShard, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+	tShard = aShard;
+	return aShard;
+}
+
+uint64_t MetricsRegistry::Total(const TCounter &inCounter)
+{
+	uint64_t aTotal = 0;
+	for (TShard *aShard = sShards.load(std::memory_order_acquire); aShard; aShard = aShard->next)
+	{
+		aTotal += aShard->values[inCounter].load(std::memory_order_relaxed);
+	}
+	return aTotal;
+}
+
+void MetricsRegistry::WritePrometheus(std::string &outText)
+{
+	uint64_t aTotals[kCounterCount];
+	for (int i = 0; i < kCounterCount; i++)
+	{
+		aTotals[i] = Total(static_cast<TCounter>(i));
+	}
+
+	std::stringstream ss;
+	ss.precision(9);
+	const char *aFamily = "";
+	for (int i = 0; i < kCounterCount; i++)
+	{
+		const TDescriptor &aDescriptor = kDescriptors[i];
+		if (std::string(aFamily) != aDescriptor.family)
+		{
+			aFamily = aDescriptor.family;
+			ss << "# HELP " << aDescriptor.family << " " << aDescriptor.help << "\n"
+			   << "# TYPE " << aDescriptor.family << " " << aDescriptor.type << "\n";
+		}
+		ss << aDescriptor.sample << aDescriptor.labels << " ";
+		if (aDescriptor.scale != 1)
+		{
+			ss << std::fixed << aTotals[i] * aDescriptor.scale << std::defaultfloat;
+		}
+		else
+		{
+			ss << aTotals[i];
+		}
+		ss << "\n";
+	}
+
+	// Queue depth is derived rather than counted so that the queues
+	// themselves are never touched by a scrape
+	ss << "# HELP ea_bridge_queue_depth Messages waiting in the interchange.\n"
+	   << "# TYPE ea_bridge_queue_depth gauge\n"
+	   << "ea_bridge_queue_depth{queue=\"to_ros\"} " << (aTotals[kToRosPushed] >= aTotals[kToRosPopped] ? aTotals[kToRosPushed] - aTotals[kToRosPopped] : 0) << "\n"
+	   << "ea_bridge_queue_depth{queue=\"from_ros\"} " << (aTotals[kFromRosPushed] >= aTotals[kFromRosPopped] ? aTotals[kFromRosPushed] - aTotals[kFromRosPopped] : 0) << "\n";
+
+	if (AllocAccounting::Enabled())
+	{
+		AllocAccounting::TAllocCounts aCounts;
+		AllocAccounting::Snapshot(aCounts);
+		ss << "# HELP ea_bridge_allocations_total Heap allocations by message path stage.\n"
+		   << "# TYPE ea_bridge_allocations_total counter\n";
+		for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+		{
+			ss << "ea_bridge_allocations_total{stage=\"" << AllocAccounting::StageName(static_cast<AllocAccounting::TAllocStage>(i)) << "\"} " << aCounts.allocations[i] << "\n";
+		}
+		ss << "# HELP ea_bridge_allocated_bytes_total Heap bytes allocated by message path stage.\n"
+		   << "# TYPE ea_bridge_allocated_bytes_total counter\n";
+		for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+		{
+			ss << "ea_bridge_allocated_bytes_total{stage=\"" << AllocAccounting::StageName(static_cast<AllocAccounting::TAllocStage>(i)) << "\"} " << aCounts.bytes[i] << "\n";
+		}
+	}
+	outText = ss.str();
+}
@@ -0,0 +1,144 @@
+/*
+ * metrics_server.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "metrics_server.hpp"
+#include "metrics_registry.hpp"
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+namespace
+{
+	namespace http = boost::beast::http;
+
+	// A client that connects and stays silent is dropped after this long
+	const std::chrono::seconds kSessionTimeout(5);
+
+	// One scrape: read a request, answer it, close
+	class MetricsSession : public std::enable_shared_from_this<MetricsSession>
+	{
+	public:
+		MetricsSession(boost::asio::ip::tcp::socket inSocket) : fStream(std::move(inSocket))
+		{
+		}
+
+		void Start()
+		{
+			auto self(shared_from_this());
+			fStream.expires_after(kSessionTimeout);
+			http::async_read(fStream, fBuffer, fRequest,
+				[this, self](boost::system::error_code ec, std::size_t)
+				{
+					if (!ec)
+					{
+						Respond();
+					}
+				});
+		}
+	private:
+		void Respond()
+		{
+			fResponse.version(fRequest.version());
+			fResponse.keep_alive(false);
+			if (fRequest.method() != http::verb::get)
+			{
+				fResponse.result(http::status::method_not_allowed);
+			}
+			else if (fRequest.target() != "/metrics")
+			{
+				fResponse.result(http::status::not_found);
+			}
+			else
+			{
+				fResponse.result(http::status::ok);
+				fResponse.set(http::field::content_type, "text/plain; version=0.0.4");
+				MetricsRegistry::WritePrometheus(fResponse.body());
+			}
+			fResponse.prepare_payload();
+
+			auto self(shared_from_this());
+			fStream.expires_after(kSessionTimeout);
+			http::async_write(fStream, fResponse,
+				[this, self](boost::system::error_code ec, std::size_t)
+				{
+					fStream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+				});
+		}
+
+		boost::beast::tcp_stream fStream;
+		boost::beast::flat_buffer fBuffer;
+		http::request<http::empty_body> fRequest;
+		http::response<http::string_body> fResponse;
+	};
+}
+
+MetricsServer::MetricsServer(const std::string &inAddress, const uint16_t &inPort) : fAddress(inAddress), fPort(inPort), fAcceptor(fIoContext)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+	Stop();
+}
+
+bool MetricsServer::Start()
+{
+	boost::system::error_code ec;
+	boost::asio::ip::tcp::endpoint aEndpoint(boost::asio::ip::make_address(fAddress, ec), fPort);
+	if (!ec)
+	{
+		fAcceptor.open(aEndpoint.protocol(), ec);
+	}
+	if (!ec)
+	{
+		fAcceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec);
+		fAcceptor.bind(aEndpoint, ec);
+	}
+	if (!ec)
+	{
+		fAcceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+	}
+	if (ec)
+	{
+		std::cerr << "Metrics endpoint " << fAddress << ":" << fPort << " unavailable: " << ec.message() << std::endl;
+		return false;
+	}
+	std::cout << "Serving metrics on http://" << fAddress << ":" << fPort << "/metrics" << std::endl;
+	DoAccept();
+	fThread = boost::shared_ptr<boost::thread>(new boost::thread([this] { fIoContext.run(); }));
+	return true;
+}
+
+void MetricsServer::Stop()
+{
+	fIoContext.stop();
+	if (fThread)
+	{
+		fThread->join();
+		fThread.reset();
+	}
+}
+
+void MetricsServer::DoAccept()
+{
+	fAcceptor.async_accept(
+		[this](boost::system::error_code ec, boost::asio::ip::tcp::socket socket)
+		{
+			if (ec == boost::asio::error::operation_aborted)
+			{
+				return;
+			}
+			if (!ec)
+			{
+				std::make_shared<MetricsSession>(std::move(socket))->Start();
+			}
+			DoAccept();
+		});
+}
@@ -0,0 +1,169 @@
+/*
+ * path_simplifier.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "path_simplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace
+{
+	// Bounds on what one point list may grow to, whatever EA sends
+	const size_t kMaxPiecesPerLeg = 1000;
+	const size_t kMaxDensifiedPoints = 100000;
+
+	// Distance from P to the segment AB (not the infinite line, so paths that
+	// double back on themselves are not collapsed)
+	double_t SegmentDistance(const TWayPoint &inP, const TWayPoint &inA, const TWayPoint &inB)
+	{
+		double_t dx = inB.x - inA.x;
+		double_t dy = inB.y - inA.y;
+		double_t aLengthSq = dx * dx + dy * dy;
+		if (aLengthSq <= 0)
+		{
+			return hypot(inP.x - inA.x, inP.y - inA.y);
+		}
+		double_t s = ((inP.x - inA.x) * dx + (inP.y - inA.y) * dy) / aLengthSq;
+		s = std::max(0.0, std::min(1.0, s));
+		return hypot(inP.x - (inA.x + s * dx), inP.y - (inA.y + s * dy));
+	}
+}
+
+PathSimplifier::PathSimplifier() : fTolerance(0.05), fMaxSpacing(0)
+{
+}
+
+PathSimplifier::~PathSimplifier()
+{
+}
+
+void PathSimplifier::Process(const TPointList &inPointList, TPointList &outPointList) const
+{
+	TPointList aSimplified;
+	Simplify(inPointList, aSimplified);
+	Densify(aSimplified, outPointList);
+}
+
+bool PathSimplifier::IsAnchor(const TPointList &inPointList, const size_t &inIndex) const
+{
+	if (inIndex == 0 || inIndex + 1 == inPointList.size())
+	{
+		return true;
+	}
+	const TWayPoint &aPoint = inPointList[inIndex];
+	const TWayPoint &aPrev = inPointList[inIndex - 1];
+	return (aPoint.t > 0 || aPoint.v != aPrev.v || aPoint.a != aPrev.a);
+}
+
+void PathSimplifier::Simplify(const TPointList &inPointList, TPointList &outPointList) const
+{
+	outPointList.clear();
+	if (fTolerance <= 0 || inPointList.size() < 3)
+	{
+		outPointList = inPointList;
+		return;
+	}
+
+	std::vector<bool> aKeep(inPointList.size(), false);
+	size_t aFirst = 0;
+	aKeep[0] = true;
+	for (size_t i = 1; i < inPointList.size(); i++)
+	{
+		if (IsAnchor(inPointList, i))
+		{
+			aKeep[i] = true;
+			SimplifyRange(inPointList, aFirst, i, aKeep);
+			aFirst = i;
+		}
+	}
+
+	outPointList.reserve(std::count(aKeep.begin(), aKeep.end(), true));
+	for (size_t i = 0; i < inPointList.size(); i++)
+	{
+		if (aKeep[i])
+		{
+			outPointList.push_back(inPointList[i]);
+		}
+	}
+}
+
+void PathSimplifier::SimplifyRange(const TPointList &inPointList, const size_t &inFirst, const size_t &inLast, std::vector<bool> &outKeep) const
+{
+	// Explicit stack, EA point lists can be long enough to make recursion risky
+	std::vector<std::pair<size_t, size_t> > aStack;
+	aStack.push_back(std::make_pair(inFirst, inLast));
+	while (!aStack.empty())
+	{
+		size_t aFirst = aStack.back().first;
+		size_t aLast = aStack.back().second;
+		aStack.pop_back();
+		if (aLast <= aFirst + 1)
+		{
+			continue;
+		}
+
+		double_t aMaxDistance = 0;
+		size_t aMaxIndex = aFirst;
+		for (size_t i = aFirst + 1; i < aLast; i++)
+		{
+			double_t aDistance = SegmentDistance(inPointList[i], inPointList[aFirst], inPointList[aLast]);
+			if (aDistance > aMaxDistance)
+			{
+				aMaxDistance = aDistance;
+				aMaxIndex = i;
+			}
+		}
+		if (aMaxDistance > fTolerance)
+		{
+			outKeep[aMaxIndex] = true;
+			aStack.push_back(std::make_pair(aFirst, aMaxIndex));
+			aStack.push_back(std::make_pair(aMaxIndex, aLast));
+		}
+	}
+}
+
+void PathSimplifier::Densify(const TPointList &inPointList, TPointList &outPointList) const
+{
+	outPointList.clear();
+	if (fMaxSpacing <= 0 || inPointList.size() < 2)
+	{
+		outPointList = inPointList;
+		return;
+	}
+
+	outPointList.reserve(inPointList.size());
+	outPointList.push_back(inPointList.front());
+	for (size_t i = 1; i < inPointList.size(); i++)
+	{
+		const TWayPoint &aFrom = inPointList[i - 1];
+		const TWayPoint &aTo = inPointList[i];
+		// A leg that is not finite or would take more than the budget left is
+		// kept as it is; a point list with such points should have been
+		// rejected before it got here
+		double_t aPiecesWanted = ceil(hypot(aTo.x - aFrom.x, aTo.y - aFrom.y) / fMaxSpacing);
+		size_t aBudget = kMaxDensifiedPoints - std::min(kMaxDensifiedPoints, outPointList.size() + inPointList.size() - i);
+		size_t aPieces = 1;
+		if (std::isfinite(aPiecesWanted) && aPiecesWanted > 1)
+		{
+			aPieces = static_cast<size_t>(std::min(aPiecesWanted, static_cast<double_t>(std::min(kMaxPiecesPerLeg, aBudget + 1))));
+		}
+		for (size_t j = 1; j < aPieces; j++)
+		{
+			double_t s = static_cast<double_t>(j) / aPieces;
+			TWayPoint aPoint;
+			aPoint.x = aFrom.x + s * (aTo.x - aFrom.x);
+			aPoint.y = aFrom.y + s * (aTo.y - aFrom.y);
+			// Inserted points travel like the leg they belong to, only the
+			// original point keeps its arrival time
+			aPoint.v = aTo.v;
+			aPoint.a = aTo.a;
+			outPointList.push_back(aPoint);
+		}
+		outPointList.push_back(aTo);
+	}
+}
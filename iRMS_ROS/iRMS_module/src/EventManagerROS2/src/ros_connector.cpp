@@ -10,14 +10,117 @@
 #include <boost/json.hpp>
 #include <boost/json/src.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string.hpp>
 #include "nav2_msgs/action/follow_waypoints.hpp"
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include "nav2_util/geometry_utils.hpp"
+#include "metrics_registry.hpp"
+#include "async_logger.hpp"
+#include "alloc_accounting.hpp"
+#include "tracepoints.hpp"
+#include "decode_arena.hpp"
+#include "map_converter.hpp"
+#ifdef EM_PROTOBUF
+#include "robot_commands.pb.h"
+#endif
 #include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <sstream>
 
-RosConnector::RosConnector() : server_timeout_(10), fRunThread(false)
+namespace
+{
+  // point_list_status reason for a point list that waited past its deadline
+  const char *const kExpiredReason = "deadline passed";
+
+  // x, y and the optional v, a and t of a point
+  const size_t kPointFields = 5;
+
+  // One whole field of a point, converted as lexical_cast would but without
+  // a stream or a heap copy
+  double_t ParsePointField(const boost::string_view &inField)
+  {
+    char aField[64];
+    if (inField.empty() || inField.size() >= sizeof(aField))
+    {
+      throw boost::bad_lexical_cast();
+    }
+    memcpy(aField, inField.data(), inField.size());
+    aField[inField.size()] = '\0';
+    char *aEnd = NULL;
+    double_t aValue = strtod(aField, &aEnd);
+    if (aEnd != aField + inField.size())
+    {
+      throw boost::bad_lexical_cast();
+    }
+    return aValue;
+  }
+
+  // Replies are written straight into a pooled buffer, no stream in between
+  void PutText(MessageBufferStream &ioStream, const boost::string_view &inText)
+  {
+    for (boost::string_view::const_iterator aIter = inText.begin(); aIter != inText.end(); aIter++)
+    {
+      ioStream.Put(*aIter);
+    }
+  }
+
+  void PutNumber(MessageBufferStream &ioStream, const uint64_t &inNumber)
+  {
+    char aDigits[24];
+    int aLength = snprintf(aDigits, sizeof(aDigits), "%" PRIu64, inNumber);
+    PutText(ioStream, boost::string_view(aDigits, aLength));
+  }
+
+#ifdef EM_PROTOBUF
+  // A command is built in a protobuf arena whose first block comes from the
+  // decode arena; decoded it is about the size of its packed points
+  google::protobuf::ArenaOptions CommandArenaOptions(const MessageBuffer &inMessage)
+  {
+    google::protobuf::ArenaOptions aOptions;
+    aOptions.initial_block_size = inMessage.Size() * 2 + 1024;
+    aOptions.initial_block = static_cast<char *>(DecodeArena::ForThread().Allocate(aOptions.initial_block_size));
+    return aOptions;
+  }
+
+  // NULL, counted and logged, when the command does not parse
+  ats::base::RobotCommand *DecodeCommand(const MessageBuffer &inMessage, google::protobuf::Arena &inArena)
+  {
+    ats::base::RobotCommand *aCommand = google::protobuf::Arena::CreateMessage<ats::base::RobotCommand>(&inArena);
+    if (!aCommand->ParseFromArray(inMessage.Data(), static_cast<int>(inMessage.Size())))
+    {
+      MetricsRegistry::Add(MetricsRegistry::kProtobufParseErrors);
+      EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Malformed {} byte protobuf command", inMessage.Size());
+      return NULL;
+    }
+    return aCommand;
+  }
+
+  // Protobuf replies are built in an arena whose first block is on the
+  // stack, a status only allocates when it carries many violations
+  class StatusArena
+  {
+  public:
+    StatusArena() : fArena(Options(fBlock, sizeof(fBlock))) {}
+    ats::base::RobotStatus &NewStatus() { return *google::protobuf::Arena::CreateMessage<ats::base::RobotStatus>(&fArena); }
+  private:
+    static google::protobuf::ArenaOptions Options(char *inBlock, const size_t &inSize)
+    {
+      google::protobuf::ArenaOptions aOptions;
+      aOptions.initial_block = inBlock;
+      aOptions.initial_block_size = inSize;
+      return aOptions;
+    }
+
+    char fBlock[1024];
+    google::protobuf::Arena fArena;
+  };
+#endif
+}
+
+RosConnector::RosConnector() : server_timeout_(10), fMessageInterchange(NULL), fZoneIndex(NULL), fLatencyTracer(NULL), fFlightRecorder(NULL), fUseActionClient(false), fReplyFormat(MessageBuffer::kFormatText), fExpired(false), fRunThread(false), fMapWorkGuard(boost::asio::make_work_guard(fMapWorker)), fMapLoadSequence(0)
 {
   auto options = rclcpp::NodeOptions().arguments({"--ros-args --remap __node:=navigation_dialog_action_client"});
   client_node_ = std::make_shared<rclcpp::Node>("_", options);
@@ -30,21 +133,44 @@ RosConnector::RosConnector() : server_timeout_(10), fRunThread(false)
 
 RosConnector::~RosConnector()
 {
+  Stop();
 }
 
-bool RosConnector::Start(MessageInterchange *inMessageInterchange)
+bool RosConnector::Start(MessageInterchange *inMessageInterchange, const bool &inIntegrated)
 {
 
   fMessageInterchange = inMessageInterchange;
+  fMapThread = boost::shared_ptr<boost::thread>(new boost::thread([this] { fMapWorker.run(); }));
 
+  if (inIntegrated)
+  {
+    fMessageInterchange->SetDirectHandlerForROS(boost::bind(&RosConnector::ProcessIncomingMessage, this, boost::placeholders::_1, boost::placeholders::_2));
+    return true;
+  }
+  fRunThread = true;
   fInterchangeThread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&RosConnector::RunInterchangeThread, this)));
+  fControlThread = boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&RosConnector::RunControlThread, this)));
 	return true;
 }
 
 void RosConnector::Stop()
 {
   fRunThread = false;
-  fInterchangeThread->join();
+  if (fInterchangeThread && fInterchangeThread->joinable())
+  {
+    fInterchangeThread->join();
+  }
+  if (fControlThread && fControlThread->joinable())
+  {
+    fControlThread->join();
+  }
+  // A map already being uploaded finishes, queued ones are dropped
+  fMapWorkGuard.reset();
+  fMapWorker.stop();
+  if (fMapThread && fMapThread->joinable())
+  {
+    fMapThread->join();
+  }
 }
 
 void RosConnector::SendLoadMapMessage(const std::string &inMapMetadataPath)
@@ -52,135 +178,782 @@ void RosConnector::SendLoadMapMessage(const std::string &inMapMetadataPath)
   auto request = std::make_shared<nav2_msgs::srv::LoadMap::Request>();
   request->map_url = inMapMetadataPath;
 
-  while (!fLoadMapClient->wait_for_service(std::chrono::seconds(1))) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Interrupted while waiting for the service. Exiting.");
-      return;
-    }
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "service not available, waiting again...");
+  if (!fLoadMapClient->wait_for_service(server_timeout_))
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "load_map service not available, {} not loaded", inMapMetadataPath);
+    return;
   }
 
-  auto result = fLoadMapClient->async_send_request(request);
+  std::string aMapUrl = inMapMetadataPath;
+  fLoadMapClient->async_send_request(request,
+    [aMapUrl](rclcpp::Client<nav2_msgs::srv::LoadMap>::SharedFuture inResponse)
+    {
+      unsigned aResult = inResponse.get()->result;
+      if (aResult == nav2_msgs::srv::LoadMap::Response::RESULT_SUCCESS)
+      {
+        EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogInfo, "Map server loaded {}", aMapUrl);
+      }
+      else
+      {
+        EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Map server failed to load {}, result {}", aMapUrl, aResult);
+      }
+    });
 }
 
-void RosConnector::ProcessIncomingMessage(const std::string inMessage)
+void RosConnector::ProcessIncomingMessage(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace)
 {
-  std::cout << "from ROS: " << inMessage << std::endl;
-  boost::json::error_code aErr;
-  boost::json::value aValue = boost::json::parse(inMessage, aErr);
-  if (!aErr && aValue.is_object())
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDecode);
+  bool aGoalPending = false;
+  fReplyFormat = inMessage->Format();
+  // Commands that waited too long are still decoded so EA can be told which
+  // point lists and starts were not acted on
+  fExpired = CheckExpired(inTrace);
+  // The parsed value lives in the thread's arena until aScope ends
+  DecodeArena &aArena = DecodeArena::ForThread();
+  DecodeArena::TScope aScope(aArena);
+  if (fReplyFormat == MessageBuffer::kFormatProtobuf)
+  {
+    aGoalPending = DoProcessCommand(*inMessage, inTrace);
+  }
+  else
+  {
+    boost::json::value aValue(aArena.Storage());
+    const boost::json::object *aObj = DecodeRobot(*inMessage, aArena, aValue);
+    if (aObj)
+    {
+      // Each handler first checks its key is there, a message carries one
+      // command and throwing out_of_range for the others would allocate
+      DoProcessStopMessage(*aObj, inTrace);
+      DoProcessLoadMessage(*aObj);
+      DoProcessWaypointsMessage(*aObj);
+      aGoalPending = DoProcessMoveMessage(*aObj, inTrace);
+      DoProcessLatencyReportMessage(*aObj, fExpired);
+    }
+  }
+  if (!aGoalPending)
   {
-    boost::json::object aObj;
-    try {
-      aObj = aValue.at("robot").as_object();
+    CompleteTrace(inTrace);
+  }
+}
+
+void RosConnector::ProcessControlMessage(const TMessageBufferPtr &inMessage, LatencyTracer::TMessageTrace &inTrace)
+{
+  // Runs beside the interchange thread, so it leaves fReplyFormat, fExpired
+  // and the point lists alone. A stop is acted on even past its deadline.
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDecode);
+  bool aExpired = CheckExpired(inTrace);
+  DecodeArena &aArena = DecodeArena::ForThread();
+  DecodeArena::TScope aScope(aArena);
+  if (inMessage->Format() == MessageBuffer::kFormatProtobuf)
+  {
+#ifdef EM_PROTOBUF
+    google::protobuf::Arena aProtoArena(CommandArenaOptions(*inMessage));
+    ats::base::RobotCommand *aCommand = DecodeCommand(*inMessage, aProtoArena);
+    if (aCommand && aCommand->has_stop())
+    {
+      DoStop(inTrace);
     }
-    catch(std::out_of_range &e)
+    if (aCommand && (aCommand->has_load_map() || aCommand->has_point_list() || aCommand->has_start()))
     {
-      return;
+      EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Message {} on the control lane, only its stop is acted on", inTrace.id);
     }
-    DoProcessLoadMessage(aObj);
-    DoProcessWaypointsMessage(aObj);
-    DoProcessMoveMessage(aObj);
+#else
+    MetricsRegistry::Add(MetricsRegistry::kProtobufParseErrors);
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Dropped {} byte protobuf command, built without protobuf", inMessage->Size());
+#endif
+  }
+  else
+  {
+    boost::json::value aValue(aArena.Storage());
+    const boost::json::object *aObj = DecodeRobot(*inMessage, aArena, aValue);
+    if (aObj)
+    {
+      DoProcessStopMessage(*aObj, inTrace);
+      DoProcessLatencyReportMessage(*aObj, aExpired);
+      if (aObj->find("load_map") != aObj->end() || aObj->find("map") != aObj->end() || aObj->find("start") != aObj->end())
+      {
+        EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Message {} on the control lane, only stop and latency_report are acted on", inTrace.id);
+      }
+    }
+  }
+  CompleteTrace(inTrace);
+}
+
+bool RosConnector::CheckExpired(const LatencyTracer::TMessageTrace &inTrace)
+{
+  uint64_t aNow = LatencyTracer::Now();
+  if (!inTrace.Expired(aNow))
+  {
+    return false;
+  }
+  MetricsRegistry::Add(MetricsRegistry::kCommandsExpired);
+  MetricsRegistry::Add(MetricsRegistry::kCommandsExpiredLateNanoseconds, aNow - inTrace.deadline);
+  EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Message {} is {} ms past its deadline", inTrace.id, (aNow - inTrace.deadline) / 1000000);
+  return true;
+}
+
+const boost::json::object *RosConnector::DecodeRobot(const MessageBuffer &inMessage, DecodeArena &inArena, boost::json::value &outValue)
+{
+  EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogDebug, "from ROS: {}", inMessage.View());
+  boost::json::parser &aParser = inArena.JsonParser();
+  aParser.reset(inArena.Storage());
+  boost::json::error_code aErr;
+  aParser.write(inMessage.Data(), inMessage.Size(), aErr);
+  if (aErr)
+  {
+    MetricsRegistry::Add(MetricsRegistry::kJsonParseErrors);
+    return NULL;
+  }
+  outValue = aParser.release();
+  if (!outValue.is_object())
+  {
+    return NULL;
+  }
+  boost::json::object::const_iterator aRobot = outValue.get_object().find("robot");
+  if (aRobot == outValue.get_object().end() || !aRobot->value().is_object())
+  {
+    return NULL;
+  }
+  return &aRobot->value().get_object();
+}
+
+void RosConnector::CompleteTrace(LatencyTracer::TMessageTrace &inTrace)
+{
+  if (!inTrace.stamps[LatencyTracer::kStageDispatched])
+  {
+    inTrace.Mark(LatencyTracer::kStageDispatched);
+  }
+  if (fLatencyTracer)
+  {
+    fLatencyTracer->Record(inTrace);
+  }
+  if (fFlightRecorder)
+  {
+    fFlightRecorder->Record(FlightRecorder::kEntryTrace, NULL, 0, &inTrace);
+  }
+}
+
+void RosConnector::DoProcessStopMessage(const boost::json::object &inMessageObj, const LatencyTracer::TMessageTrace &inTrace)
+{
+  if (inMessageObj.find("stop") != inMessageObj.end())
+  {
+    DoStop(inTrace);
   }
 }
 
+void RosConnector::DoStop(const LatencyTracer::TMessageTrace &inTrace)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  if (fFlightRecorder)
+  {
+    fFlightRecorder->Record(FlightRecorder::kEntryGoalCanceled, NULL, 0, &inTrace);
+  }
+  if (!fUseActionClient)
+  {
+    // Killing the ros2 cli would leave its goal running on the server
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Stop {} needs goals sent through the action client, the current goal keeps running", inTrace.id);
+    return;
+  }
+  if (!waypoint_follower_action_client_->action_server_is_ready())
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Stop {} not sent, follow_waypoints action server is not available", inTrace.id);
+    return;
+  }
+  // Cancels goals sent by any client, as nav2's own stop does
+  uint64_t aId = inTrace.id;
+  waypoint_follower_action_client_->async_cancel_all_goals([aId](auto inResponse)
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogInfo, "Stop {} canceling {} goals", aId, inResponse ? inResponse->goals_canceling.size() : 0);
+  });
+  MetricsRegistry::Add(MetricsRegistry::kGoalsCanceled);
+  EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogInfo, "Stop {} sent", aId);
+}
+
+void RosConnector::DoProcessLatencyReportMessage(const boost::json::object &inMessageObj, const bool &inExpired)
+{
+  if (!fLatencyTracer || inExpired || inMessageObj.find("latency_report") == inMessageObj.end())
+  {
+    return;
+  }
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  LatencyTracer::TSummaryList aSummaries;
+  fLatencyTracer->Summarise(aSummaries);
+  std::stringstream ss;
+  ss << "<robot><latency_report>";
+  for (LatencyTracer::TSummaryList::const_iterator aIter = aSummaries.begin(); aIter != aSummaries.end(); aIter++)
+  {
+    ss << "<stage>"
+       << "<name>" << aIter->stage << "</name>"
+       << "<count>" << aIter->count << "</count>"
+       << "<p50_us>" << aIter->p50_us << "</p50_us>"
+       << "<p99_us>" << aIter->p99_us << "</p99_us>"
+       << "<p999_us>" << aIter->p999_us << "</p999_us>"
+       << "</stage>";
+  }
+  ss << "</latency_report></robot>";
+  // Only the latest report is worth sending if EA asked again meanwhile
+  fMessageInterchange->SendMessageToEA(ss.str(), MessageInterchange::MakeKey(MessageInterchange::kKeyLatencyReport, 0));
+}
+
 void RosConnector::DoProcessLoadMessage(const boost::json::object &inMessageObj)
 {
+  if (inMessageObj.find("load_map") == inMessageObj.end())
+  {
+    return;
+  }
   try {
-    boost::json::value aVal = inMessageObj.at("load_map");
-    if (aVal.is_number())
+    const boost::json::value &aVal = inMessageObj.at("load_map");
+    if (fExpired)
+    {
+      return;
+    }
+    // Maps from the XML side arrive as text
+    if (aVal.is_string())
     {
-      fPointLists.clear();
-      //TODO create ROS load_map request
+      DoLoadMap(boost::lexical_cast<uint64_t>(aVal.as_string().c_str()));
+    }
+    else if (aVal.is_number())
+    {
+      DoLoadMap(aVal.to_number<uint64_t>());
     }
   }
   catch (std::out_of_range &e)
   {
   }
+  catch (boost::system::system_error &e)
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Malformed load_map: {}", e.what());
+  }
+  catch (boost::bad_lexical_cast &e)
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Malformed load_map: {}", e.what());
+  }
+}
+
+void RosConnector::DoLoadMap(const uint64_t &inMapId)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  // Point lists and zones belong to the map they were made for
+  fWaypointStore.Clear();
+  if (fMapDirectory.empty())
+  {
+    return;
+  }
+  std::stringstream aMapPath;
+  aMapPath << fMapDirectory << "/" << inMapId << "_runtime_map.svg";
+  std::ifstream aFileStream(aMapPath.str().c_str());
+  std::stringstream aMapSvg;
+  if (aFileStream.is_open())
+  {
+    aMapSvg << aFileStream.rdbuf();
+  }
+  else
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Map {} not found at {}", inMapId, aMapPath.str());
+  }
+
+  // The next point list is checked against the new zones, so they are read
+  // here in order with it. A map that could not be read leaves none.
+  MapConverter aConverter;
+  bool aLoaded = aConverter.LoadZones(aMapSvg.str());
+  if (fZoneIndex)
+  {
+    fZoneIndex->SetZones(aConverter.GetZones());
+  }
+  EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogInfo, "Map {} has {} nogo zones", inMapId, aConverter.GetZones().size());
+  if (!aLoaded)
+  {
+    return;
+  }
+
+  uint64_t aSequence = ++fMapLoadSequence;
+  boost::shared_ptr<std::string> aSvg(new std::string(aMapSvg.str()));
+  boost::asio::post(fMapWorker, [this, inMapId, aSequence, aSvg] { RunMapUpload(inMapId, aSequence, *aSvg); });
+}
+
+void RosConnector::RunMapUpload(const uint64_t &inMapId, const uint64_t &inSequence, const std::string &inMapSvg)
+{
+  if (inSequence != fMapLoadSequence)
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogInfo, "Map {} superseded before upload", inMapId);
+    return;
+  }
+  MapConverter aConverter;
+  std::string aMapName = "map_" + boost::lexical_cast<std::string>(inMapId);
+  std::string aOutputMetaDataPath;
+  uint64_t aStartTime = LatencyTracer::Now();
+  bool aUploaded = false;
+  // An exception escaping here would end the map worker, and the process
+  try {
+    aUploaded = aConverter.ConvertToRos(fRobotAddress, inMapSvg, aMapName, aOutputMetaDataPath);
+  }
+  catch (std::exception &e)
+  {
+    EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogWarn, "Map {} conversion failed: {}", inMapId, e.what());
+  }
+  MetricsRegistry::Add(MetricsRegistry::kMapConversions);
+  MetricsRegistry::Add(MetricsRegistry::kMapConversionNanoseconds, LatencyTracer::Now() - aStartTime);
+  EM_LOG(AsyncLogger::kLogMap, AsyncLogger::kLogInfo, "Map {} costmap {}", inMapId, aUploaded ? "uploaded" : "not uploaded");
+  if (aUploaded)
+  {
+    SendLoadMapMessage(aOutputMetaDataPath);
+  }
 }
 
 void RosConnector::DoProcessWaypointsMessage(const boost::json::object &inMessageObj)
 {
+  if (inMessageObj.find("map") == inMessageObj.end())
+  {
+    return;
+  }
   try {
-    boost::json::object aMap = inMessageObj.at("map").as_object();
-    boost::json::object aCommand = aMap.at("point_list").as_object();
-    uint64_t aPointListId = boost::lexical_cast<uint64_t>(aCommand.at("id").as_string().c_str());
-    TPointList &aPointList = fPointLists[aPointListId];
-    aPointList.clear();
-    boost::json::value aPoints = aCommand.at("point");
-    if (aPoints.is_string())
+    const boost::json::object &aMap = inMessageObj.at("map").as_object();
+    const boost::json::object &aCommand = aMap.at("point_list").as_object();
+    WaypointStore::TPatch &aPatch = fPatch;
+    aPatch.Reset();
+    aPatch.id = boost::lexical_cast<uint64_t>(aCommand.at("id").as_string().c_str());
+    if (fExpired)
     {
-      std::string aPointString(aPoints.as_string().c_str());
-      AddPoint(aPointList, aPointString);
+      ReportPointListStatus(aPatch.id, kExpiredReason, ZoneIndex::TViolationList());
+      return;
     }
-    else if (aPoints.is_array())
+
+    std::string aError;
+    if (!ParsePatch(aCommand, aPatch, aError))
     {
-      boost::json::array aPointArray = aPoints.as_array();
-      for (boost::json::array::const_iterator aIter = aPointArray.cbegin(); aIter != aPointArray.cend(); aIter++)
+      ReportPointListStatus(aPatch.id, aError, ZoneIndex::TViolationList());
+      return;
+    }
+    DoApplyPatch(aPatch);
+  }
+  catch (std::out_of_range &e)
+  {
+  }
+  catch (boost::system::system_error &e)
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Malformed point list: {}", e.what());
+  }
+  catch (boost::bad_lexical_cast &e)
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Malformed point list: {}", e.what());
+  }
+}
+
+void RosConnector::DoApplyPatch(const WaypointStore::TPatch &inPatch)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  std::string aError;
+  TPointList &aWindow = fPatchWindow;
+  size_t aWindowStart = 0;
+  ZoneIndex::TViolationList aViolations;
+  for (TPointList::const_iterator aIter = inPatch.points.begin(); aIter != inPatch.points.end(); aIter++)
+  {
+    if (!aIter->IsFinite())
+    {
+      ReportPointListStatus(inPatch.id, "point is not finite", aViolations);
+      return;
+    }
+  }
+  if (!fWaypointStore.PatchWindow(inPatch, aWindow, aWindowStart, aError))
+  {
+    ReportPointListStatus(inPatch.id, aError, aViolations);
+    return;
+  }
+
+  // Reject edits that enter a nogo zone now rather than after a failed plan
+  // on the robot. Only the legs the patch touches need checking.
+  if (fZoneIndex && !fZoneIndex->Validate(aWindow, aViolations))
+  {
+    for (ZoneIndex::TViolationList::iterator aIter = aViolations.begin(); aIter != aViolations.end(); aIter++)
+    {
+      aIter->index += aWindowStart;
+    }
+    ReportPointListStatus(inPatch.id, "enters a nogo zone", aViolations);
+    return;
+  }
+
+  fWaypointStore.Apply(inPatch, aError);
+  ReportPointListStatus(inPatch.id, aError, aViolations);
+}
+
+bool RosConnector::DoProcessCommand(const MessageBuffer &inMessage, LatencyTracer::TMessageTrace &inTrace)
+{
+#ifdef EM_PROTOBUF
+  google::protobuf::Arena aProtoArena(CommandArenaOptions(inMessage));
+  ats::base::RobotCommand *aCommand = DecodeCommand(inMessage, aProtoArena);
+  if (!aCommand)
+  {
+    return false;
+  }
+  if (aCommand->has_stop())
+  {
+    DoStop(inTrace);
+  }
+  if (aCommand->has_load_map() && !fExpired)
+  {
+    DoLoadMap(aCommand->load_map().map_id());
+  }
+  if (aCommand->has_point_list())
+  {
+    DoProcessPointList(aCommand->point_list());
+  }
+  if (aCommand->has_start())
+  {
+    return DoStartMission(aCommand->start().point_list_id(), inTrace);
+  }
+#else
+  (void)inTrace;
+  MetricsRegistry::Add(MetricsRegistry::kProtobufParseErrors);
+  EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Dropped {} byte protobuf command, built without protobuf", inMessage.Size());
+#endif
+  return false;
+}
+
+#ifdef EM_PROTOBUF
+void RosConnector::DoProcessPointList(const ats::base::PointList &inPointList)
+{
+  WaypointStore::TPatch &aPatch = fPatch;
+  aPatch.Reset();
+  aPatch.id = inPointList.id();
+  if (fExpired)
+  {
+    ReportPointListStatus(aPatch.id, kExpiredReason, ZoneIndex::TViolationList());
+    return;
+  }
+  if (!ats::base::PointList::Operation_IsValid(inPointList.op()))
+  {
+    ReportPointListStatus(aPatch.id, "unknown operation", ZoneIndex::TViolationList());
+    return;
+  }
+  // PointList.Operation is numbered like TPatchOperation
+  aPatch.operation = static_cast<WaypointStore::TPatchOperation>(inPointList.op());
+  aPatch.index = inPointList.index();
+  aPatch.count = inPointList.count();
+  aPatch.base_version = inPointList.base_version();
+
+  int aSize = inPointList.x_size();
+  if (inPointList.y_size() != aSize
+    || (inPointList.v_size() && inPointList.v_size() != aSize)
+    || (inPointList.a_size() && inPointList.a_size() != aSize)
+    || (inPointList.t_size() && inPointList.t_size() != aSize))
+  {
+    ReportPointListStatus(aPatch.id, "point columns differ in length", ZoneIndex::TViolationList());
+    return;
+  }
+  aPatch.points.resize(aSize);
+  for (int i = 0; i < aSize; i++)
+  {
+    TWayPoint &aWayPoint = aPatch.points[i];
+    aWayPoint.x = inPointList.x(i);
+    aWayPoint.y = inPointList.y(i);
+    aWayPoint.v = (inPointList.v_size() ? inPointList.v(i) : 0);
+    aWayPoint.a = (inPointList.a_size() ? inPointList.a(i) : 0);
+    aWayPoint.t = (inPointList.t_size() ? inPointList.t(i) : 0);
+  }
+  DoApplyPatch(aPatch);
+}
+#endif
+
+bool RosConnector::ParsePatch(const boost::json::object &inCommandObj, WaypointStore::TPatch &outPatch, std::string &outError)
+{
+  // A point_list without an op replaces the whole list, as EA always did
+  boost::json::object::const_iterator aField = inCommandObj.find("op");
+  if (aField != inCommandObj.end() && aField->value().is_string())
+  {
+    if (!WaypointStore::ParseOperation(aField->value().as_string().c_str(), outPatch.operation))
+    {
+      outError = "unknown operation";
+      return false;
+    }
+  }
+  aField = inCommandObj.find("index");
+  if (aField != inCommandObj.end() && aField->value().is_string())
+  {
+    outPatch.index = boost::lexical_cast<size_t>(aField->value().as_string().c_str());
+  }
+  aField = inCommandObj.find("count");
+  if (aField != inCommandObj.end() && aField->value().is_string())
+  {
+    outPatch.count = boost::lexical_cast<size_t>(aField->value().as_string().c_str());
+  }
+  aField = inCommandObj.find("base_version");
+  if (aField != inCommandObj.end() && aField->value().is_string())
+  {
+    outPatch.base_version = boost::lexical_cast<uint64_t>(aField->value().as_string().c_str());
+  }
+  aField = inCommandObj.find("point");
+  if (aField != inCommandObj.end())
+  {
+    ParsePoints(aField->value(), outPatch.points);
+  }
+  return true;
+}
+
+void RosConnector::ParsePoints(const boost::json::value &inPoints, TPointList &outPointList)
+{
+  if (inPoints.is_string())
+  {
+    AddPoint(outPointList, boost::string_view(inPoints.as_string().data(), inPoints.as_string().size()));
+  }
+  else if (inPoints.is_array())
+  {
+    const boost::json::array &aPointArray = inPoints.as_array();
+    outPointList.reserve(aPointArray.size());
+    for (boost::json::array::const_iterator aIter = aPointArray.cbegin(); aIter != aPointArray.cend(); aIter++)
+    {
+      if (aIter->is_string())
       {
-        if (aIter->is_string())
-        {
-          std::string aPointString(aIter->as_string().c_str());
-          AddPoint(aPointList, aPointString);
-        }
+        AddPoint(outPointList, boost::string_view(aIter->as_string().data(), aIter->as_string().size()));
       }
     }
   }
-  catch (std::out_of_range &e)
+}
+
+void RosConnector::ReportPointListStatus(const uint64_t &inPointListId, const std::string &inError, const ZoneIndex::TViolationList &inViolations)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  if (!inError.empty())
   {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogInfo, "Points list with id {} rejected: {}", inPointListId, inError);
+  }
+#ifdef EM_PROTOBUF
+  if (fReplyFormat == MessageBuffer::kFormatProtobuf)
+  {
+    StatusArena aArena;
+    ats::base::RobotStatus &aStatus = aArena.NewStatus();
+    ats::base::PointListStatus *aListStatus = aStatus.mutable_point_list_status();
+    aListStatus->set_id(inPointListId);
+    aListStatus->set_accepted(inError.empty());
+    if (inError.empty())
+    {
+      aListStatus->set_version(fWaypointStore.Version(inPointListId));
+      aListStatus->set_size(fWaypointStore.Size(inPointListId));
+    }
+    else
+    {
+      aListStatus->set_reason(inError);
+    }
+    for (ZoneIndex::TViolationList::const_iterator aIter = inViolations.begin(); aIter != inViolations.end(); aIter++)
+    {
+      ats::base::PointListStatus::Violation *aViolation = aListStatus->add_violations();
+      aViolation->set_index(aIter->index);
+      aViolation->set_leg(aIter->leg);
+      aViolation->set_zone(aIter->zone);
+    }
+    SendStatusToEA(aStatus);
+    return;
   }
+#endif
+  MessageBufferStream aStream(256);
+  PutText(aStream, "<robot><point_list_status><id>");
+  PutNumber(aStream, inPointListId);
+  PutText(aStream, "</id>");
+  if (inError.empty())
+  {
+    PutText(aStream, "<result>accepted</result><version>");
+    PutNumber(aStream, fWaypointStore.Version(inPointListId));
+    PutText(aStream, "</version><size>");
+    PutNumber(aStream, fWaypointStore.Size(inPointListId));
+    PutText(aStream, "</size>");
+  }
+  else
+  {
+    PutText(aStream, "<result>rejected</result><reason>");
+    PutText(aStream, inError);
+    PutText(aStream, "</reason>");
+  }
+  for (ZoneIndex::TViolationList::const_iterator aIter = inViolations.begin(); aIter != inViolations.end(); aIter++)
+  {
+    PutText(aStream, "<violation><index>");
+    PutNumber(aStream, aIter->index);
+    PutText(aStream, "</index><type>");
+    PutText(aStream, aIter->leg ? "leg" : "point");
+    PutText(aStream, "</type><zone>");
+    PutText(aStream, aIter->zone);
+    PutText(aStream, "</zone></violation>");
+  }
+  PutText(aStream, "</point_list_status></robot>");
+  LatencyTracer::TMessageTrace aTrace;
+  fMessageInterchange->SendMessageToEA(aStream.GetBuffer(), aTrace);
+}
+
+void RosConnector::ReportGoalResult(const uint64_t &inPointListId, const bool &inAccepted, const size_t &inPoses)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+#ifdef EM_PROTOBUF
+  if (fReplyFormat != MessageBuffer::kFormatProtobuf)
+  {
+    return;
+  }
+  StatusArena aArena;
+  ats::base::RobotStatus &aStatus = aArena.NewStatus();
+  ats::base::GoalResult *aResult = aStatus.mutable_goal_result();
+  aResult->set_point_list_id(inPointListId);
+  aResult->set_accepted(inAccepted);
+  aResult->set_poses(static_cast<uint32_t>(inPoses));
+  SendStatusToEA(aStatus);
+#else
+  (void)inPointListId;
+  (void)inAccepted;
+  (void)inPoses;
+#endif
+}
+
+#ifdef EM_PROTOBUF
+void RosConnector::SendStatusToEA(const ats::base::RobotStatus &inStatus)
+{
+  std::size_t aSize = inStatus.ByteSizeLong();
+  TMessageBufferPtr aBuffer = BufferPool::Acquire(aSize);
+  inStatus.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(aBuffer->Data()));
+  aBuffer->Resize(aSize);
+  aBuffer->SetFormat(MessageBuffer::kFormatProtobuf);
+  LatencyTracer::TMessageTrace aTrace;
+  fMessageInterchange->SendMessageToEA(aBuffer, aTrace);
 }
+#endif
 
-void RosConnector::AddPoint(TPointList &inPointList, const std::string &inPointString)
+void RosConnector::AddPoint(TPointList &inPointList, const boost::string_view &inPointString)
 {
-  std::vector<std::string> aFields;
-  boost::split(aFields, inPointString, boost::is_any_of(", "), boost::token_compress_on);
+  // Fields are separated by runs of commas and spaces, a leading or trailing
+  // separator leaves an empty field
+  boost::string_view aFields[kPointFields];
+  size_t aFieldCount = 0;
+  size_t aStart = 0;
+  while (aFieldCount < kPointFields)
+  {
+    size_t aEnd = inPointString.find_first_of(", ", aStart);
+    aFields[aFieldCount++] = inPointString.substr(aStart, aEnd - aStart);
+    if (aEnd == boost::string_view::npos)
+    {
+      break;
+    }
+    aStart = inPointString.find_first_not_of(", ", aEnd);
+    if (aStart == boost::string_view::npos)
+    {
+      if (aFieldCount < kPointFields)
+      {
+        aFields[aFieldCount++] = boost::string_view();
+      }
+      break;
+    }
+  }
   TWayPoint aWayPoint;
-  if (aFields.size() > 1)
+  if (aFieldCount > 1)
   {
-    aWayPoint.x = boost::lexical_cast<double_t>(aFields[0]);
-    aWayPoint.y = boost::lexical_cast<double_t>(aFields[1]);
+    aWayPoint.x = ParsePointField(aFields[0]);
+    aWayPoint.y = ParsePointField(aFields[1]);
+    // Optional speed, acceleration and arrival time follow the position
+    if (aFieldCount > 2 && !aFields[2].empty())
+    {
+      aWayPoint.v = ParsePointField(aFields[2]);
+    }
+    if (aFieldCount > 3 && !aFields[3].empty())
+    {
+      aWayPoint.a = ParsePointField(aFields[3]);
+    }
+    if (aFieldCount > 4 && !aFields[4].empty())
+    {
+      aWayPoint.t = ParsePointField(aFields[4]);
+    }
     inPointList.push_back(aWayPoint);
   }
 }
 
-void RosConnector::DoProcessMoveMessage(const boost::json::object &inMessageObj)
+bool RosConnector::DoProcessMoveMessage(const boost::json::object &inMessageObj, LatencyTracer::TMessageTrace &inTrace)
 {
+  if (inMessageObj.find("start") == inMessageObj.end())
+  {
+    return false;
+  }
   try {
-    boost::json::object aCommand = inMessageObj.at("start").as_object();
+    const boost::json::object &aCommand = inMessageObj.at("start").as_object();
     uint64_t aPointListId = boost::lexical_cast<uint64_t>(aCommand.at("point_list_id").as_string().c_str());
-    if (fPointLists.count(aPointListId))
-    {
-      TPointList aPointList = fPointLists[aPointListId];
-      BuildFollowWaypointsMessage(aPointList);
-      //DoFollowWaypointsAction();
-      //YAML::Emitter aYaml;
-      //FollowWaypointsMsgToYaml(waypoint_follower_goal_, aYaml);
-      //std::cout << aYaml.c_str() << std::endl;
-      std::string aJsonStr;
-      FollowWaypointsMsgToJson(waypoint_follower_goal_, aJsonStr);
-      DoRunFollowWaypointsActionInShell(aJsonStr);
-    }
-    else
-    {
-      std::cout << "Points list with id " << aPointListId << " not found" << std::endl;
-    }
+    return DoStartMission(aPointListId, inTrace);
   }
   catch (std::out_of_range &e)
   {
   }
+  catch (boost::system::system_error &e)
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Malformed start: {}", e.what());
+  }
+  catch (boost::bad_lexical_cast &e)
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Malformed start: {}", e.what());
+  }
+  return false;
+}
+
+bool RosConnector::DoStartMission(const uint64_t &inPointListId, LatencyTracer::TMessageTrace &inTrace)
+{
+  EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+  if (fExpired)
+  {
+    ReportGoalResult(inPointListId, false, 0);
+    return false;
+  }
+  WaypointStore::TSnapshot aSnapshot;
+  uint64_t aVersion = 0;
+  if (!fWaypointStore.Snapshot(inPointListId, aSnapshot, aVersion))
+  {
+    EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogWarn, "Points list with id {} not found", inPointListId);
+    ReportGoalResult(inPointListId, false, 0);
+    return false;
+  }
+  // Holding the snapshot makes later patches to this list copy it first
+  fActiveMission = aSnapshot;
+  double_t aPlannedDuration = BuildFollowWaypointsMessage(*fActiveMission);
+  EM_TRACE3(goal_sent, inTrace.id, inPointListId, waypoint_follower_goal_.poses.size());
+  if (fFlightRecorder)
+  {
+    char aEvent[128];
+    int aLength = snprintf(aEvent, sizeof(aEvent), "point_list_id=%llu version=%llu poses=%zu planned=%.1fs",
+      static_cast<unsigned long long>(inPointListId), static_cast<unsigned long long>(aVersion), waypoint_follower_goal_.poses.size(), aPlannedDuration);
+    fFlightRecorder->Record(FlightRecorder::kEntryGoalSent, aEvent, aLength > 0 ? aLength : 0, &inTrace);
+  }
+  if (fUseActionClient)
+  {
+    inTrace.Mark(LatencyTracer::kStageDispatched);
+    bool aSent = DoFollowWaypointsAction(inTrace);
+    ReportGoalResult(inPointListId, aSent, waypoint_follower_goal_.poses.size());
+    return aSent;
+  }
+  //YAML::Emitter aYaml;
+  //FollowWaypointsMsgToYaml(waypoint_follower_goal_, aYaml);
+  //std::cout << aYaml.c_str() << std::endl;
+  std::string aJsonStr;
+  FollowWaypointsMsgToJson(waypoint_follower_goal_, aJsonStr);
+  DoRunFollowWaypointsActionInShell(aJsonStr);
+  inTrace.Mark(LatencyTracer::kStageDispatched);
+  ReportGoalResult(inPointListId, true, waypoint_follower_goal_.poses.size());
+  return false;
 }
 
 void RosConnector::RunInterchangeThread()
 {
-  fRunThread = true;
-  std::string aMessage;
+  TMessageBufferPtr aMessage;
+  LatencyTracer::TMessageTrace aTrace;
   while (fRunThread)
   {
-    aMessage.clear();
-    if (fMessageInterchange->GetNextMessageForROS(aMessage))
+    aMessage.reset();
+    if (fMessageInterchange->GetNextMissionMessageForROS(aMessage, aTrace))
     {
-      ProcessIncomingMessage(aMessage);
+      ProcessIncomingMessage(aMessage, aTrace);
+    }
+    usleep(16);
+  }
+}
+
+void RosConnector::RunControlThread()
+{
+  TMessageBufferPtr aMessage;
+  LatencyTracer::TMessageTrace aTrace;
+  while (fRunThread)
+  {
+    aMessage.reset();
+    if (fMessageInterchange->GetNextControlMessageForROS(aMessage, aTrace))
+    {
+      ProcessControlMessage(aMessage, aTrace);
     }
     usleep(16);
   }
@@ -229,6 +1002,8 @@ void RosConnector::FollowWaypointsMsgToJson(nav2_msgs::action::FollowWaypoints::
     ss << "{";
 
     ss << "header: {"
+      << "stamp: {sec: " << aIter->header.stamp.sec
+      << ", nanosec: " << aIter->header.stamp.nanosec << "}, "
       << "frame_id" << ": " << aIter->header.frame_id
       << "}, ";
 
@@ -255,49 +1030,94 @@ void RosConnector::FollowWaypointsMsgToJson(nav2_msgs::action::FollowWaypoints::
   outJson = ss.str();
 }
 
-void RosConnector::BuildFollowWaypointsMessage(TPointList &inWayPoints)
+double_t RosConnector::BuildFollowWaypointsMessage(const TPointList &inWayPoints)
 {
   waypoint_follower_goal_.poses.clear();
 
-  for (TPointList::iterator aIter = inWayPoints.begin(); aIter != inWayPoints.end(); aIter++)
+  TPointList aPoints;
+  fPathSimplifier.Process(inWayPoints, aPoints);
+  TrajectoryConditioner::TTrajectory aTrajectory;
+  fTrajectoryConditioner.Condition(aPoints, aTrajectory);
+
+  // FollowWaypoints stops at every pose, so only the sample standing for
+  // each EA point is sent, facing the blended heading. The stamp is left at
+  // zero so nav2 transforms the pose with the latest TF; the timing stays
+  // with the trajectory and is returned as the planned duration.
+  waypoint_follower_goal_.poses.reserve(aTrajectory.size());
+  for (TrajectoryConditioner::TTrajectory::iterator aIter = aTrajectory.begin(); aIter != aTrajectory.end(); aIter++)
   {
+    if (!aIter->waypoint)
+    {
+      continue;
+    }
     geometry_msgs::msg::PoseStamped aPose;
-    aPose.header.stamp = rclcpp::Clock().now();
     aPose.header.frame_id = "map";
     aPose.pose.position.x = aIter->x;
     aPose.pose.position.y = aIter->y;
     aPose.pose.position.z = 0;
-    aPose.pose.orientation = nav2_util::geometry_utils::orientationAroundZAxis(1);
+    aPose.pose.orientation = nav2_util::geometry_utils::orientationAroundZAxis(aIter->yaw);
 
     waypoint_follower_goal_.poses.push_back(aPose);
   }
+  return (aTrajectory.empty() ? 0 : aTrajectory.back().t);
+}
+
+namespace
+{
+// Foxy hands the goal response callback a future, later distros the handle
+template <typename THandle>
+THandle GoalHandleFromResponse(const std::shared_future<THandle> &inResponse)
+{
+  return inResponse.get();
 }
 
-void RosConnector::DoFollowWaypointsAction()
+template <typename THandle>
+THandle GoalHandleFromResponse(const THandle &inResponse)
 {
-  auto is_action_server_ready = waypoint_follower_action_client_->wait_for_action_server(std::chrono::seconds(5));
-  if (!is_action_server_ready) {
+  return inResponse;
+}
+}
+
+bool RosConnector::DoFollowWaypointsAction(const LatencyTracer::TMessageTrace &inTrace)
+{
+  // Never block the interchange waiting for the server, the goal is dropped
+  // and EA can resend once navigation is up
+  if (!waypoint_follower_action_client_->action_server_is_ready()) {
     RCLCPP_ERROR(client_node_->get_logger(), "follow_waypoints action server is not available.");
-    return;
+    return false;
   }
 
-  std::cout << "Sending " << waypoint_follower_goal_.poses.size() << " poses" << std::endl;
+  EM_LOG(AsyncLogger::kLogROS, AsyncLogger::kLogInfo, "Sending {} poses", waypoint_follower_goal_.poses.size());
   auto send_goal_options = rclcpp_action::Client<nav2_msgs::action::FollowWaypoints>::SendGoalOptions();
   send_goal_options.result_callback = [](auto) {};
-
-  auto future_goal_handle = waypoint_follower_action_client_->async_send_goal(waypoint_follower_goal_, send_goal_options);
-  if (rclcpp::spin_until_future_complete(client_node_, future_goal_handle, server_timeout_) != rclcpp::FutureReturnCode::SUCCESS)
+  LatencyTracer::TMessageTrace aTrace = inTrace;
+  send_goal_options.goal_response_callback = [this, aTrace](auto inResponse) mutable
   {
-    RCLCPP_ERROR(client_node_->get_logger(), "Send goal call failed");
-    return;
-  }
+    waypoint_follower_goal_handle_ = GoalHandleFromResponse(inResponse);
+    if (!waypoint_follower_goal_handle_) {
+      RCLCPP_ERROR(client_node_->get_logger(), "Goal was rejected by server");
+      EM_TRACE1(goal_rejected, aTrace.id);
+      if (fFlightRecorder)
+      {
+        fFlightRecorder->Record(FlightRecorder::kEntryGoalRejected, NULL, 0, &aTrace);
+      }
+      return;
+    }
+    aTrace.Mark(LatencyTracer::kStageGoalAccepted);
+    EM_TRACE2(goal_accepted, aTrace.id, aTrace.stamps[LatencyTracer::kStageGoalAccepted] - aTrace.stamps[LatencyTracer::kStageReceived]);
+    if (fLatencyTracer)
+    {
+      fLatencyTracer->Record(aTrace);
+    }
+    if (fFlightRecorder)
+    {
+      fFlightRecorder->Record(FlightRecorder::kEntryGoalAccepted, NULL, 0, &aTrace);
+    }
+  };
 
-  // Get the goal handle and save so that we can check on completion in the timer callback
-  waypoint_follower_goal_handle_ = future_goal_handle.get();
-  if (!waypoint_follower_goal_handle_) {
-    RCLCPP_ERROR(client_node_->get_logger(), "Goal was rejected by server");
-    return;
-  }
+  waypoint_follower_action_client_->async_send_goal(waypoint_follower_goal_, send_goal_options);
+  MetricsRegistry::Add(MetricsRegistry::kGoalsSent);
+  return true;
 }
 
 void RosConnector::DoRunFollowWaypointsActionInShell(const std::string &inActionMessage)
@@ -313,4 +1133,5 @@ void RosConnector::DoRunFollowWaypointsActionInShell(const std::string &inAction
   auto env = boost::this_process::environment();
   fRosFollowWaypointAction = boost::process::child(boost::process::search_path("ros2"), "action", "send_goal", "/FollowWaypoints", "nav2_msgs/action/FollowWaypoints", inActionMessage, boost::process::std_out > fFollowWaypointsActionProcessStream, env);
   fRosFollowWaypointAction.detach();
+  MetricsRegistry::Add(MetricsRegistry::kGoalsSent);
 }
\ No newline at end of file
@@ -0,0 +1,335 @@
+/*
+ * shm_ring.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "shm_ring.hpp"
+
+#include <boost/interprocess/exceptions.hpp>
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <linux/futex.h>
+#include <new>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+	const uint32_t kRingMagic = 0x45415231;	// "EAR1"
+	// Also covers what MessageInterchange writes into each record: 3 added the
+	// deadline to the trace ahead of the message
+	const uint32_t kRingVersion = 3;
+	const std::size_t kAlignment = 8;
+	const std::size_t kCacheLineSize = 64;
+	// A zero byte where a record would start sends the reader back to offset 0
+	const char kWrapMarker = 0;
+	// How long Attach waits for the other side to finish creating the segment
+	const int kAttachAttempts = 1000;
+	const useconds_t kAttachRetryUs = 1000;
+}
+
+// Head and tail count bytes since creation and only ever grow, so the ring
+// is empty when they are equal and never has to tell full from empty
+struct ShmRing::SControl
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+	alignas(kCacheLineSize) std::atomic<uint64_t> head;		// written by the producer
+	std::atomic<uint32_t> written;							// sequence of the last record written
+	alignas(kCacheLineSize) std::atomic<uint64_t> tail;		// written by the consumer
+	std::atomic<uint32_t> consumed;							// sequence of the last record consumed
+	alignas(kCacheLineSize) std::atomic<uint32_t> signal;	// futex word, bumped on every write
+	std::atomic<uint32_t> waiting;							// the consumer is asleep on signal
+};
+
+ShmRing::ShmRing() :
+	fControl(NULL), fData(NULL), fCapacity(0), fOwner(false), fPeekedSize(0), fPeekedSequence(0)
+{
+}
+
+ShmRing::~ShmRing()
+{
+	Close();
+}
+
+bool ShmRing::Create(const std::string &inName, const std::size_t &inCapacity)
+{
+	Close();
+	boost::interprocess::shared_memory_object::remove(inName.c_str());
+	try
+	{
+		if (!Initialise(inName, inCapacity))
+		{
+			return false;
+		}
+	}
+	catch (boost::interprocess::interprocess_exception &e)
+	{
+		return false;
+	}
+	fOwner = true;
+	return true;
+}
+
+bool ShmRing::Attach(const std::string &inName, const std::size_t &inCapacity)
+{
+	Close();
+	for (int i = 0; i < kAttachAttempts; i++)
+	{
+		if (Open(inName))
+		{
+			return true;
+		}
+		try
+		{
+			return Initialise(inName, inCapacity);
+		}
+		catch (boost::interprocess::interprocess_exception &e)
+		{
+			if (e.get_error_code() != boost::interprocess::already_exists_error)
+			{
+				return false;
+			}
+		}
+		// The other side is part way through creating it
+		usleep(kAttachRetryUs);
+	}
+	// Left by an incompatible build or a creator that died half way
+	boost::interprocess::shared_memory_object::remove(inName.c_str());
+	try
+	{
+		return Initialise(inName, inCapacity);
+	}
+	catch (boost::interprocess::interprocess_exception &e)
+	{
+		return false;
+	}
+}
+
+// Throws when the segment already exists, so Attach can tell that apart
+bool ShmRing::Initialise(const std::string &inName, const std::size_t &inCapacity)
+{
+	std::size_t aCapacity = (inCapacity + kAlignment - 1) / kAlignment * kAlignment;
+	if (aCapacity < EAFrame::kHeaderSize * 2)
+	{
+		return false;
+	}
+	fSegment = boost::interprocess::shared_memory_object(boost::interprocess::create_only, inName.c_str(), boost::interprocess::read_write);
+	try
+	{
+		fSegment.truncate(sizeof(TControl) + aCapacity);
+		fRegion = boost::interprocess::mapped_region(fSegment, boost::interprocess::read_write);
+	}
+	catch (boost::interprocess::interprocess_exception &e)
+	{
+		Close();
+		boost::interprocess::shared_memory_object::remove(inName.c_str());
+		return false;
+	}
+	fName = inName;
+	fControl = new (fRegion.get_address()) TControl();
+	fControl->capacity = aCapacity;
+	fControl->head.store(0, std::memory_order_relaxed);
+	fControl->written.store(0, std::memory_order_relaxed);
+	fControl->tail.store(0, std::memory_order_relaxed);
+	fControl->consumed.store(0, std::memory_order_relaxed);
+	fControl->signal.store(0, std::memory_order_relaxed);
+	fControl->waiting.store(0, std::memory_order_relaxed);
+	fControl->version = kRingVersion;
+	// Producers check the magic, so it goes last
+	std::atomic_thread_fence(std::memory_order_release);
+	fControl->magic = kRingMagic;
+	fData = static_cast<char *>(fRegion.get_address()) + sizeof(TControl);
+	fCapacity = aCapacity;
+	return true;
+}
+
+bool ShmRing::Open(const std::string &inName)
+{
+	Close();
+	try
+	{
+		fSegment = boost::interprocess::shared_memory_object(boost::interprocess::open_only, inName.c_str(), boost::interprocess::read_write);
+		fRegion = boost::interprocess::mapped_region(fSegment, boost::interprocess::read_write);
+	}
+	catch (boost::interprocess::interprocess_exception &e)
+	{
+		Close();
+		return false;
+	}
+	TControl *aControl = static_cast<TControl *>(fRegion.get_address());
+	if (fRegion.get_size() < sizeof(TControl) || aControl->magic != kRingMagic)
+	{
+		Close();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (aControl->version != kRingVersion || fRegion.get_size() < sizeof(TControl) + aControl->capacity)
+	{
+		Close();
+		return false;
+	}
+	fControl = aControl;
+	fData = static_cast<char *>(fRegion.get_address()) + sizeof(TControl);
+	fCapacity = aControl->capacity;
+	fName = inName;
+	return true;
+}
+
+void ShmRing::Close()
+{
+	fControl = NULL;
+	fData = NULL;
+	fCapacity = 0;
+	fPeekedSize = 0;
+	fRegion = boost::interprocess::mapped_region();
+	fSegment = boost::interprocess::shared_memory_object();
+	if (fOwner)
+	{
+		boost::interprocess::shared_memory_object::remove(fName.c_str());
+		fOwner = false;
+	}
+	fName.clear();
+}
+
+std::size_t ShmRing::RecordSize(const uint32_t &inLength)
+{
+	return (EAFrame::kHeaderSize + inLength + 1 + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+bool ShmRing::Write(const EAFrame::THeader &inHeader, const char *inPayload)
+{
+	return Write(inHeader, NULL, 0, inPayload);
+}
+
+bool ShmRing::Write(const EAFrame::THeader &inHeader, const void *inPrefix, const std::size_t &inPrefixSize, const char *inPayload)
+{
+	std::size_t aRecordSize = RecordSize(inHeader.length);
+	if (!fControl || aRecordSize > fCapacity || inPrefixSize > inHeader.length)
+	{
+		return false;
+	}
+	uint64_t aHead = fControl->head.load(std::memory_order_relaxed);
+	uint64_t aTail = fControl->tail.load(std::memory_order_acquire);
+	std::size_t aOffset = aHead % fCapacity;
+	std::size_t aToEnd = fCapacity - aOffset;
+	std::size_t aSkip = (aToEnd < aRecordSize ? aToEnd : 0);
+	if (aHead + aSkip + aRecordSize - aTail > fCapacity)
+	{
+		return false;
+	}
+	if (aSkip)
+	{
+		fData[aOffset] = kWrapMarker;
+		aOffset = 0;
+	}
+	EAFrame::Encode(inHeader, reinterpret_cast<unsigned char *>(fData + aOffset));
+	char *aPayload = fData + aOffset + EAFrame::kHeaderSize;
+	if (inPrefixSize)
+	{
+		memcpy(aPayload, inPrefix, inPrefixSize);
+	}
+	memcpy(aPayload + inPrefixSize, inPayload, inHeader.length - inPrefixSize);
+	fControl->written.store(inHeader.sequence, std::memory_order_relaxed);
+	fControl->head.store(aHead + aSkip + aRecordSize, std::memory_order_release);
+
+	fControl->signal.fetch_add(1);
+	if (fControl->waiting.load())
+	{
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(&fControl->signal), FUTEX_WAKE, 1, NULL, NULL, 0);
+	}
+	return true;
+}
+
+ShmRing::TPeekResult ShmRing::Peek(EAFrame::THeader &outHeader, char *&outPayload)
+{
+	if (!fControl)
+	{
+		return kPeekEmpty;
+	}
+	uint64_t aTail = fControl->tail.load(std::memory_order_relaxed);
+	uint64_t aHead = fControl->head.load(std::memory_order_acquire);
+	if (aTail == aHead)
+	{
+		return kPeekEmpty;
+	}
+	std::size_t aOffset = aTail % fCapacity;
+	if (fData[aOffset] == kWrapMarker)
+	{
+		aTail += fCapacity - aOffset;
+		aOffset = 0;
+		fControl->tail.store(aTail, std::memory_order_release);
+		if (aTail == aHead)
+		{
+			return kPeekEmpty;
+		}
+	}
+	if (aHead - aTail < EAFrame::kHeaderSize
+		|| fCapacity - aOffset < EAFrame::kHeaderSize
+		|| !EAFrame::Decode(reinterpret_cast<const unsigned char *>(fData + aOffset), outHeader)
+		|| RecordSize(outHeader.length) > fCapacity - aOffset
+		|| RecordSize(outHeader.length) > aHead - aTail)
+	{
+		fControl->tail.store(aHead, std::memory_order_release);
+		return kPeekCorrupt;
+	}
+	outPayload = fData + aOffset + EAFrame::kHeaderSize;
+	fPeekedSize = RecordSize(outHeader.length);
+	fPeekedSequence = outHeader.sequence;
+	return kPeekFrame;
+}
+
+uint32_t ShmRing::WrittenSequence() const
+{
+	return (fControl ? fControl->written.load(std::memory_order_relaxed) : 0);
+}
+
+uint32_t ShmRing::ConsumedSequence() const
+{
+	return (fControl ? fControl->consumed.load(std::memory_order_relaxed) : 0);
+}
+
+void ShmRing::Consume()
+{
+	if (!fControl || !fPeekedSize)
+	{
+		return;
+	}
+	fControl->consumed.store(fPeekedSequence, std::memory_order_relaxed);
+	fControl->tail.store(fControl->tail.load(std::memory_order_relaxed) + fPeekedSize, std::memory_order_release);
+	fPeekedSize = 0;
+}
+
+bool ShmRing::Empty() const
+{
+	return !fControl || fControl->head.load() == fControl->tail.load(std::memory_order_relaxed);
+}
+
+bool ShmRing::Wait(const std::chrono::milliseconds &inTimeout)
+{
+	if (!fControl)
+	{
+		return false;
+	}
+	uint32_t aSeen = fControl->signal.load();
+	if (!Empty())
+	{
+		return true;
+	}
+	// A write after waiting is set either sees it and wakes us, or bumped
+	// signal before we sleep so FUTEX_WAIT returns at once
+	fControl->waiting.store(1);
+	if (Empty())
+	{
+		timespec aTimeout;
+		aTimeout.tv_sec = inTimeout.count() / 1000;
+		aTimeout.tv_nsec = (inTimeout.count() % 1000) * 1000000;
+		syscall(SYS_futex, reinterpret_cast<uint32_t *>(&fControl->signal), FUTEX_WAIT, aSeen, &aTimeout, NULL, 0);
+	}
+	fControl->waiting.store(0);
+	return !Empty();
+}
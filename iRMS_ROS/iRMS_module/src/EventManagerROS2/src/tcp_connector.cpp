@@ -1,14 +1,17 @@
 #include <tcp_connector.hpp>
+#include <latency_tracer.hpp>
+#include <metrics_registry.hpp>
+#include <async_logger.hpp>
+#include <alloc_accounting.hpp>
+#include <tracepoints.hpp>
 #include <iostream>
-#include <sstream>
-#include <algorithm>
-#include <iterator>
 #include <boost/bind/bind.hpp>
 #include <boost/thread/lock_guard.hpp>
+#include <array>
 
 
-TcpConnector::TcpConnector(boost::asio::ip::tcp::socket inSocket) : 
-fSocket(std::move(inSocket))
+TcpConnector::TcpConnector(TSocket inSocket) : 
+fSocket(std::move(inSocket)), fFraming(kFramingUnknown), fSendSequence(0), fReceiveSequence(0), fSpeaksProtobuf(false), fReadReserved(0), fCapture(NULL), fSession(0)
 {
 }
 
@@ -20,51 +23,253 @@ void TcpConnector::Start()
 void TcpConnector::DoRead()
 {
     auto self(shared_from_this());
-    fSocket.async_read_some(fReadBuffer.prepare(1024), boost::bind(&TcpConnector::handleRead, self, boost::placeholders::_1, boost::placeholders::_2));
+    // Read straight onto the end of what is still waiting to be framed
+    std::size_t aUsed = fReadBuffer.size();
+    if (fFraming == kFramingLength)
+    {
+        // The rest of the current frame arrives as one completion, along
+        // with whatever of the next frames fits in the same reads
+        std::size_t aNeeded = FrameBytesNeeded();
+        fReadReserved = (aNeeded > kReadSize ? aNeeded : kReadSize);
+        fReadBuffer.resize(aUsed + fReadReserved);
+        boost::asio::async_read(fSocket, boost::asio::buffer(&fReadBuffer[aUsed], fReadReserved), boost::asio::transfer_at_least(aNeeded),
+            boost::bind(&TcpConnector::handleRead, self, boost::placeholders::_1, boost::placeholders::_2));
+        return;
+    }
+    fReadReserved = kReadSize;
+    fReadBuffer.resize(aUsed + fReadReserved);
+    fSocket.async_read_some(boost::asio::buffer(&fReadBuffer[aUsed], fReadReserved), boost::bind(&TcpConnector::handleRead, self, boost::placeholders::_1, boost::placeholders::_2));
+}
+
+std::size_t TcpConnector::FrameBytesNeeded() const
+{
+    if (fReadBuffer.size() < EAFrame::kHeaderSize)
+    {
+        return EAFrame::kHeaderSize - fReadBuffer.size();
+    }
+    // ProcessFrames has already checked this header
+    EAFrame::THeader aHeader;
+    EAFrame::Decode(reinterpret_cast<const unsigned char *>(fReadBuffer.data()), aHeader);
+    return EAFrame::kHeaderSize + aHeader.length - fReadBuffer.size();
+}
+
+bool TcpConnector::ProcessFrames(const uint64_t &inReceivedTime)
+{
+    std::size_t aOffset = 0;
+    EAFrame::THeader aHeader;
+    while (fReadBuffer.size() - aOffset >= EAFrame::kHeaderSize)
+    {
+        if (!EAFrame::Decode(reinterpret_cast<const unsigned char *>(fReadBuffer.data() + aOffset), aHeader))
+        {
+            return false;
+        }
+        if (fReadBuffer.size() - aOffset - EAFrame::kHeaderSize < aHeader.length)
+        {
+            break;
+        }
+        if (aHeader.sequence != fReceiveSequence + 1)
+        {
+            // A frame lost or replayed by whatever relays the link, the
+            // frames themselves are still whole
+            MetricsRegistry::Add(MetricsRegistry::kFrameSequenceGaps);
+            EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "EA frame sequence went from {} to {}", fReceiveSequence, aHeader.sequence);
+        }
+        fReceiveSequence = aHeader.sequence;
+        if (aHeader.type == EAFrame::kFrameProtobuf)
+        {
+            fSpeaksProtobuf = true;
+        }
+        if (fFrameHandler)
+        {
+            // The byte after the payload is the next header or the string's terminator
+            fFrameHandler(aHeader, &fReadBuffer[aOffset + EAFrame::kHeaderSize], inReceivedTime);
+        }
+        aOffset += EAFrame::kHeaderSize + aHeader.length;
+    }
+    if (aOffset)
+    {
+        fReadBuffer.erase(0, aOffset);
+    }
+    return true;
 }
 
 void TcpConnector::handleRead(boost::system::error_code ec, std::size_t length)
 {
+    uint64_t aReceivedTime = LatencyTracer::Now();
+    EM_ALLOC_STAGE(AllocAccounting::kAllocRead);
+    // Drop the part of the read the socket did not fill
+    fReadBuffer.resize(fReadBuffer.size() - fReadReserved + (ec ? 0 : length));
     if (!ec)
     {
-        fReadBuffer.commit(length);
-
-        // get const buffer
-        std::stringstream ssOut;
-        boost::asio::streambuf::const_buffers_type constBuffer = fReadBuffer.data();
-
-        size_t nBufferSize = boost::asio::buffer_size(fReadBuffer.data());
-        // copy const buffer to stringstream, then output
-        std::copy(
-            boost::asio::buffers_begin(constBuffer),
-            boost::asio::buffers_begin(constBuffer) + nBufferSize,
-            std::ostream_iterator<char>(ssOut));
-        if (fReadHandler)
+        bool aFramingFound = false;
+        MetricsRegistry::Add(MetricsRegistry::kBytesReceived, length);
+        EM_TRACE1(ea_read, length);
+        if (fCapture)
+        {
+            // The new bytes are the tail of the read buffer
+            fCapture->Record(TrafficCapture::kRecordIngress, fSession, fReadBuffer.data() + fReadBuffer.size() - length, length);
+        }
+
+        if (fFraming == kFramingUnknown)
+        {
+            fFraming = (EAFrame::IsFramed(fReadBuffer[0]) ? kFramingLength : kFramingSentinel);
+            EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogInfo, "EA session uses {} framing", (fFraming == kFramingLength ? "length prefixed" : "sentinel"));
+            aFramingFound = true;
+        }
+
+        if (fFraming == kFramingLength)
+        {
+            if (!ProcessFrames(aReceivedTime))
+            {
+                // Nothing after a bad header can be trusted to start a frame
+                MetricsRegistry::Add(MetricsRegistry::kFramingErrors);
+                EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "EA session sent an invalid frame header, closing");
+                if (fCapture)
+                {
+                    fCapture->Record(TrafficCapture::kRecordSessionClose, fSession, NULL, 0);
+                }
+                boost::system::error_code aError;
+                fSocket.close(aError);
+                return;
+            }
+        }
+        else if (fReadHandler)
         {            
-            std::string aString = ssOut.str();
             size_t aBytesProcessed = 0;
-            fReadHandler(aString, length, aBytesProcessed);
+            fReadHandler(fReadBuffer, length, aBytesProcessed, aReceivedTime);
             if (aBytesProcessed)
             {
-                fReadBuffer.consume(aBytesProcessed);
+                fReadBuffer.erase(0, aBytesProcessed);
             }
         }
+
+        if (aFramingFound)
+        {
+            // After the frames so a first binary command counts
+            ReleaseHeldWrites();
+        }
     }
     else
     {
-        std::cout << ec.message() << std::endl;
+        // The peer has gone, stop reading so the connector can be released
+        if (fCapture)
+        {
+            fCapture->Record(TrafficCapture::kRecordSessionClose, fSession, NULL, 0);
+        }
+        EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogInfo, "EA session read ended: {}", ec.message());
+        return;
     }
     DoRead();
 }
 
+void TcpConnector::Send(const TMessageBufferPtr &inMessage)
+{
+    auto self(shared_from_this());
+    uint64_t aQueued = LatencyTracer::Now();
+    boost::asio::post(fSocket.get_executor(), [this, self, inMessage, aQueued]()
+        {
+          if (fFraming == kFramingUnknown)
+          {
+            // Held until the peer's first read says how to frame it
+            if (fWriteQueue.size() >= kMaxHeldWrites)
+            {
+              MetricsRegistry::Add(MetricsRegistry::kHeldWritesDropped);
+              fWriteQueue.pop_front();
+            }
+            fWriteQueue.push_back(TOutgoing());
+            fWriteQueue.back().message = inMessage;
+            fWriteQueue.back().queued = aQueued;
+            fWriteQueue.back().header_size = 0;
+            return;
+          }
+          if (!Accepts(*inMessage))
+          {
+            return;
+          }
+          bool aWriteInProgress = !fWriteQueue.empty();
+          fWriteQueue.push_back(TOutgoing());
+          TOutgoing &aOutgoing = fWriteQueue.back();
+          aOutgoing.message = inMessage;
+          aOutgoing.queued = aQueued;
+          FrameOutgoing(aOutgoing);
+          if (!aWriteInProgress)
+          {
+            DoWrite();
+          }
+        }
+    );
+}
+
+void TcpConnector::FrameOutgoing(TOutgoing &ioOutgoing)
+{
+    ioOutgoing.header_size = 0;
+    if (fFraming == kFramingLength)
+    {
+        EAFrame::THeader aHeader;
+        aHeader.type = (ioOutgoing.message->Format() == MessageBuffer::kFormatProtobuf ? EAFrame::kFrameProtobuf : EAFrame::kFrameXml);
+        aHeader.length = static_cast<uint32_t>(ioOutgoing.message->Size());
+        aHeader.sequence = ++fSendSequence;
+        EAFrame::Encode(aHeader, ioOutgoing.header);
+        ioOutgoing.header_size = EAFrame::kHeaderSize;
+    }
+}
+
+bool TcpConnector::Accepts(const MessageBuffer &inMessage) const
+{
+    // Binary status would be garbage to a session that only speaks XML
+    return inMessage.Format() != MessageBuffer::kFormatProtobuf || fSpeaksProtobuf;
+}
+
+void TcpConnector::ReleaseHeldWrites()
+{
+    std::deque<TOutgoing>::iterator aIter = fWriteQueue.begin();
+    while (aIter != fWriteQueue.end())
+    {
+        if (!Accepts(*aIter->message))
+        {
+            aIter = fWriteQueue.erase(aIter);
+            continue;
+        }
+        FrameOutgoing(*aIter);
+        ++aIter;
+    }
+    if (!fWriteQueue.empty())
+    {
+        DoWrite();
+    }
+}
+
 void TcpConnector::DoWrite()
 {
     auto self(shared_from_this());
-    boost::asio::async_write(fSocket, fReadBuffer.data(), [this, self](boost::system::error_code ec, std::size_t length)
+    // The header goes out with the shared message buffer rather than being
+    // copied in front of it
+    const TOutgoing &aOutgoing = fWriteQueue.front();
+    std::array<boost::asio::const_buffer, 2> aBuffers =
+    {{
+        boost::asio::buffer(aOutgoing.header, aOutgoing.header_size),
+        boost::asio::buffer(aOutgoing.message->Data(), aOutgoing.message->Size())
+    }};
+    boost::asio::async_write(fSocket, aBuffers, [this, self](boost::system::error_code ec, std::size_t length)
         {
           if (!ec)
           {
-//            fWriteHandler(fWriteBuffer.data(), length);
+            MetricsRegistry::Add(MetricsRegistry::kBytesSent, length);
+            if (fWriteHandler)
+            {
+              size_t aBytesProcessed = length;
+              fWriteHandler(*fWriteQueue.front().message, length, aBytesProcessed, fWriteQueue.front().queued);
+            }
+            fWriteQueue.pop_front();
+            if (!fWriteQueue.empty())
+            {
+              DoWrite();
+            }
+          }
+          else
+          {
+            EM_LOG(AsyncLogger::kLogEA, AsyncLogger::kLogWarn, "EA session write failed: {}", ec.message());
+            fWriteQueue.clear();
           }
         }
     );
@@ -77,9 +282,24 @@ void TcpConnector::RegisterCallbackHandlerReceivedData(TBoostAsioHandler inCallb
 	fReadHandler = inCallbackHandler;
 }
 
-void TcpConnector::RegisterCallbackHandlerSentData(TBoostAsioHandler inCallbackHandler)
+void TcpConnector::SetTrafficCapture(TrafficCapture *inCapture, const uint16_t &inSession)
+{
+	boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
+
+	fCapture = inCapture;
+	fSession = inSession;
+}
+
+void TcpConnector::RegisterCallbackHandlerSentData(TSentHandler inCallbackHandler)
 {
 	boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
 
 	fWriteHandler = inCallbackHandler;
 }
+
+void TcpConnector::RegisterCallbackHandlerFrame(TFrameHandler inCallbackHandler)
+{
+	boost::lock_guard<boost::recursive_mutex> aLock(fMutex);
+
+	fFrameHandler = inCallbackHandler;
+}
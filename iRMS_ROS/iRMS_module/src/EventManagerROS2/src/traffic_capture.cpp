@@ -0,0 +1,83 @@
+/*
+ * traffic_capture.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "traffic_capture.hpp"
+#include "latency_tracer.hpp"
+
+#include <boost/thread/lock_guard.hpp>
+#include <chrono>
+
+static_assert(sizeof(TrafficCapture::THeader) == 32, "header size is part of the file format");
+static_assert(sizeof(TrafficCapture::TRecord) == 16, "record size is part of the file format");
+
+TrafficCapture::TrafficCapture() : fFile(NULL), fBuffer(1 << 20), fSessions(0)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+	Close();
+}
+
+bool TrafficCapture::Open(const std::string &inPath)
+{
+	Close();
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	fFile = fopen(inPath.c_str(), "wb");
+	if (!fFile)
+	{
+		return false;
+	}
+	setvbuf(fFile, &fBuffer[0], _IOFBF, fBuffer.size());
+
+	THeader aHeader;
+	aHeader.magic = kMagic;
+	aHeader.version = kVersion;
+	aHeader.reserved = 0;
+	aHeader.wall_clock_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	aHeader.monotonic_ns = LatencyTracer::Now();
+	if (fwrite(&aHeader, sizeof(aHeader), 1, fFile) != 1)
+	{
+		fclose(fFile);
+		fFile = NULL;
+		return false;
+	}
+	return true;
+}
+
+void TrafficCapture::Close()
+{
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	if (fFile)
+	{
+		fclose(fFile);
+		fFile = NULL;
+	}
+}
+
+void TrafficCapture::Record(const TRecordType &inType, const uint16_t &inSession, const char *inData, const std::size_t &inLength)
+{
+	static const char kPadding[8] = {0};
+
+	TRecord aRecord;
+	aRecord.timestamp = LatencyTracer::Now();
+	aRecord.length = inLength;
+	aRecord.type = inType;
+	aRecord.session = inSession;
+
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	if (!fFile)
+	{
+		return;
+	}
+	fwrite(&aRecord, sizeof(aRecord), 1, fFile);
+	if (inLength)
+	{
+		fwrite(inData, 1, inLength, fFile);
+		fwrite(kPadding, 1, PaddedLength(inLength) - inLength, fFile);
+	}
+}
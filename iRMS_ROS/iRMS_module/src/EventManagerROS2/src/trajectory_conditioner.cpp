@@ -0,0 +1,257 @@
+/*
+ * trajectory_conditioner.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "trajectory_conditioner.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const double_t kMinSegmentLength = 1e-6;
+
+	double_t NormaliseAngle(double_t inAngle)
+	{
+		while (inAngle > M_PI)
+		{
+			inAngle -= 2.0 * M_PI;
+		}
+		while (inAngle < -M_PI)
+		{
+			inAngle += 2.0 * M_PI;
+		}
+		return inAngle;
+	}
+
+	// Time to cover inDistance entering at inV0 and leaving at inV1 without
+	// exceeding inVMax, using a trapezoidal (or triangular) speed profile.
+	double_t SegmentTime(const double_t inDistance, const double_t inV0, const double_t inV1, const double_t inVMax, const double_t inAcceleration)
+	{
+		if (inDistance <= 0)
+		{
+			return 0;
+		}
+		double_t aVMax = std::max(inVMax, std::max(inV0, inV1));
+		if (inAcceleration <= 0)
+		{
+			return inDistance / std::max(aVMax, kMinSegmentLength);
+		}
+		double_t aPeak = sqrt((2.0 * inAcceleration * inDistance + inV0 * inV0 + inV1 * inV1) / 2.0);
+		if (aPeak <= aVMax)
+		{
+			return (2.0 * aPeak - inV0 - inV1) / inAcceleration;
+		}
+		double_t aAccelDistance = (aVMax * aVMax - inV0 * inV0) / (2.0 * inAcceleration);
+		double_t aDecelDistance = (aVMax * aVMax - inV1 * inV1) / (2.0 * inAcceleration);
+		return (2.0 * aVMax - inV0 - inV1) / inAcceleration + (inDistance - aAccelDistance - aDecelDistance) / aVMax;
+	}
+}
+
+TrajectoryConditioner::TrajectoryConditioner() :
+	 fCornerRadius(0.5)
+	,fDefaultSpeed(0.5)
+	,fMaxAcceleration(0.5)
+	,fMinTurnAngle(5.0 * M_PI / 180.0)
+	,fSampleAngle(15.0 * M_PI / 180.0)
+{
+}
+
+TrajectoryConditioner::~TrajectoryConditioner()
+{
+}
+
+double_t TrajectoryConditioner::PointSpeed(const TWayPoint &inPoint) const
+{
+	return (inPoint.v > 0 ? inPoint.v : fDefaultSpeed);
+}
+
+double_t TrajectoryConditioner::PointAcceleration(const TWayPoint &inPoint) const
+{
+	return (inPoint.a > 0 ? inPoint.a : fMaxAcceleration);
+}
+
+void TrajectoryConditioner::Condition(const TPointList &inPointList, TTrajectory &outTrajectory) const
+{
+	outTrajectory.clear();
+
+	// Repeated points carry no direction, drop them before computing headings
+	TPointList aPoints;
+	aPoints.reserve(inPointList.size());
+	for (TPointList::const_iterator aIter = inPointList.begin(); aIter != inPointList.end(); aIter++)
+	{
+		if (aPoints.empty() || hypot(aIter->x - aPoints.back().x, aIter->y - aPoints.back().y) > kMinSegmentLength)
+		{
+			aPoints.push_back(*aIter);
+		}
+	}
+
+	TPath aPath;
+	BuildPath(aPoints, aPath);
+	TimePath(aPath, outTrajectory);
+}
+
+void TrajectoryConditioner::BuildPath(const TPointList &inPointList, TPath &outPath) const
+{
+	outPath.clear();
+	if (inPointList.empty())
+	{
+		return;
+	}
+
+	const TWayPoint &aFirst = inPointList.front();
+	TPathSample aSample;
+	aSample.x = aFirst.x;
+	aSample.y = aFirst.y;
+	aSample.yaw = 0;
+	aSample.vmax = PointSpeed(aFirst);
+	aSample.vleg = aSample.vmax;
+	aSample.a = PointAcceleration(aFirst);
+	aSample.t = aFirst.t;
+	aSample.waypoint = true;
+	if (inPointList.size() > 1)
+	{
+		aSample.yaw = atan2(inPointList[1].y - aFirst.y, inPointList[1].x - aFirst.x);
+	}
+	outPath.push_back(aSample);
+
+	for (size_t i = 1; i + 1 < inPointList.size(); i++)
+	{
+		BlendCorner(inPointList[i - 1], inPointList[i], inPointList[i + 1], outPath);
+	}
+
+	if (inPointList.size() > 1)
+	{
+		const TWayPoint &aPrev = inPointList[inPointList.size() - 2];
+		const TWayPoint &aLast = inPointList.back();
+		aSample.x = aLast.x;
+		aSample.y = aLast.y;
+		aSample.yaw = atan2(aLast.y - aPrev.y, aLast.x - aPrev.x);
+		aSample.vmax = PointSpeed(aLast);
+		aSample.vleg = aSample.vmax;
+		aSample.a = PointAcceleration(aLast);
+		aSample.t = aLast.t;
+		outPath.push_back(aSample);
+	}
+}
+
+void TrajectoryConditioner::BlendCorner(const TWayPoint &inPrev, const TWayPoint &inCorner, const TWayPoint &inNext, TPath &outPath) const
+{
+	double_t aLengthIn = hypot(inCorner.x - inPrev.x, inCorner.y - inPrev.y);
+	double_t aLengthOut = hypot(inNext.x - inCorner.x, inNext.y - inCorner.y);
+	double_t aInX = (inCorner.x - inPrev.x) / aLengthIn;
+	double_t aInY = (inCorner.y - inPrev.y) / aLengthIn;
+	double_t aOutX = (inNext.x - inCorner.x) / aLengthOut;
+	double_t aOutY = (inNext.y - inCorner.y) / aLengthOut;
+	double_t aYawIn = atan2(aInY, aInX);
+	double_t aTurn = NormaliseAngle(atan2(aOutY, aOutX) - aYawIn);
+
+	TPathSample aSample;
+	aSample.vmax = PointSpeed(inCorner);
+	aSample.vleg = aSample.vmax;
+	aSample.a = PointAcceleration(inCorner);
+	aSample.t = inCorner.t;
+	aSample.waypoint = true;
+
+	// Tangent length of a circular fillet, limited to half of either leg so
+	// neighbouring corners never overlap
+	double_t aHalfTurn = fabs(aTurn) / 2.0;
+	double_t aTangent = std::min(fCornerRadius * tan(aHalfTurn), 0.5 * std::min(aLengthIn, aLengthOut));
+	if (fabs(aTurn) < fMinTurnAngle || fCornerRadius <= 0 || aTangent <= kMinSegmentLength)
+	{
+		// Shallow corner, face the bisector and drive straight through
+		aSample.x = inCorner.x;
+		aSample.y = inCorner.y;
+		aSample.yaw = NormaliseAngle(aYawIn + aTurn / 2.0);
+		outPath.push_back(aSample);
+		return;
+	}
+
+	// Speed through the blend is capped by the lateral acceleration limit
+	double_t aRadius = aTangent / tan(aHalfTurn);
+	double_t aCornerSpeed = std::min(aSample.vmax, sqrt(aSample.a * aRadius));
+
+	// Quadratic Bezier from the entry tangent point, controlled by the
+	// corner, to the exit tangent point
+	double_t aStartX = inCorner.x - aInX * aTangent;
+	double_t aStartY = inCorner.y - aInY * aTangent;
+	double_t aEndX = inCorner.x + aOutX * aTangent;
+	double_t aEndY = inCorner.y + aOutY * aTangent;
+	size_t aSteps = std::max<size_t>(2, ceil(fabs(aTurn) / fSampleAngle));
+	for (size_t i = 0; i <= aSteps; i++)
+	{
+		double_t s = static_cast<double_t>(i) / aSteps;
+		double_t aW0 = (1 - s) * (1 - s);
+		double_t aW1 = 2 * s * (1 - s);
+		double_t aW2 = s * s;
+		aSample.x = aW0 * aStartX + aW1 * inCorner.x + aW2 * aEndX;
+		aSample.y = aW0 * aStartY + aW1 * inCorner.y + aW2 * aEndY;
+		aSample.yaw = atan2((1 - s) * aInY + s * aOutY, (1 - s) * aInX + s * aOutX);
+		aSample.vmax = aCornerSpeed;
+		// The straight leg into the blend keeps the cruise speed
+		aSample.vleg = (i ? aCornerSpeed : PointSpeed(inCorner));
+		// EA timing belongs to the corner itself, anchor it on the sample
+		// nearest the apex, which is between two samples when aSteps is odd
+		aSample.t = (i == aSteps / 2 ? inCorner.t : 0);
+		aSample.waypoint = (i == aSteps / 2);
+		outPath.push_back(aSample);
+	}
+}
+
+void TrajectoryConditioner::TimePath(const TPath &inPath, TTrajectory &outTrajectory) const
+{
+	outTrajectory.clear();
+	size_t n = inPath.size();
+	if (!n)
+	{
+		return;
+	}
+
+	std::vector<double_t> aDistance(n, 0);
+	for (size_t i = 1; i < n; i++)
+	{
+		aDistance[i] = hypot(inPath[i].x - inPath[i - 1].x, inPath[i].y - inPath[i - 1].y);
+	}
+
+	// Pass-through speeds: start and finish at rest, respect every sample's
+	// cap and never demand more than the acceleration limit between samples
+	std::vector<double_t> aSpeed(n, 0);
+	for (size_t i = 1; i + 1 < n; i++)
+	{
+		aSpeed[i] = inPath[i].vmax;
+	}
+	for (size_t i = 1; i < n; i++)
+	{
+		aSpeed[i] = std::min(aSpeed[i], sqrt(aSpeed[i - 1] * aSpeed[i - 1] + 2.0 * inPath[i - 1].a * aDistance[i]));
+	}
+	for (size_t i = n - 1; i > 0; i--)
+	{
+		aSpeed[i - 1] = std::min(aSpeed[i - 1], sqrt(aSpeed[i] * aSpeed[i] + 2.0 * inPath[i - 1].a * aDistance[i]));
+	}
+
+	outTrajectory.resize(n);
+	double_t aTime = 0;
+	double_t aDelay = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (i)
+		{
+			aTime += SegmentTime(aDistance[i], aSpeed[i - 1], aSpeed[i], inPath[i].vleg, inPath[i - 1].a);
+		}
+		// EA may ask for a later arrival than the kinematics allow, never earlier
+		if (inPath[i].t > aTime + aDelay)
+		{
+			aDelay = inPath[i].t - aTime;
+		}
+		TTrajectoryPoint &aPoint = outTrajectory[i];
+		aPoint.x = inPath[i].x;
+		aPoint.y = inPath[i].y;
+		aPoint.yaw = inPath[i].yaw;
+		aPoint.v = aSpeed[i];
+		aPoint.t = aTime + aDelay;
+		aPoint.waypoint = inPath[i].waypoint;
+	}
+}
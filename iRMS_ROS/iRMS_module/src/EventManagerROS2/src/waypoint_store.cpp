@@ -0,0 +1,215 @@
+/*
+ * waypoint_store.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "waypoint_store.hpp"
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <sstream>
+
+WaypointStore::WaypointStore()
+{
+}
+
+WaypointStore::~WaypointStore()
+{
+}
+
+bool WaypointStore::ParseOperation(const std::string &inName, TPatchOperation &outOperation)
+{
+	if (inName.empty() || inName == "replace")
+	{
+		outOperation = kPatchReplace;
+	}
+	else if (inName == "append")
+	{
+		outOperation = kPatchAppend;
+	}
+	else if (inName == "insert")
+	{
+		outOperation = kPatchInsert;
+	}
+	else if (inName == "delete")
+	{
+		outOperation = kPatchDelete;
+	}
+	else if (inName == "replace_range")
+	{
+		outOperation = kPatchReplaceRange;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool WaypointStore::ResolveRange(const TPatch &inPatch, const size_t &inSize, size_t &outIndex, size_t &outCount, std::string &outError) const
+{
+	switch (inPatch.operation)
+	{
+	case kPatchAppend:
+		outIndex = inSize;
+		outCount = 0;
+		break;
+	case kPatchInsert:
+		outIndex = inPatch.index;
+		outCount = 0;
+		break;
+	case kPatchDelete:
+	case kPatchReplaceRange:
+		outIndex = inPatch.index;
+		outCount = inPatch.count;
+		break;
+	default:
+		outIndex = 0;
+		outCount = inSize;
+		break;
+	}
+	if (outIndex > inSize || outCount > inSize - outIndex)
+	{
+		std::stringstream ss;
+		ss << "range " << outIndex << "+" << outCount << " outside list of " << inSize << " points";
+		outError = ss.str();
+		return false;
+	}
+	return true;
+}
+
+bool WaypointStore::PatchWindow(const TPatch &inPatch, TPointList &outWindow, size_t &outWindowStart, std::string &outError) const
+{
+	outWindow.clear();
+	outWindowStart = 0;
+	if (inPatch.operation == kPatchReplace)
+	{
+		outWindow = inPatch.points;
+		return true;
+	}
+
+	TEntryMap::const_iterator aIter = fEntries.find(inPatch.id);
+	if (aIter == fEntries.end())
+	{
+		outError = "unknown point list";
+		return false;
+	}
+	if (inPatch.base_version && inPatch.base_version != aIter->second.version)
+	{
+		std::stringstream ss;
+		ss << "base version " << inPatch.base_version << " does not match " << aIter->second.version;
+		outError = ss.str();
+		return false;
+	}
+
+	const TPointList &aPoints = *aIter->second.points;
+	size_t aIndex, aCount;
+	if (!ResolveRange(inPatch, aPoints.size(), aIndex, aCount, outError))
+	{
+		return false;
+	}
+	outWindow.reserve(inPatch.points.size() + 2);
+	if (aIndex > 0)
+	{
+		outWindow.push_back(aPoints[aIndex - 1]);
+		outWindowStart = aIndex - 1;
+	}
+	outWindow.insert(outWindow.end(), inPatch.points.begin(), inPatch.points.end());
+	if (aIndex + aCount < aPoints.size())
+	{
+		outWindow.push_back(aPoints[aIndex + aCount]);
+	}
+	return true;
+}
+
+bool WaypointStore::Apply(const TPatch &inPatch, std::string &outError)
+{
+	if (inPatch.operation == kPatchReplace)
+	{
+		TEntryMap::iterator aIter = fEntries.find(inPatch.id);
+		uint64_t aVersion = (aIter == fEntries.end() ? 0 : aIter->second.version);
+		if (inPatch.base_version && inPatch.base_version != aVersion)
+		{
+			outError = "base version does not match";
+			return false;
+		}
+		// A list only enters the store with its points
+		TEntry &aEntry = (aIter == fEntries.end() ? fEntries[inPatch.id] : aIter->second);
+		// Never write through a list a snapshot may still be reading. One
+		// nobody else holds is overwritten in place and keeps its capacity.
+		if (aEntry.points && aEntry.points.unique())
+		{
+			*aEntry.points = inPatch.points;
+		}
+		else
+		{
+			aEntry.points = boost::make_shared<TPointList>(inPatch.points);
+		}
+		aEntry.version++;
+		return true;
+	}
+
+	TPointList aUnused;
+	size_t aUnusedStart;
+	if (!PatchWindow(inPatch, aUnused, aUnusedStart, outError))
+	{
+		return false;
+	}
+	TEntry &aEntry = fEntries[inPatch.id];
+	size_t aIndex, aCount;
+	ResolveRange(inPatch, aEntry.points->size(), aIndex, aCount, outError);
+
+	if (!aEntry.points.unique())
+	{
+		aEntry.points = boost::make_shared<TPointList>(*aEntry.points);
+	}
+	TPointList &aPoints = *aEntry.points;
+	size_t aShared = std::min(aCount, inPatch.points.size());
+	std::copy(inPatch.points.begin(), inPatch.points.begin() + aShared, aPoints.begin() + aIndex);
+	if (aCount > aShared)
+	{
+		aPoints.erase(aPoints.begin() + aIndex + aShared, aPoints.begin() + aIndex + aCount);
+	}
+	else
+	{
+		aPoints.insert(aPoints.begin() + aIndex + aShared, inPatch.points.begin() + aShared, inPatch.points.end());
+	}
+	aEntry.version++;
+	return true;
+}
+
+bool WaypointStore::Snapshot(const uint64_t &inId, TSnapshot &outSnapshot, uint64_t &outVersion) const
+{
+	TEntryMap::const_iterator aIter = fEntries.find(inId);
+	if (aIter == fEntries.end())
+	{
+		return false;
+	}
+	outSnapshot = aIter->second.points;
+	outVersion = aIter->second.version;
+	return true;
+}
+
+uint64_t WaypointStore::Version(const uint64_t &inId) const
+{
+	TEntryMap::const_iterator aIter = fEntries.find(inId);
+	return (aIter == fEntries.end() ? 0 : aIter->second.version);
+}
+
+size_t WaypointStore::Size(const uint64_t &inId) const
+{
+	TEntryMap::const_iterator aIter = fEntries.find(inId);
+	return (aIter == fEntries.end() ? 0 : aIter->second.points->size());
+}
+
+void WaypointStore::Remove(const uint64_t &inId)
+{
+	fEntries.erase(inId);
+}
+
+void WaypointStore::Clear()
+{
+	fEntries.clear();
+}
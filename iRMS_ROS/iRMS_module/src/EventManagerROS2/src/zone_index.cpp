@@ -0,0 +1,197 @@
+/*
+ * zone_index.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "zone_index.hpp"
+
+#include <boost/thread/lock_guard.hpp>
+#include <algorithm>
+#include <iterator>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+namespace
+{
+	double_t Cross(const ZoneIndex::TPoint &inO, const ZoneIndex::TPoint &inA, const ZoneIndex::TPoint &inB)
+	{
+		return (inA.x() - inO.x()) * (inB.y() - inO.y()) - (inA.y() - inO.y()) * (inB.x() - inO.x());
+	}
+
+	bool SegmentsIntersect(const ZoneIndex::TPoint &inP1, const ZoneIndex::TPoint &inP2, const ZoneIndex::TPoint &inQ1, const ZoneIndex::TPoint &inQ2)
+	{
+		double_t d1 = Cross(inQ1, inQ2, inP1);
+		double_t d2 = Cross(inQ1, inQ2, inP2);
+		double_t d3 = Cross(inP1, inP2, inQ1);
+		double_t d4 = Cross(inP1, inP2, inQ2);
+		if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+		{
+			return true;
+		}
+		// Touching or collinear overlap counts as entering the zone
+		return (d1 == 0 && bg::covered_by(inP1, bg::return_envelope<ZoneIndex::TBox>(ZoneIndex::TSegment(inQ1, inQ2))))
+			|| (d2 == 0 && bg::covered_by(inP2, bg::return_envelope<ZoneIndex::TBox>(ZoneIndex::TSegment(inQ1, inQ2))))
+			|| (d3 == 0 && bg::covered_by(inQ1, bg::return_envelope<ZoneIndex::TBox>(ZoneIndex::TSegment(inP1, inP2))))
+			|| (d4 == 0 && bg::covered_by(inQ2, bg::return_envelope<ZoneIndex::TBox>(ZoneIndex::TSegment(inP1, inP2))));
+	}
+
+	bool SegmentCrossesRing(const ZoneIndex::TPoint &inFrom, const ZoneIndex::TPoint &inTo, const ZoneIndex::TPolygon::ring_type &inRing)
+	{
+		for (size_t i = 1; i < inRing.size(); i++)
+		{
+			if (SegmentsIntersect(inFrom, inTo, inRing[i - 1], inRing[i]))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// With both ends outside the polygon a leg can only enter it by crossing
+	// the outer ring, or an inner ring when it starts inside a hole
+	bool SegmentCrossesPolygon(const ZoneIndex::TPoint &inFrom, const ZoneIndex::TPoint &inTo, const ZoneIndex::TPolygon &inPolygon)
+	{
+		if (SegmentCrossesRing(inFrom, inTo, inPolygon.outer()))
+		{
+			return true;
+		}
+		for (size_t i = 0; i < inPolygon.inners().size(); i++)
+		{
+			if (SegmentCrossesRing(inFrom, inTo, inPolygon.inners()[i]))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+ZoneIndex::ZoneIndex()
+{
+}
+
+ZoneIndex::~ZoneIndex()
+{
+}
+
+void ZoneIndex::SetZones(const TZoneList &inZones)
+{
+	boost::shared_ptr<TIndex> aIndex(new TIndex());
+	aIndex->zones = inZones;
+
+	std::vector<TIndexValue> aValues;
+	aValues.reserve(aIndex->zones.size());
+	for (size_t i = 0; i < aIndex->zones.size(); i++)
+	{
+		// SVG polygons come in either winding and may be left open
+		bg::correct(aIndex->zones[i].polygon);
+		aValues.push_back(std::make_pair(bg::return_envelope<TBox>(aIndex->zones[i].polygon), i));
+	}
+	// Bulk loading packs the tree far better than inserting one at a time
+	aIndex->tree = TRTree(aValues.begin(), aValues.end());
+
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	fIndex = aIndex;
+}
+
+size_t ZoneIndex::ZoneCount() const
+{
+	boost::shared_ptr<const TIndex> aIndex = Snapshot();
+	return (aIndex ? aIndex->zones.size() : 0);
+}
+
+boost::shared_ptr<const ZoneIndex::TIndex> ZoneIndex::Snapshot() const
+{
+	boost::lock_guard<boost::mutex> aLock(fMutex);
+	return fIndex;
+}
+
+bool ZoneIndex::Validate(const TPointList &inPointList, TViolationList &outViolations, const size_t &inMaxViolations) const
+{
+	outViolations.clear();
+	boost::shared_ptr<const TIndex> aIndex = Snapshot();
+	if (!aIndex || aIndex->zones.empty() || inPointList.empty())
+	{
+		return true;
+	}
+
+	// EA point lists are dense, so the tree is queried once per run of legs
+	// and the points and legs of the run are only tested against the zones
+	// that run can reach. Most runs hit nothing and cost a single query.
+	const size_t kLegsPerQuery = 16;
+	bool aValid = true;
+	std::vector<TIndexValue> aCandidates;
+	std::vector<bool> aInside(inPointList.size(), false);
+	size_t aLast = inPointList.size() - 1;
+	for (size_t aStart = 0; aStart <= aLast; aStart += kLegsPerQuery)
+	{
+		size_t aEnd = std::min(aStart + kLegsPerQuery, aLast);
+		TBox aEnvelope;
+		bg::assign_inverse(aEnvelope);
+		for (size_t i = aStart; i <= aEnd; i++)
+		{
+			bg::expand(aEnvelope, TPoint(inPointList[i].x, inPointList[i].y));
+		}
+		if (!aValid && outViolations.size() >= inMaxViolations)
+		{
+			break;
+		}
+		aCandidates.clear();
+		aIndex->tree.query(bgi::intersects(aEnvelope), std::back_inserter(aCandidates));
+		if (aCandidates.empty())
+		{
+			continue;
+		}
+
+		// The first point of a run was tested as the last point of the one before
+		for (size_t i = (aStart ? aStart + 1 : 0); i <= aEnd; i++)
+		{
+			TPoint aPoint(inPointList[i].x, inPointList[i].y);
+			for (std::vector<TIndexValue>::const_iterator aIter = aCandidates.begin(); aIter != aCandidates.end(); aIter++)
+			{
+				const TZone &aZone = aIndex->zones[aIter->second];
+				if (bg::covered_by(aPoint, aIter->first) && bg::covered_by(aPoint, aZone.polygon))
+				{
+					aValid = false;
+					aInside[i] = true;
+					if (outViolations.size() < inMaxViolations)
+					{
+						TViolation aViolation = {i, false, aZone.id};
+						outViolations.push_back(aViolation);
+					}
+					break;
+				}
+			}
+		}
+
+		for (size_t i = aStart + 1; i <= aEnd; i++)
+		{
+			// A leg touching a zone at an endpoint has already been reported
+			if (aInside[i - 1] || aInside[i])
+			{
+				continue;
+			}
+			TPoint aFrom(inPointList[i - 1].x, inPointList[i - 1].y);
+			TPoint aTo(inPointList[i].x, inPointList[i].y);
+			TBox aLegEnvelope = bg::return_envelope<TBox>(TSegment(aFrom, aTo));
+			for (std::vector<TIndexValue>::const_iterator aIter = aCandidates.begin(); aIter != aCandidates.end(); aIter++)
+			{
+				const TZone &aZone = aIndex->zones[aIter->second];
+				if (bg::intersects(aLegEnvelope, aIter->first) && SegmentCrossesPolygon(aFrom, aTo, aZone.polygon))
+				{
+					aValid = false;
+					if (outViolations.size() < inMaxViolations)
+					{
+						TViolation aViolation = {i - 1, true, aZone.id};
+						outViolations.push_back(aViolation);
+					}
+					break;
+				}
+			}
+		}
+	}
+	return aValid;
+}
@@ -0,0 +1,156 @@
+/*
+ * test_alloc_budget.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "ea_connector.hpp"
+#include "ros_connector.hpp"
+#include "alloc_accounting.hpp"
+#ifdef EM_PROTOBUF
+#include "robot_commands.pb.h"
+#endif
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+namespace
+{
+	// Warm-up messages fill the buffer pool and arenas before counting starts
+	const int kWarmUpMessages = 16;
+	const int kMeasuredMessages = 200;
+
+	// The bench's timed lawnmower point list, kBudgetPoints long
+	double_t PointX(const size_t &i) { return (i / 10) * 2.0; }
+	double_t PointY(const size_t &i) { return ((i / 10) % 2 ? 9 - i % 10 : i % 10) * 1.5; }
+
+	std::string PointListXml()
+	{
+		std::stringstream ss;
+		ss << "<robot><map><point_list><id>1</id>";
+		for (size_t i = 0; i < AllocAccounting::kBudgetPoints; i++)
+		{
+			ss << "<point>" << PointX(i) << "," << PointY(i) << ",0.8,0.4," << i * 2.5 << "</point>";
+		}
+		ss << "</point_list></map></robot>\n";
+		return ss.str();
+	}
+}
+
+class AllocBudgetTest : public ::testing::Test
+{
+protected:
+	static void SetUpTestCase()
+	{
+		rclcpp::init(0, NULL);
+	}
+
+	static void TearDownTestCase()
+	{
+		rclcpp::shutdown();
+	}
+
+	AllocBudgetTest() : fEAConnector(fIoContext, "127.0.0.1", 0, "127.0.0.1")
+	{
+		fEAConnector.fMessageInterchange = &fMessageInterchange;
+		fRosConnector.Start(&fMessageInterchange, true);
+	}
+
+	// One EA read holding a whole frame, through framing, conversion and the
+	// ROS side, with the replies collected as the io thread would
+	void RunMessagePath(std::string &inBuffer)
+	{
+		std::size_t aProcessed = 0;
+		fEAConnector.HandleAsyncRead(inBuffer, aProcessed, LatencyTracer::Now());
+		DrainReplies();
+	}
+
+#ifdef EM_PROTOBUF
+	void RunCommandPath(std::string &inPayload)
+	{
+		EAFrame::THeader aHeader;
+		aHeader.type = EAFrame::kFrameProtobuf;
+		aHeader.length = static_cast<uint32_t>(inPayload.size());
+		aHeader.sequence = 1;
+		fEAConnector.HandleFrame(aHeader, &inPayload[0], LatencyTracer::Now());
+		DrainReplies();
+	}
+#endif
+
+	void DrainReplies()
+	{
+		TMessageBufferPtr aReply;
+		while (fMessageInterchange.GetNextMessageForEA(aReply))
+		{
+		}
+	}
+
+	template <typename TFunction>
+	void ExpectWithinBudget(TFunction inFunction)
+	{
+		for (int i = 0; i < kWarmUpMessages; i++)
+		{
+			inFunction();
+		}
+		AllocAccounting::TAllocCounts aBefore, aAfter;
+		AllocAccounting::Snapshot(aBefore);
+		for (int i = 0; i < kMeasuredMessages; i++)
+		{
+			inFunction();
+		}
+		AllocAccounting::Snapshot(aAfter);
+		for (int i = 0; i < AllocAccounting::kAllocStageCount; i++)
+		{
+			double aPerMessage = static_cast<double>(aAfter.allocations[i] - aBefore.allocations[i]) / kMeasuredMessages;
+			EXPECT_LE(aPerMessage, AllocAccounting::kMessageBudget[i])
+				<< "stage " << AllocAccounting::StageName(static_cast<AllocAccounting::TAllocStage>(i));
+		}
+	}
+
+	boost::asio::io_context fIoContext;
+	MessageInterchange fMessageInterchange;
+	EAConnector fEAConnector;
+	RosConnector fRosConnector;
+};
+
+TEST_F(AllocBudgetTest, AllocationsAreChargedToTheirStage)
+{
+	ASSERT_TRUE(AllocAccounting::Enabled());
+	AllocAccounting::TAllocCounts aBefore, aAfter;
+	AllocAccounting::Snapshot(aBefore);
+	{
+		EM_ALLOC_STAGE(AllocAccounting::kAllocDispatch);
+		// A new expression could be elided, a call to operator new cannot
+		void *volatile aBlock = ::operator new(16);
+		::operator delete(aBlock);
+	}
+	AllocAccounting::Snapshot(aAfter);
+	EXPECT_EQ(aBefore.allocations[AllocAccounting::kAllocDispatch] + 1, aAfter.allocations[AllocAccounting::kAllocDispatch]);
+}
+
+TEST_F(AllocBudgetTest, PointListMessageWithinBudget)
+{
+	std::string aBuffer = PointListXml();
+	ExpectWithinBudget([&] { RunMessagePath(aBuffer); });
+}
+
+#ifdef EM_PROTOBUF
+TEST_F(AllocBudgetTest, PointListCommandWithinBudget)
+{
+	ats::base::RobotCommand aCommand;
+	ats::base::PointList *aList = aCommand.mutable_point_list();
+	aList->set_id(1);
+	for (size_t i = 0; i < AllocAccounting::kBudgetPoints; i++)
+	{
+		aList->add_x(PointX(i));
+		aList->add_y(PointY(i));
+		aList->add_v(0.8);
+		aList->add_a(0.4);
+		aList->add_t(i * 2.5);
+	}
+	std::string aPayload = aCommand.SerializeAsString();
+	ExpectWithinBudget([&] { RunCommandPath(aPayload); });
+}
+#endif
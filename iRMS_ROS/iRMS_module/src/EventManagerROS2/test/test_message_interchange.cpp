@@ -0,0 +1,106 @@
+/*
+ * test_message_interchange.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "message_interchange.hpp"
+
+#include <gtest/gtest.h>
+
+namespace
+{
+	const uint64_t kKeyA = MessageInterchange::MakeKey(MessageInterchange::kKeyPointList, 1);
+	const uint64_t kKeyB = MessageInterchange::MakeKey(MessageInterchange::kKeyPointList, 2);
+
+	void Send(MessageInterchange &ioInterchange, const std::string &inText, const uint64_t &inKey = 0, const MessageInterchange::TLane &inLane = MessageInterchange::kLaneMission)
+	{
+		LatencyTracer::TMessageTrace aTrace;
+		ASSERT_TRUE(ioInterchange.SendMessageToROS(BufferPool::Copy(inText), aTrace, inLane, inKey));
+	}
+
+	std::string Drain(MessageInterchange &ioInterchange)
+	{
+		std::string aOrder;
+		TMessageBufferPtr aMessage;
+		while (ioInterchange.GetNextMessageForROS(aMessage))
+		{
+			aOrder += (aOrder.empty() ? "" : " ") + aMessage->ToString();
+		}
+		return aOrder;
+	}
+}
+
+TEST(MessageInterchange, KeyedMessageSupersedesTheTail)
+{
+	MessageInterchange aInterchange;
+	Send(aInterchange, "A1", kKeyA);
+	Send(aInterchange, "A2", kKeyA);
+	Send(aInterchange, "A3", kKeyA);
+	EXPECT_EQ("A3", Drain(aInterchange));
+}
+
+TEST(MessageInterchange, KeyedMessageNeverOvertakes)
+{
+	// replace A, append to A, replace A: the append must apply to the first
+	// replace and the second replace come last
+	MessageInterchange aInterchange;
+	Send(aInterchange, "A1", kKeyA);
+	Send(aInterchange, "P");
+	Send(aInterchange, "A2", kKeyA);
+	EXPECT_EQ("A1 P A2", Drain(aInterchange));
+}
+
+TEST(MessageInterchange, OtherKeyEndsCoalescing)
+{
+	MessageInterchange aInterchange;
+	Send(aInterchange, "A1", kKeyA);
+	Send(aInterchange, "B1", kKeyB);
+	Send(aInterchange, "A2", kKeyA);
+	Send(aInterchange, "B2", kKeyB);
+	Send(aInterchange, "B3", kKeyB);
+	EXPECT_EQ("A1 B1 A2 B3", Drain(aInterchange));
+}
+
+TEST(MessageInterchange, DeliveredMessageIsNotSuperseded)
+{
+	MessageInterchange aInterchange;
+	Send(aInterchange, "A1", kKeyA);
+	EXPECT_EQ("A1", Drain(aInterchange));
+	Send(aInterchange, "A2", kKeyA);
+	Send(aInterchange, "A3", kKeyA);
+	EXPECT_EQ("A3", Drain(aInterchange));
+}
+
+TEST(MessageInterchange, ControlOvertakesMapLoadDoesNot)
+{
+	MessageInterchange aInterchange;
+	Send(aInterchange, "P1");
+	Send(aInterchange, "L", 0, MessageInterchange::kLaneBulk);
+	Send(aInterchange, "P2");
+	Send(aInterchange, "S", 0, MessageInterchange::kLaneControl);
+	EXPECT_EQ("S P1 L P2", Drain(aInterchange));
+}
+
+TEST(MessageInterchange, ControlConsumerTakesOnlyControl)
+{
+	MessageInterchange aInterchange;
+	Send(aInterchange, "P1");
+	Send(aInterchange, "L", 0, MessageInterchange::kLaneBulk);
+	Send(aInterchange, "S", 0, MessageInterchange::kLaneControl);
+	Send(aInterchange, "P2");
+
+	TMessageBufferPtr aMessage;
+	LatencyTracer::TMessageTrace aTrace;
+	ASSERT_TRUE(aInterchange.GetNextControlMessageForROS(aMessage, aTrace));
+	EXPECT_EQ("S", aMessage->ToString());
+	EXPECT_FALSE(aInterchange.GetNextControlMessageForROS(aMessage, aTrace));
+
+	std::string aOrder;
+	while (aInterchange.GetNextMissionMessageForROS(aMessage, aTrace))
+	{
+		aOrder += (aOrder.empty() ? "" : " ") + aMessage->ToString();
+	}
+	EXPECT_EQ("P1 L P2", aOrder);
+}
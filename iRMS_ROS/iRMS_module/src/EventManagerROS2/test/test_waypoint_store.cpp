@@ -0,0 +1,198 @@
+/*
+ * test_waypoint_store.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ */
+
+#include "waypoint_store.hpp"
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+	WaypointStore::TPatch MakeReplace(const uint64_t &inId, const uint64_t &inBaseVersion, const size_t &inPoints)
+	{
+		WaypointStore::TPatch aPatch;
+		aPatch.operation = WaypointStore::kPatchReplace;
+		aPatch.id = inId;
+		aPatch.base_version = inBaseVersion;
+		aPatch.points.resize(inPoints);
+		for (size_t i = 0; i < inPoints; i++)
+		{
+			aPatch.points[i].x = i;
+		}
+		return aPatch;
+	}
+
+	// inPoints points with x from inFirstX upwards
+	WaypointStore::TPatch MakePatch(const WaypointStore::TPatchOperation &inOperation, const uint64_t &inId, const size_t &inIndex, const size_t &inCount, const size_t &inPoints, const double_t &inFirstX)
+	{
+		WaypointStore::TPatch aPatch;
+		aPatch.operation = inOperation;
+		aPatch.id = inId;
+		aPatch.index = inIndex;
+		aPatch.count = inCount;
+		aPatch.points.resize(inPoints);
+		for (size_t i = 0; i < inPoints; i++)
+		{
+			aPatch.points[i].x = inFirstX + i;
+		}
+		return aPatch;
+	}
+
+	std::vector<double_t> PointXs(const WaypointStore &inStore, const uint64_t &inId)
+	{
+		std::vector<double_t> aXs;
+		WaypointStore::TSnapshot aSnapshot;
+		uint64_t aVersion;
+		if (inStore.Snapshot(inId, aSnapshot, aVersion))
+		{
+			for (TPointList::const_iterator aIter = aSnapshot->begin(); aIter != aSnapshot->end(); aIter++)
+			{
+				aXs.push_back(aIter->x);
+			}
+		}
+		return aXs;
+	}
+}
+
+TEST(WaypointStore, ReplaceCreatesList)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	EXPECT_EQ(1u, aStore.Version(1));
+	EXPECT_EQ(3u, aStore.Size(1));
+}
+
+TEST(WaypointStore, ReplaceOfUnknownListAgainstBaseVersionLeavesNoEntry)
+{
+	WaypointStore aStore;
+	std::string aError;
+	EXPECT_FALSE(aStore.Apply(MakeReplace(1, 4, 3), aError));
+	EXPECT_FALSE(aError.empty());
+
+	WaypointStore::TSnapshot aSnapshot;
+	uint64_t aVersion;
+	EXPECT_FALSE(aStore.Snapshot(1, aSnapshot, aVersion));
+	EXPECT_EQ(0u, aStore.Version(1));
+	EXPECT_EQ(0u, aStore.Size(1));
+
+	// Patches against the rejected list still see an unknown list
+	WaypointStore::TPatch aAppend;
+	aAppend.operation = WaypointStore::kPatchAppend;
+	aAppend.id = 1;
+	aAppend.points.resize(1);
+	EXPECT_FALSE(aStore.Apply(aAppend, aError));
+	EXPECT_EQ("unknown point list", aError);
+}
+
+TEST(WaypointStore, ReplaceChecksBaseVersion)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	EXPECT_FALSE(aStore.Apply(MakeReplace(1, 2, 5), aError));
+	EXPECT_EQ(3u, aStore.Size(1));
+	EXPECT_TRUE(aStore.Apply(MakeReplace(1, 1, 5), aError));
+	EXPECT_EQ(2u, aStore.Version(1));
+	EXPECT_EQ(5u, aStore.Size(1));
+}
+
+TEST(WaypointStore, SnapshotSurvivesPatch)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	WaypointStore::TSnapshot aSnapshot;
+	uint64_t aVersion;
+	ASSERT_TRUE(aStore.Snapshot(1, aSnapshot, aVersion));
+
+	WaypointStore::TPatch aDelete;
+	aDelete.operation = WaypointStore::kPatchDelete;
+	aDelete.id = 1;
+	aDelete.index = 0;
+	aDelete.count = 2;
+	ASSERT_TRUE(aStore.Apply(aDelete, aError));
+	EXPECT_EQ(1u, aStore.Size(1));
+	EXPECT_EQ(3u, aSnapshot->size());
+}
+
+TEST(WaypointStore, AppendAddsToTheEnd)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	// Index and count mean nothing to an append
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchAppend, 1, 99, 99, 2, 10), aError));
+	EXPECT_EQ(2u, aStore.Version(1));
+	EXPECT_EQ(std::vector<double_t>({0, 1, 2, 10, 11}), PointXs(aStore, 1));
+}
+
+TEST(WaypointStore, InsertAtStartMiddleAndEnd)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchInsert, 1, 0, 0, 1, 10), aError));
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchInsert, 1, 2, 0, 2, 20), aError));
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchInsert, 1, 6, 0, 1, 30), aError));
+	EXPECT_EQ(4u, aStore.Version(1));
+	EXPECT_EQ(std::vector<double_t>({10, 0, 20, 21, 1, 2, 30}), PointXs(aStore, 1));
+}
+
+TEST(WaypointStore, InsertPastTheEndIsRejected)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchInsert, 1, 4, 0, 1, 10), aError));
+	EXPECT_FALSE(aError.empty());
+	EXPECT_EQ(1u, aStore.Version(1));
+	EXPECT_EQ(std::vector<double_t>({0, 1, 2}), PointXs(aStore, 1));
+}
+
+TEST(WaypointStore, ReplaceRangeGrowsAndShrinks)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 4), aError));
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 1, 1, 3, 10), aError));
+	EXPECT_EQ(std::vector<double_t>({0, 10, 11, 12, 2, 3}), PointXs(aStore, 1));
+	ASSERT_TRUE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 2, 4, 1, 20), aError));
+	EXPECT_EQ(std::vector<double_t>({0, 10, 20}), PointXs(aStore, 1));
+	EXPECT_EQ(3u, aStore.Version(1));
+}
+
+TEST(WaypointStore, OutOfRangeIndicesAreRejected)
+{
+	WaypointStore aStore;
+	std::string aError;
+	ASSERT_TRUE(aStore.Apply(MakeReplace(1, 0, 3), aError));
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 2, 2, 1, 10), aError));
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 4, 0, 1, 10), aError));
+	// An index large enough to wrap index + count must not slip through
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 1, SIZE_MAX, 1, 10), aError));
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchDelete, 1, 3, 1, 0, 0), aError));
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchDelete, 1, SIZE_MAX, 1, 0, 0), aError));
+	EXPECT_EQ(1u, aStore.Version(1));
+	EXPECT_EQ(std::vector<double_t>({0, 1, 2}), PointXs(aStore, 1));
+
+	// The window the zone check sees is rejected the same way
+	TPointList aWindow;
+	size_t aWindowStart;
+	EXPECT_FALSE(aStore.PatchWindow(MakePatch(WaypointStore::kPatchInsert, 1, 4, 0, 1, 10), aWindow, aWindowStart, aError));
+}
+
+TEST(WaypointStore, PatchOfUnknownListIsRejected)
+{
+	WaypointStore aStore;
+	std::string aError;
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchInsert, 1, 0, 0, 1, 10), aError));
+	EXPECT_EQ("unknown point list", aError);
+	EXPECT_FALSE(aStore.Apply(MakePatch(WaypointStore::kPatchReplaceRange, 1, 0, 0, 1, 10), aError));
+	EXPECT_EQ(0u, aStore.Size(1));
+}
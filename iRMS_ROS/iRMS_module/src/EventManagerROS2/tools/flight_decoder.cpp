@@ -0,0 +1,277 @@
+/*
+ * flight_decoder.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ *
+ * Prints the entries of a flight recorder file, either the live ring the
+ * bridge maps or a dump written on SIGUSR1 or a crash, oldest first.
+ */
+
+#include "flight_recorder.hpp"
+#include "latency_tracer.hpp"
+
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace
+{
+	const char *EntryTypeName(const uint32_t &inType)
+	{
+		switch (inType)
+		{
+		case FlightRecorder::kEntryInbound:
+			return "inbound";
+		case FlightRecorder::kEntryOutbound:
+			return "outbound";
+		case FlightRecorder::kEntryGoalSent:
+			return "goal_sent";
+		case FlightRecorder::kEntryGoalAccepted:
+			return "goal_accepted";
+		case FlightRecorder::kEntryGoalRejected:
+			return "goal_rejected";
+		case FlightRecorder::kEntryTrace:
+			return "trace";
+		case FlightRecorder::kEntryGoalCanceled:
+			return "goal_canceled";
+		}
+		return "unknown";
+	}
+
+	// Control characters are escaped so that every entry stays on one line
+	std::string Escape(const char *inData, const std::size_t &inLength)
+	{
+		std::string aText;
+		aText.reserve(inLength);
+		for (std::size_t i = 0; i < inLength; i++)
+		{
+			unsigned char aChar = inData[i];
+			if (aChar == '\\')
+			{
+				aText += "\\\\";
+			}
+			else if (aChar == '\n')
+			{
+				aText += "\\n";
+			}
+			else if (aChar == '\r')
+			{
+				aText += "\\r";
+			}
+			else if (aChar == '\t')
+			{
+				aText += "\\t";
+			}
+			else if (aChar < 0x20 || aChar == 0x7f)
+			{
+				char aHex[8];
+				snprintf(aHex, sizeof(aHex), "\\x%02x", aChar);
+				aText += aHex;
+			}
+			else
+			{
+				aText += aChar;
+			}
+		}
+		return aText;
+	}
+
+	// Time from each stamped stage to the next, in µs
+	std::string FormatStamps(const uint64_t *inStamps)
+	{
+		std::string aText;
+		uint64_t aFirst = 0;
+		uint64_t aPrevious = 0;
+		for (int i = 0; i < LatencyTracer::kStageCount; i++)
+		{
+			if (!inStamps[i])
+			{
+				continue;
+			}
+			char aStage[64];
+			if (!aPrevious)
+			{
+				aFirst = inStamps[i];
+				snprintf(aStage, sizeof(aStage), "%s", LatencyTracer::StageName(static_cast<LatencyTracer::TStage>(i)));
+			}
+			else
+			{
+				snprintf(aStage, sizeof(aStage), " %s=+%.1f", LatencyTracer::StageName(static_cast<LatencyTracer::TStage>(i)),
+					(static_cast<double>(inStamps[i]) - static_cast<double>(aPrevious)) / 1000.0);
+			}
+			aText += aStage;
+			aPrevious = inStamps[i];
+		}
+		if (aPrevious != aFirst)
+		{
+			char aTotal[48];
+			snprintf(aTotal, sizeof(aTotal), " total=%.1fus", (aPrevious - aFirst) / 1000.0);
+			aText += aTotal;
+		}
+		return aText;
+	}
+
+	std::string FormatTime(const uint64_t &inNanoseconds)
+	{
+		time_t aSeconds = inNanoseconds / 1000000000ull;
+		struct tm aTime;
+		gmtime_r(&aSeconds, &aTime);
+		char aStamp[64];
+		strftime(aStamp, sizeof(aStamp), "%Y-%m-%dT%H:%M:%S", &aTime);
+		char aText[96];
+		snprintf(aText, sizeof(aText), "%s.%06uZ", aStamp, static_cast<unsigned>((inNanoseconds % 1000000000ull) / 1000));
+		return aText;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("file", po::value<std::string>(), "set flight recorder file or dump to decode")
+		("last", po::value<uint32_t>()->default_value(0), "set how many of the most recent entries to print, 0 prints all")
+		("type", po::value<std::string>(), "set entry type to print: inbound, outbound, goal_sent, goal_accepted, goal_rejected, trace or goal_canceled");
+
+	po::positional_options_description aPositional;
+	aPositional.add("file", 1);
+
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).positional(aPositional).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || !vm.count("file")) {
+		std::cout << desc << "\n";
+		return 1;
+	}
+
+	std::string aPath = vm["file"].as<std::string>();
+	std::ifstream aFile(aPath.c_str(), std::ios::binary);
+	std::vector<char> aData((std::istreambuf_iterator<char>(aFile)), std::istreambuf_iterator<char>());
+	if (aData.size() < sizeof(FlightRecorder::THeader))
+	{
+		std::cerr << aPath << " is not a flight recorder file" << std::endl;
+		return 1;
+	}
+
+	// The atomics in the layout are read as plain integers
+	uint64_t aMagic = 0;
+	uint32_t aSlotSize = 0;
+	uint32_t aSlotCount = 0;
+	memcpy(&aMagic, &aData[offsetof(FlightRecorder::THeader, magic)], sizeof(aMagic));
+	memcpy(&aSlotSize, &aData[offsetof(FlightRecorder::THeader, slot_size)], sizeof(aSlotSize));
+	memcpy(&aSlotCount, &aData[offsetof(FlightRecorder::THeader, slot_count)], sizeof(aSlotCount));
+	if (aMagic != FlightRecorder::kMagic || aSlotSize != sizeof(FlightRecorder::TSlot))
+	{
+		std::cerr << aPath << " is not a flight recorder file of this version" << std::endl;
+		return 1;
+	}
+	if (aData.size() < sizeof(FlightRecorder::THeader) + static_cast<std::size_t>(aSlotCount) * aSlotSize)
+	{
+		std::cerr << aPath << " is truncated" << std::endl;
+		return 1;
+	}
+
+	uint32_t aType = 0;
+	if (vm.count("type"))
+	{
+		std::string aName = vm["type"].as<std::string>();
+		for (uint32_t i = FlightRecorder::kEntryInbound; i <= FlightRecorder::kEntryGoalCanceled; i++)
+		{
+			if (aName == EntryTypeName(i))
+			{
+				aType = i;
+			}
+		}
+		if (!aType)
+		{
+			std::cerr << "unknown entry type " << aName << std::endl;
+			return 1;
+		}
+	}
+
+	// Slots still being written (odd) or never written (0) are skipped
+	typedef std::pair<uint64_t, const char *> TEntry;
+	std::vector<TEntry> aEntries;
+	const char *aSlots = &aData[sizeof(FlightRecorder::THeader)];
+	for (uint32_t i = 0; i < aSlotCount; i++)
+	{
+		const char *aSlot = aSlots + static_cast<std::size_t>(i) * aSlotSize;
+		uint64_t aSequence = 0;
+		memcpy(&aSequence, aSlot + offsetof(FlightRecorder::TSlot, sequence), sizeof(aSequence));
+		if (aSequence && !(aSequence & 1))
+		{
+			aEntries.push_back(TEntry(aSequence, aSlot));
+		}
+	}
+	std::sort(aEntries.begin(), aEntries.end());
+
+	if (aType)
+	{
+		std::vector<TEntry> aMatching;
+		for (std::vector<TEntry>::iterator aIter = aEntries.begin(); aIter != aEntries.end(); aIter++)
+		{
+			uint32_t aEntryType = 0;
+			memcpy(&aEntryType, aIter->second + offsetof(FlightRecorder::TSlot, type), sizeof(aEntryType));
+			if (aEntryType == aType)
+			{
+				aMatching.push_back(*aIter);
+			}
+		}
+		aEntries.swap(aMatching);
+	}
+
+	uint32_t aLast = vm["last"].as<uint32_t>();
+	std::vector<TEntry>::iterator aBegin = aEntries.begin();
+	if (aLast && aLast < aEntries.size())
+	{
+		aBegin = aEntries.end() - aLast;
+	}
+
+	for (std::vector<TEntry>::iterator aIter = aBegin; aIter != aEntries.end(); aIter++)
+	{
+		const char *aSlot = aIter->second;
+		uint64_t aTimestamp = 0;
+		uint32_t aEntryType = 0;
+		uint32_t aLength = 0;
+		uint32_t aStored = 0;
+		uint64_t aStamps[LatencyTracer::kStageCount];
+		memcpy(&aTimestamp, aSlot + offsetof(FlightRecorder::TSlot, timestamp), sizeof(aTimestamp));
+		memcpy(&aEntryType, aSlot + offsetof(FlightRecorder::TSlot, type), sizeof(aEntryType));
+		memcpy(&aLength, aSlot + offsetof(FlightRecorder::TSlot, length), sizeof(aLength));
+		memcpy(&aStored, aSlot + offsetof(FlightRecorder::TSlot, stored), sizeof(aStored));
+		memcpy(aStamps, aSlot + offsetof(FlightRecorder::TSlot, stamps), sizeof(aStamps));
+		aStored = std::min<uint32_t>(aStored, sizeof(FlightRecorder::TSlot::data));
+
+		std::cout << (aIter->first / 2 - 1) << " " << FormatTime(aTimestamp) << " " << EntryTypeName(aEntryType);
+		if (aLength)
+		{
+			std::cout << " " << aLength << " bytes";
+			if (aStored < aLength)
+			{
+				std::cout << " (truncated to " << aStored << ")";
+			}
+		}
+		std::string aStages = FormatStamps(aStamps);
+		if (!aStages.empty())
+		{
+			std::cout << " [" << aStages << "]";
+		}
+		if (aStored)
+		{
+			std::cout << " " << Escape(aSlot + offsetof(FlightRecorder::TSlot, data), aStored);
+		}
+		std::cout << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,479 @@
+/*
+ * load_generator.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ *
+ * Stands in for one or many Event Manager clients. Each session sends
+ * point_list traffic, optionally mixed with start and load_map commands,
+ * at a fixed rate and reports how much the bridge absorbed and how long
+ * point lists took to be acknowledged with point_list_status. With --framed
+ * every frame carries an EAFrame header instead of relying on </robot>.
+ * Sessions connect over TCP, or over AF_UNIX with --local; with --shm the
+ * frames go through the bridge's shared memory ring and the socket only
+ * carries the replies.
+ */
+
+#include "ea_frame.hpp"
+#include "shm_ring.hpp"
+
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace po = boost::program_options;
+
+namespace
+{
+	typedef std::chrono::steady_clock TClock;
+
+	// Point list ids are session * kIdStride + sequence, acks are broadcast to
+	// every session so only the owner of an id counts it
+	const uint64_t kIdStride = 1000000000ull;
+
+	typedef struct SLoadOptions
+	{
+		std::string address;
+		uint16_t port;
+		uint32_t sessions;
+		double rate;				// writes per second per session, 0 = back to back
+		double duration;			// seconds of sending
+		uint32_t points;			// points per point_list
+		uint32_t pipeline;			// frames per write
+		uint32_t split;				// segments each write is cut into
+		uint32_t split_delay_us;	// pause between segments
+		uint32_t start_every;		// start after every N point lists, 0 = never
+		uint32_t load_map_every;	// load_map after every N point lists, 0 = never
+		bool framed;				// length prefixed rather than sentinel framing
+	} TLoadOptions;
+
+	typedef struct SLoadStats
+	{
+		SLoadStats() : frames(0), bytes(0), point_lists(0), acks(0), rejected(0) {}
+		uint64_t frames;
+		uint64_t bytes;
+		uint64_t point_lists;
+		uint64_t acks;
+		uint64_t rejected;
+		std::vector<double> ack_latency_us;
+	} TLoadStats;
+
+	bool ExtractElement(const std::string &inFrame, const std::string &inName, std::string &outValue)
+	{
+		std::string aOpen = "<" + inName + ">";
+		std::size_t aStart = inFrame.find(aOpen);
+		if (aStart == std::string::npos)
+		{
+			return false;
+		}
+		aStart += aOpen.size();
+		std::size_t aEnd = inFrame.find("</" + inName + ">", aStart);
+		if (aEnd == std::string::npos)
+		{
+			return false;
+		}
+		outValue = inFrame.substr(aStart, aEnd - aStart);
+		return true;
+	}
+
+	double Percentile(std::vector<double> &inValues, const double &inQuantile)
+	{
+		if (inValues.empty())
+		{
+			return 0;
+		}
+		std::size_t aIndex = std::min(inValues.size() - 1, static_cast<std::size_t>(inQuantile * inValues.size()));
+		std::nth_element(inValues.begin(), inValues.begin() + aIndex, inValues.end());
+		return inValues[aIndex];
+	}
+}
+
+class LoadSession : public std::enable_shared_from_this<LoadSession>
+{
+public:
+	LoadSession(boost::asio::io_context &inIoContext, const TLoadOptions &inOptions, const uint32_t &inIndex, TLoadStats &inStats, ShmRing *inRing) :
+		fSocket(inIoContext),
+		fTimer(inIoContext),
+		fOptions(inOptions),
+		fIndex(inIndex),
+		fStats(inStats),
+		fSequence(0),
+		fLastListId(0),
+		fSegment(0),
+		fFrameSequence(0),
+		fRing(inRing),
+		fRingOffset(0)
+	{
+	}
+
+	void Start(const boost::asio::generic::stream_protocol::endpoint &inEndpoint, const TClock::time_point &inDeadline)
+	{
+		fDeadline = inDeadline;
+		auto self(shared_from_this());
+		fSocket.async_connect(inEndpoint, [this, self](boost::system::error_code ec)
+		{
+			if (ec)
+			{
+				std::cerr << "session " << fIndex << ": " << ec.message() << std::endl;
+				return;
+			}
+			// Keep split segments as separate TCP segments, fails harmlessly on AF_UNIX
+			boost::system::error_code aError;
+			fSocket.set_option(boost::asio::ip::tcp::no_delay(true), aError);
+			fNextWrite = TClock::now();
+			DoRead();
+			DoSend();
+		});
+	}
+
+	void Close()
+	{
+		boost::system::error_code ec;
+		fTimer.cancel();
+		fSocket.close(ec);
+	}
+private:
+	void AppendFrame(std::string &outBuffer, const std::string &inXml)
+	{
+		if (fOptions.framed || fRing)
+		{
+			EAFrame::THeader aHeader;
+			aHeader.type = EAFrame::kFrameXml;
+			aHeader.length = static_cast<uint32_t>(inXml.size());
+			aHeader.sequence = ++fFrameSequence;
+			unsigned char aBytes[EAFrame::kHeaderSize];
+			EAFrame::Encode(aHeader, aBytes);
+			outBuffer.append(reinterpret_cast<const char *>(aBytes), sizeof(aBytes));
+		}
+		outBuffer += inXml;
+	}
+
+	void AppendPointList(std::string &outBuffer)
+	{
+		uint64_t aId = fIndex * kIdStride + ++fSequence;
+		std::stringstream ss;
+		ss << "<robot><map><point_list><id>" << aId << "</id>";
+		for (uint32_t i = 0; i < fOptions.points; i++)
+		{
+			ss << "<point>" << (i / 10) * 2.0 << "," << ((i / 10) % 2 ? 9 - i % 10 : i % 10) * 1.5 << "</point>";
+		}
+		ss << "</point_list></map></robot>";
+		AppendFrame(outBuffer, ss.str());
+		fSent[aId] = TClock::now();
+		fLastListId = aId;
+		fStats.point_lists++;
+		fStats.frames++;
+
+		if (fOptions.start_every && fSequence % fOptions.start_every == 0)
+		{
+			AppendFrame(outBuffer, "<robot><start><point_list_id>" + std::to_string(fLastListId) + "</point_list_id></start></robot>");
+			fStats.frames++;
+		}
+		if (fOptions.load_map_every && fSequence % fOptions.load_map_every == 0)
+		{
+			AppendFrame(outBuffer, "<robot><load_map>1</load_map></robot>");
+			fStats.frames++;
+		}
+	}
+
+	void DoSend()
+	{
+		if (TClock::now() >= fDeadline)
+		{
+			return;
+		}
+		fWriteBuffer.clear();
+		for (uint32_t i = 0; i < std::max<uint32_t>(fOptions.pipeline, 1); i++)
+		{
+			AppendPointList(fWriteBuffer);
+		}
+		fSegment = 0;
+		fRingOffset = 0;
+		if (fRing)
+		{
+			DoWriteRing();
+			return;
+		}
+		DoWriteSegment();
+	}
+
+	// Frames go into the ring one at a time, waiting while it is full
+	void DoWriteRing()
+	{
+		while (fRingOffset < fWriteBuffer.size())
+		{
+			EAFrame::THeader aHeader;
+			EAFrame::Decode(reinterpret_cast<const unsigned char *>(fWriteBuffer.data() + fRingOffset), aHeader);
+			if (!fRing->Write(aHeader, fWriteBuffer.data() + fRingOffset + EAFrame::kHeaderSize))
+			{
+				auto self(shared_from_this());
+				fTimer.expires_after(std::chrono::microseconds(50));
+				fTimer.async_wait([this, self](boost::system::error_code ec)
+				{
+					if (!ec)
+					{
+						DoWriteRing();
+					}
+				});
+				return;
+			}
+			fRingOffset += EAFrame::kHeaderSize + aHeader.length;
+			fStats.bytes += EAFrame::kHeaderSize + aHeader.length;
+		}
+		ScheduleSend();
+	}
+
+	void DoWriteSegment()
+	{
+		uint32_t aSegments = std::max<uint32_t>(fOptions.split, 1);
+		std::size_t aSegmentSize = (fWriteBuffer.size() + aSegments - 1) / aSegments;
+		std::size_t aOffset = fSegment * aSegmentSize;
+		std::size_t aLength = std::min(aSegmentSize, fWriteBuffer.size() - aOffset);
+
+		auto self(shared_from_this());
+		boost::asio::async_write(fSocket, boost::asio::buffer(fWriteBuffer.data() + aOffset, aLength),
+			[this, self, aSegments](boost::system::error_code ec, std::size_t length)
+			{
+				if (ec)
+				{
+					std::cerr << "session " << fIndex << ": " << ec.message() << std::endl;
+					return;
+				}
+				fStats.bytes += length;
+				if (++fSegment < aSegments)
+				{
+					fTimer.expires_after(std::chrono::microseconds(fOptions.split_delay_us));
+					fTimer.async_wait([this, self](boost::system::error_code ec)
+					{
+						if (!ec)
+						{
+							DoWriteSegment();
+						}
+					});
+					return;
+				}
+				ScheduleSend();
+			});
+	}
+
+	void ScheduleSend()
+	{
+		if (fOptions.rate <= 0)
+		{
+			DoSend();
+			return;
+		}
+		fNextWrite += std::chrono::duration_cast<TClock::duration>(std::chrono::duration<double>(1.0 / fOptions.rate));
+		auto self(shared_from_this());
+		fTimer.expires_at(fNextWrite);
+		fTimer.async_wait([this, self](boost::system::error_code ec)
+		{
+			if (!ec)
+			{
+				DoSend();
+			}
+		});
+	}
+
+	void DoRead()
+	{
+		auto self(shared_from_this());
+		fSocket.async_read_some(boost::asio::buffer(fReadChunk), [this, self](boost::system::error_code ec, std::size_t length)
+		{
+			if (ec)
+			{
+				return;
+			}
+			fReadBuffer.append(fReadChunk, length);
+			HandleReplies();
+			DoRead();
+		});
+	}
+
+	bool NextReply(std::string &outFrame)
+	{
+		// A session that has only used the ring has not sent a frame header,
+		// so the bridge answers it with plain XML
+		if (!fOptions.framed || fRing)
+		{
+			std::size_t aEnd = fReadBuffer.find("</robot>");
+			if (aEnd == std::string::npos)
+			{
+				return false;
+			}
+			outFrame = fReadBuffer.substr(0, aEnd);
+			fReadBuffer.erase(0, aEnd + 8);
+			return true;
+		}
+		EAFrame::THeader aHeader;
+		if (fReadBuffer.size() < EAFrame::kHeaderSize)
+		{
+			return false;
+		}
+		if (!EAFrame::Decode(reinterpret_cast<const unsigned char *>(fReadBuffer.data()), aHeader))
+		{
+			std::cerr << "session " << fIndex << ": invalid frame header from the bridge" << std::endl;
+			Close();
+			return false;
+		}
+		if (fReadBuffer.size() - EAFrame::kHeaderSize < aHeader.length)
+		{
+			return false;
+		}
+		outFrame = fReadBuffer.substr(EAFrame::kHeaderSize, aHeader.length);
+		fReadBuffer.erase(0, EAFrame::kHeaderSize + aHeader.length);
+		return true;
+	}
+
+	void HandleReplies()
+	{
+		TClock::time_point aNow = TClock::now();
+		std::string aFrame;
+		while (NextReply(aFrame))
+		{
+			std::string aIdString;
+			if (aFrame.find("<point_list_status>") == std::string::npos || !ExtractElement(aFrame, "id", aIdString))
+			{
+				continue;
+			}
+			uint64_t aId = std::strtoull(aIdString.c_str(), NULL, 10);
+			std::map<uint64_t, TClock::time_point>::iterator aSent = fSent.find(aId);
+			if (aId / kIdStride != fIndex || aSent == fSent.end())
+			{
+				continue;
+			}
+			fStats.acks++;
+			std::string aResult;
+			if (ExtractElement(aFrame, "result", aResult) && aResult != "accepted")
+			{
+				fStats.rejected++;
+			}
+			fStats.ack_latency_us.push_back(std::chrono::duration<double, std::micro>(aNow - aSent->second).count());
+			fSent.erase(aSent);
+		}
+	}
+
+	boost::asio::generic::stream_protocol::socket fSocket;
+	boost::asio::steady_timer fTimer;
+	const TLoadOptions &fOptions;
+	uint32_t fIndex;
+	TLoadStats &fStats;
+	uint64_t fSequence;
+	uint64_t fLastListId;
+	uint32_t fSegment;
+	uint32_t fFrameSequence;
+	ShmRing *fRing;
+	std::size_t fRingOffset;
+	TClock::time_point fDeadline;
+	TClock::time_point fNextWrite;
+	std::string fWriteBuffer;
+	std::string fReadBuffer;
+	char fReadChunk[4096];
+	std::map<uint64_t, TClock::time_point> fSent;
+};
+
+int main(int argc, char* argv[])
+{
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("address", po::value<std::string>()->default_value("127.0.0.1"), "set address of the bridge")
+		("port", po::value<uint16_t>(), "set port of the bridge")
+		("local", po::value<std::string>(), "set AF_UNIX socket path of the bridge, used instead of address and port")
+		("shm", po::value<std::string>(), "set name of the bridge's shared memory ring to send frames through")
+		("sessions", po::value<uint32_t>()->default_value(1), "set number of concurrent EA sessions")
+		("rate", po::value<double>()->default_value(10), "set writes per second per session, 0 sends back to back")
+		("duration", po::value<double>()->default_value(10), "set how long (s) to send for")
+		("points", po::value<uint32_t>()->default_value(20), "set points per point_list")
+		("pipeline", po::value<uint32_t>()->default_value(1), "set frames sent in each write")
+		("split", po::value<uint32_t>()->default_value(1), "set how many segments each write is cut into")
+		("split_delay_us", po::value<uint32_t>()->default_value(500), "set pause (us) between segments of a write")
+		("start_every", po::value<uint32_t>()->default_value(0), "send start after every N point lists, 0 never")
+		("load_map_every", po::value<uint32_t>()->default_value(0), "send load_map after every N point lists, 0 never")
+		("framed", po::bool_switch()->default_value(false), "use length prefixed framing instead of </robot>")
+		("drain", po::value<double>()->default_value(2), "set how long (s) to wait for outstanding acks");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || (!vm.count("port") && !vm.count("local"))) {
+		std::cout << desc << "\n";
+		return 1;
+	}
+
+	TLoadOptions aOptions;
+	aOptions.address = vm["address"].as<std::string>();
+	aOptions.port = (vm.count("port") ? vm["port"].as<uint16_t>() : 0);
+	aOptions.sessions = vm["sessions"].as<uint32_t>();
+	aOptions.rate = vm["rate"].as<double>();
+	aOptions.duration = vm["duration"].as<double>();
+	aOptions.points = vm["points"].as<uint32_t>();
+	aOptions.pipeline = vm["pipeline"].as<uint32_t>();
+	aOptions.split = vm["split"].as<uint32_t>();
+	aOptions.split_delay_us = vm["split_delay_us"].as<uint32_t>();
+	aOptions.start_every = vm["start_every"].as<uint32_t>();
+	aOptions.load_map_every = vm["load_map_every"].as<uint32_t>();
+	aOptions.framed = vm["framed"].as<bool>();
+
+	boost::asio::io_context io_context;
+	boost::asio::generic::stream_protocol::endpoint aEndpoint;
+	if (vm.count("local"))
+	{
+		aEndpoint = boost::asio::local::stream_protocol::endpoint(vm["local"].as<std::string>());
+	}
+	else
+	{
+		aEndpoint = boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address(aOptions.address), aOptions.port);
+	}
+	// Every session writes from this one thread, so the ring still has a
+	// single producer
+	ShmRing aRing;
+	if (vm.count("shm") && !aRing.Open(vm["shm"].as<std::string>()))
+	{
+		std::cerr << "shared memory ring " << vm["shm"].as<std::string>() << " could not be opened" << std::endl;
+		return 1;
+	}
+	TLoadStats aStats;
+	std::vector<std::shared_ptr<LoadSession> > aSessions;
+
+	TClock::time_point aStart = TClock::now();
+	TClock::time_point aDeadline = aStart + std::chrono::duration_cast<TClock::duration>(std::chrono::duration<double>(aOptions.duration));
+	for (uint32_t i = 0; i < aOptions.sessions; i++)
+	{
+		aSessions.push_back(std::make_shared<LoadSession>(io_context, aOptions, i, aStats, aRing.IsOpen() ? &aRing : NULL));
+		aSessions.back()->Start(aEndpoint, aDeadline);
+	}
+
+	io_context.run_until(aDeadline + std::chrono::duration_cast<TClock::duration>(std::chrono::duration<double>(vm["drain"].as<double>())));
+	for (std::vector<std::shared_ptr<LoadSession> >::iterator aIter = aSessions.begin(); aIter != aSessions.end(); aIter++)
+	{
+		(*aIter)->Close();
+	}
+	double aSeconds = aOptions.duration;
+
+	std::cout << "{\"sessions\":" << aOptions.sessions
+		<< ",\"points\":" << aOptions.points
+		<< ",\"pipeline\":" << aOptions.pipeline
+		<< ",\"split\":" << aOptions.split
+		<< ",\"framed\":" << (aOptions.framed ? "true" : "false")
+		<< ",\"frames\":" << aStats.frames
+		<< ",\"frames_per_s\":" << aStats.frames / aSeconds
+		<< ",\"bytes_per_s\":" << aStats.bytes / aSeconds
+		<< ",\"point_lists\":" << aStats.point_lists
+		<< ",\"acks\":" << aStats.acks
+		<< ",\"rejected\":" << aStats.rejected
+		<< ",\"unacked\":" << aStats.point_lists - aStats.acks
+		<< ",\"ack_p50_us\":" << Percentile(aStats.ack_latency_us, 0.5)
+		<< ",\"ack_p99_us\":" << Percentile(aStats.ack_latency_us, 0.99)
+		<< ",\"ack_max_us\":" << Percentile(aStats.ack_latency_us, 1.0)
+		<< "}" << std::endl;
+	return 0;
+}
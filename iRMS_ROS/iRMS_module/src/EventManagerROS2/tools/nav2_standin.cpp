@@ -0,0 +1,216 @@
+/*
+ * nav2_standin.cpp
+ *
+ *  Created on: 19 Oct. 2026
+ *      Author: aros
+ *
+ * Answers the follow_waypoints action and load_map service in place of a
+ * nav2 stack so the bridge can be load tested on a plain Linux box. Goal
+ * acceptance latency, progress and failures are configurable.
+ */
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_action/rclcpp_action.hpp"
+#include "nav2_msgs/action/follow_waypoints.hpp"
+#include "nav2_msgs/srv/load_map.hpp"
+
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace po = boost::program_options;
+
+class Nav2StandIn
+{
+public:
+	using FollowWaypoints = nav2_msgs::action::FollowWaypoints;
+	using GoalHandle = rclcpp_action::ServerGoalHandle<FollowWaypoints>;
+
+	typedef struct SStandInOptions
+	{
+		std::string action_name;
+		std::string load_map_name;
+		uint32_t accept_latency_ms;	// delay before a goal is accepted or rejected
+		double waypoint_time;		// seconds spent "driving" to each pose
+		double feedback_rate;		// feedback messages per second
+		double reject_ratio;		// goals rejected outright
+		double abort_ratio;			// accepted goals aborted half way
+		double miss_ratio;			// waypoints reported missed
+		uint32_t load_map_latency_ms;
+		double load_map_fail_ratio;
+	} TStandInOptions;
+
+	Nav2StandIn(const TStandInOptions &inOptions) : fOptions(inOptions), fRandom(std::random_device()()), fGoals(0)
+	{
+		fNode = std::make_shared<rclcpp::Node>("nav2_standin");
+		// Reentrant so a goal held back by accept_latency_ms does not hold up
+		// the next goal or a cancel, each waits on its own executor thread
+		fActionGroup = fNode->create_callback_group(rclcpp::CallbackGroupType::Reentrant);
+		fActionServer = rclcpp_action::create_server<FollowWaypoints>(fNode, fOptions.action_name,
+			std::bind(&Nav2StandIn::HandleGoal, this, std::placeholders::_1, std::placeholders::_2),
+			std::bind(&Nav2StandIn::HandleCancel, this, std::placeholders::_1),
+			std::bind(&Nav2StandIn::HandleAccepted, this, std::placeholders::_1),
+			rcl_action_server_get_default_options(), fActionGroup);
+		// A slow load_map holds up only later load_maps, goals keep flowing
+		fLoadMapGroup = fNode->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+		fLoadMapService = fNode->create_service<nav2_msgs::srv::LoadMap>(fOptions.load_map_name,
+			std::bind(&Nav2StandIn::HandleLoadMap, this, std::placeholders::_1, std::placeholders::_2),
+			rmw_qos_profile_services_default, fLoadMapGroup);
+	}
+
+	rclcpp::Node::SharedPtr GetNode() { return fNode; }
+private:
+	bool Chance(const double &inRatio)
+	{
+		std::lock_guard<std::mutex> aLock(fRandomMutex);
+		return std::uniform_real_distribution<double>(0, 1)(fRandom) < inRatio;
+	}
+
+	rclcpp_action::GoalResponse HandleGoal(const rclcpp_action::GoalUUID &, std::shared_ptr<const FollowWaypoints::Goal> inGoal)
+	{
+		uint64_t aGoal = ++fGoals;
+		std::this_thread::sleep_for(std::chrono::milliseconds(fOptions.accept_latency_ms));
+		if (inGoal->poses.empty() || Chance(fOptions.reject_ratio))
+		{
+			RCLCPP_INFO(fNode->get_logger(), "goal %lu rejected", static_cast<unsigned long>(aGoal));
+			return rclcpp_action::GoalResponse::REJECT;
+		}
+		RCLCPP_INFO(fNode->get_logger(), "goal %lu accepted, %zu poses", static_cast<unsigned long>(aGoal), inGoal->poses.size());
+		return rclcpp_action::GoalResponse::ACCEPT_AND_EXECUTE;
+	}
+
+	rclcpp_action::CancelResponse HandleCancel(const std::shared_ptr<GoalHandle>)
+	{
+		return rclcpp_action::CancelResponse::ACCEPT;
+	}
+
+	void HandleAccepted(const std::shared_ptr<GoalHandle> inGoalHandle)
+	{
+		// Executes off the executor so that new goals and cancels keep flowing
+		std::thread(&Nav2StandIn::Execute, this, inGoalHandle).detach();
+	}
+
+	void Execute(const std::shared_ptr<GoalHandle> inGoalHandle)
+	{
+		std::shared_ptr<const FollowWaypoints::Goal> aGoal = inGoalHandle->get_goal();
+		std::shared_ptr<FollowWaypoints::Feedback> aFeedback = std::make_shared<FollowWaypoints::Feedback>();
+		std::shared_ptr<FollowWaypoints::Result> aResult = std::make_shared<FollowWaypoints::Result>();
+		bool aAbort = Chance(fOptions.abort_ratio);
+
+		std::chrono::duration<double> aFeedbackPeriod(fOptions.feedback_rate > 0 ? 1.0 / fOptions.feedback_rate : fOptions.waypoint_time);
+		std::chrono::steady_clock::time_point aNextFeedback = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < aGoal->poses.size(); i++)
+		{
+			if (aAbort && i >= aGoal->poses.size() / 2)
+			{
+				inGoalHandle->abort(aResult);
+				return;
+			}
+			std::chrono::steady_clock::time_point aArrival = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(fOptions.waypoint_time));
+			aFeedback->current_waypoint = i;
+			do
+			{
+				if (inGoalHandle->is_canceling())
+				{
+					inGoalHandle->canceled(aResult);
+					return;
+				}
+				if (!inGoalHandle->is_active())
+				{
+					// Preempted by a newer goal
+					return;
+				}
+				if (std::chrono::steady_clock::now() >= aNextFeedback)
+				{
+					inGoalHandle->publish_feedback(aFeedback);
+					aNextFeedback += std::chrono::duration_cast<std::chrono::steady_clock::duration>(aFeedbackPeriod);
+				}
+				std::this_thread::sleep_until(std::min(aArrival, aNextFeedback));
+			} while (std::chrono::steady_clock::now() < aArrival);
+
+			if (Chance(fOptions.miss_ratio))
+			{
+				aResult->missed_waypoints.push_back(i);
+			}
+		}
+		inGoalHandle->succeed(aResult);
+	}
+
+	void HandleLoadMap(const std::shared_ptr<nav2_msgs::srv::LoadMap::Request> inRequest, std::shared_ptr<nav2_msgs::srv::LoadMap::Response> outResponse)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(fOptions.load_map_latency_ms));
+		if (Chance(fOptions.load_map_fail_ratio))
+		{
+			RCLCPP_INFO(fNode->get_logger(), "load_map %s failed", inRequest->map_url.c_str());
+			outResponse->result = nav2_msgs::srv::LoadMap::Response::RESULT_UNDEFINED_FAILURE;
+			return;
+		}
+		RCLCPP_INFO(fNode->get_logger(), "load_map %s", inRequest->map_url.c_str());
+		outResponse->result = nav2_msgs::srv::LoadMap::Response::RESULT_SUCCESS;
+	}
+
+	TStandInOptions fOptions;
+	rclcpp::Node::SharedPtr fNode;
+	rclcpp_action::Server<FollowWaypoints>::SharedPtr fActionServer;
+	rclcpp::Service<nav2_msgs::srv::LoadMap>::SharedPtr fLoadMapService;
+	rclcpp::CallbackGroup::SharedPtr fActionGroup;
+	rclcpp::CallbackGroup::SharedPtr fLoadMapGroup;
+	std::mutex fRandomMutex;
+	std::mt19937 fRandom;
+	std::atomic<uint64_t> fGoals;
+};
+
+int main(int argc, char* argv[])
+{
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("action_name", po::value<std::string>()->default_value("follow_waypoints"), "set name of the FollowWaypoints action served")
+		("load_map_name", po::value<std::string>()->default_value("load_map"), "set name of the LoadMap service served")
+		("accept_latency_ms", po::value<uint32_t>()->default_value(0), "set delay (ms) before a goal is accepted or rejected")
+		("waypoint_time", po::value<double>()->default_value(0.1), "set time (s) taken to reach each waypoint")
+		("feedback_rate", po::value<double>()->default_value(10), "set feedback messages per second, 0 sends one per waypoint")
+		("reject_ratio", po::value<double>()->default_value(0), "set fraction of goals rejected")
+		("abort_ratio", po::value<double>()->default_value(0), "set fraction of accepted goals aborted half way")
+		("miss_ratio", po::value<double>()->default_value(0), "set fraction of waypoints reported missed")
+		("load_map_latency_ms", po::value<uint32_t>()->default_value(0), "set delay (ms) before load_map responds")
+		("load_map_fail_ratio", po::value<double>()->default_value(0), "set fraction of load_map requests that fail");
+
+	// ROS arguments pass through to rclcpp::init
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help")) {
+		std::cout << desc << "\n";
+		return 1;
+	}
+
+	Nav2StandIn::TStandInOptions aOptions;
+	aOptions.action_name = vm["action_name"].as<std::string>();
+	aOptions.load_map_name = vm["load_map_name"].as<std::string>();
+	aOptions.accept_latency_ms = vm["accept_latency_ms"].as<uint32_t>();
+	aOptions.waypoint_time = vm["waypoint_time"].as<double>();
+	aOptions.feedback_rate = vm["feedback_rate"].as<double>();
+	aOptions.reject_ratio = vm["reject_ratio"].as<double>();
+	aOptions.abort_ratio = vm["abort_ratio"].as<double>();
+	aOptions.miss_ratio = vm["miss_ratio"].as<double>();
+	aOptions.load_map_latency_ms = vm["load_map_latency_ms"].as<uint32_t>();
+	aOptions.load_map_fail_ratio = vm["load_map_fail_ratio"].as<double>();
+
+	rclcpp::init(argc, argv);
+	Nav2StandIn aStandIn(aOptions);
+	// Delayed goal responses and load_map answers each hold an executor thread
+	rclcpp::executors::MultiThreadedExecutor aExecutor(rclcpp::ExecutorOptions(), std::max(4u, std::thread::hardware_concurrency()));
+	aExecutor.add_node(aStandIn.GetNode());
+	aExecutor.spin();
+	rclcpp::shutdown();
+	return 0;
+}